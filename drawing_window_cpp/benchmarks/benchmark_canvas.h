@@ -0,0 +1,74 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Synthetic drawings shared by the benchmarks, so every run times the same
+// input without a display or a recorded session.
+#pragma once
+
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "drawing_canvas.h"
+#include "strokes.h"
+
+// Size of the drawing area of the window
+constexpr int kCanvasSize = 250;
+constexpr double kBrushSize = 10.0;
+// Width the window gives every digit of a number
+constexpr int kDigitSlot = 125;
+
+// Mouse positions of a zero drawn as one stroke going count times around an
+// ellipse, with the spacing of motion events of a fast stroke, 16 ms apart
+inline StrokeSet make_stroke(size_t count) {
+  StrokeSet strokes;
+  for (size_t i = 0; i < count; i++) {
+    double angle = 0.05 * i;
+    strokes.add_point(kCanvasSize / 2 + 60 * std::cos(angle),
+                      kCanvasSize / 2 + 90 * std::sin(angle), i * 16);
+  }
+  return strokes;
+}
+
+// Black canvas with the stroke drawn like the window does
+inline Cairo::RefPtr<Cairo::ImageSurface> make_canvas() {
+  auto canvas = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, kCanvasSize,
+                                            kCanvasSize);
+  auto cr = Cairo::Context::create(canvas);
+  cr->set_source_rgb(0.0, 0.0, 0.0);
+  cr->paint();
+  cr->set_source_rgb(1.0, 1.0, 1.0);
+  DrawingCanvas::draw_points(cr, make_stroke(200), 0, kBrushSize);
+  canvas->flush();
+  return canvas;
+}
+
+// Black canvas of a number, a zero drawn in the slot of every digit, as wide
+// as the window makes it for that many digits
+inline Cairo::RefPtr<Cairo::ImageSurface> make_number_canvas(size_t digits) {
+  const int width =
+      std::max(kCanvasSize, static_cast<int>(digits) * kDigitSlot);
+  auto canvas =
+      Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, kCanvasSize);
+  auto cr = Cairo::Context::create(canvas);
+  cr->set_source_rgb(0.0, 0.0, 0.0);
+  cr->paint();
+  cr->set_source_rgb(1.0, 1.0, 1.0);
+  const double slot = static_cast<double>(width) / digits;
+  for (size_t d = 0; d < digits; d++) {
+    StrokeSet strokes;
+    for (size_t i = 0; i < 130; i++) {
+      double angle = 0.05 * i;
+      strokes.add_point((d + 0.5) * slot + 40 * std::cos(angle),
+                        kCanvasSize / 2 + 90 * std::sin(angle), i * 16);
+    }
+    DrawingCanvas::draw_points(cr, strokes, 0, kBrushSize);
+  }
+  canvas->flush();
+  return canvas;
+}
@@ -0,0 +1,129 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Benchmarks of the input adapter for every type, layout, channel count, size
+// and preprocessing. tests/input_adapter_test.cpp checks the same kernels
+// against a plain loop.
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "benchmark_canvas.h"
+#include "input_adapter.h"
+
+static const char *type_name(InputType type) {
+  switch (type) {
+    case InputType::float32:
+      return "float";
+    case InputType::int8:
+      return "int8";
+    default:
+      return "uint8";
+  }
+}
+
+// Spec of the arguments of the benchmark, the quantized types use the
+// parameters of a typical full range export
+static InputSpec make_spec(const benchmark::State &state) {
+  InputSpec spec;
+  spec.type = static_cast<InputType>(state.range(0));
+  spec.layout = static_cast<TensorLayout>(state.range(1));
+  spec.channels = static_cast<int>(state.range(2));
+  spec.width = spec.height = static_cast<int>(state.range(3));
+  if (spec.type == InputType::int8) spec.quant = {1.0f / 255.0f, -128};
+  if (spec.type == InputType::uint8) spec.quant = {1.0f / 255.0f, 0};
+  return spec;
+}
+
+template <typename T>
+static void run_image(benchmark::State &state, const InputSpec &spec,
+                      Preprocessing preprocessing) {
+  auto canvas = make_canvas();
+  InputAdapter adapter(spec, preprocessing);
+  std::vector<T> input(spec.elements());
+  for (auto _ : state) {
+    adapter.write_image(canvas->get_data(), kCanvasSize, kCanvasSize,
+                        canvas->get_stride(), input.data());
+    benchmark::DoNotOptimize(input.data());
+  }
+}
+
+// ARGB32 canvas into the input, the path of the predict button
+static void BM_InputAdapterImage(benchmark::State &state) {
+  InputSpec spec = make_spec(state);
+  auto preprocessing = static_cast<Preprocessing>(state.range(4));
+  state.SetLabel(std::string(type_name(spec.type)) + " " +
+                 layout_name(spec.layout) + " " +
+                 (preprocessing == Preprocessing::mnist ? "mnist"
+                                                        : "downscale"));
+  switch (spec.type) {
+    case InputType::float32:
+      run_image<float>(state, spec, preprocessing);
+      break;
+    case InputType::int8:
+      run_image<int8_t>(state, spec, preprocessing);
+      break;
+    default:
+      run_image<uint8_t>(state, spec, preprocessing);
+      break;
+  }
+}
+
+template <typename T>
+static void run_vector(benchmark::State &state, const InputSpec &spec) {
+  VectorCanvas canvas{make_stroke(200), kCanvasSize, kCanvasSize, kBrushSize};
+  InputAdapter adapter(spec, Preprocessing::downscale);
+  std::vector<T> input(spec.elements());
+  for (auto _ : state) {
+    adapter.write_vector(canvas, input.data());
+    benchmark::DoNotOptimize(input.data());
+  }
+}
+
+// Strokes rasterized into the input, the path of --vector
+static void BM_InputAdapterVector(benchmark::State &state) {
+  InputSpec spec = make_spec(state);
+  state.SetLabel(std::string(type_name(spec.type)) + " " +
+                 layout_name(spec.layout));
+  switch (spec.type) {
+    case InputType::float32:
+      run_vector<float>(state, spec);
+      break;
+    case InputType::int8:
+      run_vector<int8_t>(state, spec);
+      break;
+    default:
+      run_vector<uint8_t>(state, spec);
+      break;
+  }
+}
+
+// Every type, layout and channel count at the two fixed sizes and one that
+// takes the generic kernel
+static void adapter_args(benchmark::internal::Benchmark *b,
+                         bool preprocessings) {
+  b->ArgNames({"type", "layout", "channels", "side", "preprocessing"});
+  for (InputType type :
+       {InputType::float32, InputType::int8, InputType::uint8}) {
+    for (TensorLayout layout : {TensorLayout::nhwc, TensorLayout::nchw}) {
+      for (int channels : {1, 3}) {
+        for (int side : {28, 32, 40}) {
+          for (int preprocessing = 0; preprocessing < (preprocessings ? 2 : 1);
+               preprocessing++) {
+            b->Args({static_cast<int>(type), static_cast<int>(layout),
+                     channels, side, preprocessing});
+          }
+        }
+      }
+    }
+  }
+}
+BENCHMARK(BM_InputAdapterImage)->Apply([](benchmark::internal::Benchmark *b) {
+  adapter_args(b, true);
+});
+BENCHMARK(BM_InputAdapterVector)
+    ->Apply([](benchmark::internal::Benchmark *b) { adapter_args(b, false); });
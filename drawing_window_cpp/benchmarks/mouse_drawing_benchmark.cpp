@@ -0,0 +1,121 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Benchmarks of the stroke rasterization, what a frame costs when only the new
+// points are drawn against redrawing the whole stroke every frame, and the
+// model input rendered from the strokes at full size and downscaled against
+// rasterized straight at 28x28.
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "benchmark_canvas.h"
+#include "drawing_canvas.h"
+#include "preprocessing.h"
+#include "strokes.h"
+
+// Cost of one motion event with the incremental rendering, on a stroke that
+// already has range(0) points: the point is added, only the new segment is
+// rasterized and the damaged area is composited onto the window like on_draw
+// does. The time per frame should not grow with the length of the stroke
+static void BM_RasterizeIncremental(benchmark::State &state) {
+  DrawingCanvas canvas(kCanvasSize, kCanvasSize, kBrushSize);
+  auto window = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32,
+                                            kCanvasSize, kCanvasSize);
+  auto cr = Cairo::Context::create(window);
+  StrokeSet stroke = make_stroke(state.range(0));
+  const std::vector<StrokePoint> &points = stroke.points();
+  canvas.press(points[0].x, points[0].y, points[0].time);
+  for (size_t i = 1; i < points.size(); i++) {
+    canvas.move(points[i].x, points[i].y, points[i].time);
+  }
+  CanvasRect damage;
+  canvas.rasterize_pending(damage);
+
+  size_t next = 0;
+  for (auto _ : state) {
+    const StrokePoint &point = points[next];
+    next = (next + 1) % points.size();
+    canvas.move(point.x, point.y, point.time);
+    canvas.rasterize_pending(damage);
+    cr->save();
+    cr->rectangle(damage.x, damage.y, damage.width, damage.height);
+    cr->clip();
+    cr->set_source(canvas.surface(), 0.0, 0.0);
+    cr->paint();
+    cr->restore();
+  }
+  window->flush();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RasterizeIncremental)->Arg(100)->Arg(1000)->Arg(10000);
+
+// Cost of one frame when every point is redrawn, as on_draw did before the
+// persistent surface
+static void BM_RasterizeFullRedraw(benchmark::State &state) {
+  auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32,
+                                             kCanvasSize, kCanvasSize);
+  auto cr = Cairo::Context::create(surface);
+  StrokeSet stroke = make_stroke(state.range(0));
+  for (auto _ : state) {
+    cr->set_source_rgb(0.0, 0.0, 0.0);
+    cr->paint();
+    cr->set_source_rgb(1.0, 1.0, 1.0);
+    DrawingCanvas::draw_points(cr, stroke, 0, kBrushSize);
+    surface->flush();
+  }
+  state.SetItemsProcessed(state.iterations() * stroke.size());
+}
+BENCHMARK(BM_RasterizeFullRedraw)->Arg(100)->Arg(1000)->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+
+// Model input from the strokes, render the canvas and downscale it
+static void BM_RenderAndDownscale(benchmark::State &state) {
+  auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32,
+                                             kCanvasSize, kCanvasSize);
+  auto cr = Cairo::Context::create(surface);
+  StrokeSet stroke = make_stroke(state.range(0));
+  GrayDownscaler downscaler(kCanvasSize, kCanvasSize, 28, 28);
+  const InputLut<float> lut = make_input_lut<float>(0.0f, 0);
+  std::vector<float> pixels(28 * 28);
+  for (auto _ : state) {
+    cr->set_source_rgb(0.0, 0.0, 0.0);
+    cr->paint();
+    cr->set_source_rgb(1.0, 1.0, 1.0);
+    DrawingCanvas::draw_points(cr, stroke, 0, kBrushSize);
+    surface->flush();
+    downscaler.run<float>(surface->get_data(), surface->get_stride(),
+                          pixels.data(), lut);
+    benchmark::DoNotOptimize(pixels.data());
+  }
+}
+BENCHMARK(BM_RenderAndDownscale)->Arg(100)->Arg(1000);
+
+// Model input from the strokes rasterized straight at 28x28
+static void BM_VectorRasterize(benchmark::State &state) {
+  StrokeSet stroke = make_stroke(state.range(0));
+  StrokeRasterizer rasterizer;
+  const InputLut<float> lut = make_input_lut<float>(0.0f, 0);
+  std::vector<float> pixels(28 * 28);
+  for (auto _ : state) {
+    rasterizer.run<float>(stroke, kBrushSize, kCanvasSize, kCanvasSize, 28, 28,
+                          pixels.data(), lut);
+    benchmark::DoNotOptimize(pixels.data());
+  }
+}
+BENCHMARK(BM_VectorRasterize)->Arg(100)->Arg(1000);
+
+// Same with the MNIST normalization, two passes
+static void BM_VectorRasterizeNormalized(benchmark::State &state) {
+  StrokeSet stroke = make_stroke(state.range(0));
+  StrokeRasterizer rasterizer;
+  const InputLut<float> lut = make_input_lut<float>(0.0f, 0);
+  std::vector<float> pixels(28 * 28);
+  for (auto _ : state) {
+    rasterizer.run_normalized<float>(stroke, kBrushSize, pixels.data(), lut);
+    benchmark::DoNotOptimize(pixels.data());
+  }
+}
+BENCHMARK(BM_VectorRasterizeNormalized)->Arg(100)->Arg(1000);
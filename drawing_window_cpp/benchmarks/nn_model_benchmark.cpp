@@ -0,0 +1,102 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Benchmarks of the inference on a float and an int8 model. The models are
+// taken from the environment so the benchmark runs with the stock TFLite CPU
+// kernels on any machine:
+//   WINDOW_BENCH_FLOAT_MODEL=cnn.tflite
+//   WINDOW_BENCH_INT8_MODEL=cnn_quant.tflite
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark_canvas.h"
+#include "nn_model.h"
+#include "predictor.h"
+
+// Builds the interpreter for the model named by variable, or returns null and
+// marks the benchmark as skipped
+static std::unique_ptr<NnModel> load_model(benchmark::State &state,
+                                           const char *variable) {
+  const char *path = std::getenv(variable);
+  if (path == nullptr) {
+    state.SkipWithError((std::string(variable) + " is not set").c_str());
+    return nullptr;
+  }
+  try {
+    NnModelOptions options;
+    options.backends = {Backend::builtin};
+    return std::make_unique<NnModel>(NnModel::load_model(path), options);
+  } catch (const std::exception &e) {
+    state.SkipWithError(e.what());
+    return nullptr;
+  }
+}
+
+// Compatibility API, copies the input in and the scores out
+template <typename T>
+static void run_infer(benchmark::State &state, const char *variable) {
+  auto nn = load_model(state, variable);
+  if (!nn) return;
+  std::vector<T> input(nn->input_span<T>().size);
+  for (auto _ : state) {
+    std::vector<T> scores = nn->infer<T>(input);
+    benchmark::DoNotOptimize(scores.data());
+  }
+}
+static void BM_InferFloat(benchmark::State &state) {
+  run_infer<float>(state, "WINDOW_BENCH_FLOAT_MODEL");
+}
+BENCHMARK(BM_InferFloat);
+static void BM_InferInt8(benchmark::State &state) {
+  run_infer<int8_t>(state, "WINDOW_BENCH_INT8_MODEL");
+}
+BENCHMARK(BM_InferInt8);
+
+// Zero-copy path used by the window, canvas to digit
+static void BM_Predict(benchmark::State &state, const char *variable) {
+  auto nn = load_model(state, variable);
+  if (!nn) return;
+  auto canvas = make_canvas();
+  Predictor predictor(*nn);
+  for (auto _ : state) {
+    int digit = predictor.predict(canvas->get_data(), kCanvasSize, kCanvasSize,
+                                  canvas->get_stride());
+    benchmark::DoNotOptimize(digit);
+  }
+}
+BENCHMARK_CAPTURE(BM_Predict, float, "WINDOW_BENCH_FLOAT_MODEL");
+BENCHMARK_CAPTURE(BM_Predict, int8, "WINDOW_BENCH_INT8_MODEL");
+
+// Post-processing alone on the output of one invoke, the argmax against the
+// top 3 with probabilities
+static void BM_Argmax(benchmark::State &state, const char *variable) {
+  auto nn = load_model(state, variable);
+  if (!nn) return;
+  Predictor predictor(*nn);
+  nn->invoke();
+  for (auto _ : state) {
+    int digit = predictor.result(0);
+    benchmark::DoNotOptimize(digit);
+  }
+}
+BENCHMARK_CAPTURE(BM_Argmax, float, "WINDOW_BENCH_FLOAT_MODEL");
+BENCHMARK_CAPTURE(BM_Argmax, int8, "WINDOW_BENCH_INT8_MODEL");
+static void BM_TopK(benchmark::State &state, const char *variable) {
+  auto nn = load_model(state, variable);
+  if (!nn) return;
+  nn->invoke();
+  ClassScore top[3];
+  for (auto _ : state) {
+    size_t count = nn->top_k(0, top, 3);
+    benchmark::DoNotOptimize(count);
+    benchmark::DoNotOptimize(top);
+  }
+}
+BENCHMARK_CAPTURE(BM_TopK, float, "WINDOW_BENCH_FLOAT_MODEL");
+BENCHMARK_CAPTURE(BM_TopK, int8, "WINDOW_BENCH_INT8_MODEL");
@@ -0,0 +1,84 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Benchmarks of the number mode against the number of digits, the
+// segmentation alone and the whole read with every digit in one batched
+// invoke or one invoke per digit. The model is taken from the environment:
+//   WINDOW_BENCH_FLOAT_MODEL=cnn.tflite
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark_canvas.h"
+#include "digit_segmenter.h"
+#include "nn_model.h"
+#include "number_reader.h"
+
+// Builds the interpreter for the model named by variable, or returns null and
+// marks the benchmark as skipped
+static std::unique_ptr<NnModel> load_model(benchmark::State &state,
+                                           const char *variable) {
+  const char *path = std::getenv(variable);
+  if (path == nullptr) {
+    state.SkipWithError((std::string(variable) + " is not set").c_str());
+    return nullptr;
+  }
+  try {
+    NnModelOptions options;
+    options.backends = {Backend::builtin};
+    return std::make_unique<NnModel>(NnModel::load_model(path), options);
+  } catch (const std::exception &e) {
+    state.SkipWithError(e.what());
+    return nullptr;
+  }
+}
+
+// Labeling, boxes and crops of a number of state.range(0) digits
+static void BM_Segment(benchmark::State &state) {
+  const size_t digits = state.range(0);
+  auto canvas = make_number_canvas(digits);
+  DigitSegmenter segmenter;
+  for (auto _ : state) {
+    size_t count = segmenter.run(canvas->get_data(), canvas->get_width(),
+                                 canvas->get_height(), canvas->get_stride());
+    for (size_t i = 0; i < count; i++) {
+      benchmark::DoNotOptimize(segmenter.crop(i));
+    }
+  }
+  if (segmenter.digits().size() != digits) {
+    state.SkipWithError("Wrong number of digits segmented");
+  }
+  state.SetItemsProcessed(state.iterations() * digits);
+}
+BENCHMARK(BM_Segment)->DenseRange(1, NumberReader::kMaxDigits, 2);
+
+// Canvas to number, batched reads every digit with a single invoke and
+// sequential with one invoke per digit, the per digit time is the items rate
+static void BM_ReadNumber(benchmark::State &state, bool batched) {
+  auto nn = load_model(state, "WINDOW_BENCH_FLOAT_MODEL");
+  if (!nn) return;
+  const size_t digits = state.range(0);
+  auto canvas = make_number_canvas(digits);
+  NumberReader reader(*nn, digits);
+  // The reader splits the digits over the batch of the model
+  if (!batched) nn->set_batch_size(1);
+  std::vector<int> number;
+  for (auto _ : state) {
+    bool ok = reader.read(canvas->get_data(), canvas->get_width(),
+                          canvas->get_height(), canvas->get_stride(), number);
+    benchmark::DoNotOptimize(ok);
+  }
+  if (number.size() != digits) {
+    state.SkipWithError("Wrong number of digits read");
+  }
+  state.SetItemsProcessed(state.iterations() * digits);
+}
+BENCHMARK_CAPTURE(BM_ReadNumber, batched, true)
+    ->DenseRange(1, NumberReader::kMaxDigits, 2);
+BENCHMARK_CAPTURE(BM_ReadNumber, sequential, false)
+    ->DenseRange(1, NumberReader::kMaxDigits, 2);
@@ -0,0 +1,128 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Benchmarks of the canvas to model input conversion, the integer kernel
+// against the Cairo scaling it replaced.
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "benchmark_canvas.h"
+#include "preprocessing.h"
+
+// Lut of a model with the usual [0, 1] input quantization, float ignores the
+// parameters
+template <typename T>
+static InputLut<T> model_lut() {
+  if constexpr (std::is_same_v<T, int8_t>) {
+    return make_input_lut<T>(1.0f / 255.0f, -128);
+  } else {
+    return make_input_lut<T>(1.0f / 255.0f, 0);
+  }
+}
+
+// Former export_to_vector, Cairo scales the canvas and the luminance is
+// computed in floating point per pixel
+template <typename T>
+static std::vector<T> cairo_reference(
+    const Cairo::RefPtr<Cairo::ImageSurface> &canvas, int w, int h,
+    const InputLut<T> &lut) {
+  auto scaled = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, w, h);
+  auto cr = Cairo::Context::create(scaled);
+  cr->scale(static_cast<double>(w) / canvas->get_width(),
+            static_cast<double>(h) / canvas->get_height());
+  cr->set_source(Cairo::SurfacePattern::create(canvas));
+  cr->paint();
+  scaled->flush();
+
+  const uint8_t *data = scaled->get_data();
+  int stride = scaled->get_stride();
+  std::vector<T> pixels(w * h);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      const uint8_t *pixel = data + y * stride + x * 4;
+      auto gray = static_cast<uint8_t>(0.2126 * pixel[2] + 0.7152 * pixel[1] +
+                                       0.0722 * pixel[0]);
+      pixels[y * w + x] = lut[gray];
+    }
+  }
+  return pixels;
+}
+
+template <typename T>
+static void BM_CairoReference(benchmark::State &state) {
+  auto canvas = make_canvas();
+  const InputLut<T> lut = model_lut<T>();
+  for (auto _ : state) {
+    std::vector<T> pixels = cairo_reference<T>(canvas, 28, 28, lut);
+    benchmark::DoNotOptimize(pixels.data());
+  }
+}
+BENCHMARK_TEMPLATE(BM_CairoReference, float);
+BENCHMARK_TEMPLATE(BM_CairoReference, int8_t);
+
+// One shot conversion, builds the filter taps and the output vector per call
+template <typename T>
+static void BM_GrayDownscalerOneShot(benchmark::State &state) {
+  auto canvas = make_canvas();
+  const InputLut<T> lut = model_lut<T>();
+  for (auto _ : state) {
+    GrayDownscaler downscaler(kCanvasSize, kCanvasSize, 28, 28);
+    std::vector<T> pixels(28 * 28);
+    downscaler.run<T>(canvas->get_data(), canvas->get_stride(), pixels.data(),
+                      lut);
+    benchmark::DoNotOptimize(pixels.data());
+  }
+}
+BENCHMARK_TEMPLATE(BM_GrayDownscalerOneShot, float);
+BENCHMARK_TEMPLATE(BM_GrayDownscalerOneShot, int8_t);
+
+// Steady state of the Predictor, taps configured once and the lut fused into
+// the writes, nothing is allocated
+template <typename T>
+static void BM_GrayDownscaler(benchmark::State &state) {
+  auto canvas = make_canvas();
+  GrayDownscaler downscaler(kCanvasSize, kCanvasSize, 28, 28);
+  const InputLut<T> lut = model_lut<T>();
+  std::vector<T> pixels(28 * 28);
+  for (auto _ : state) {
+    downscaler.run<T>(canvas->get_data(), canvas->get_stride(), pixels.data(),
+                      lut);
+    benchmark::DoNotOptimize(pixels.data());
+  }
+}
+BENCHMARK_TEMPLATE(BM_GrayDownscaler, float);
+BENCHMARK_TEMPLATE(BM_GrayDownscaler, int8_t);
+BENCHMARK_TEMPLATE(BM_GrayDownscaler, uint8_t);
+
+// Luminance of one row of the canvas
+static void BM_ArgbToLuminance(benchmark::State &state) {
+  auto canvas = make_canvas();
+  std::vector<uint8_t> row(kCanvasSize);
+  for (auto _ : state) {
+    argb_to_luminance(canvas->get_data(), row.data(), kCanvasSize);
+    benchmark::DoNotOptimize(row.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kCanvasSize);
+}
+BENCHMARK(BM_ArgbToLuminance);
+
+// MNIST normalization of the canvas, gray pass plus the bounding box crop
+template <typename T>
+static void BM_DigitNormalizer(benchmark::State &state) {
+  auto canvas = make_canvas();
+  DigitNormalizer normalizer;
+  const InputLut<T> lut = model_lut<T>();
+  std::vector<T> pixels(DigitNormalizer::kSize * DigitNormalizer::kSize);
+  for (auto _ : state) {
+    normalizer.run<T>(canvas->get_data(), kCanvasSize, kCanvasSize,
+                      canvas->get_stride(), pixels.data(), lut);
+    benchmark::DoNotOptimize(pixels.data());
+  }
+}
+BENCHMARK_TEMPLATE(BM_DigitNormalizer, float);
+BENCHMARK_TEMPLATE(BM_DigitNormalizer, int8_t);
@@ -0,0 +1,397 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of the headless benchmark mode
+#include "bench.h"
+
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+#include "idx_file.h"
+#include "nn_model_pool.h"
+#include "percentile.h"
+#include "predictor.h"
+#include "startup_timing.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Converts a gray image to the ARGB32 layout of the canvas
+static Sample sample_from_gray(const uint8_t *gray, int width, int height,
+                               int label) {
+  Sample sample;
+  sample.width = width;
+  sample.height = height;
+  sample.stride = width * 4;
+  sample.label = label;
+  sample.argb.resize(sample.stride * height);
+  for (int i = 0; i < width * height; i++) {
+    uint8_t *pixel = sample.argb.data() + i * 4;
+    pixel[0] = pixel[1] = pixel[2] = gray[i];
+    pixel[3] = 255;
+  }
+  return sample;
+}
+
+// Loads a PNG through Cairo, painting it over black like the canvas
+static bool sample_from_png(const std::string &path, int label,
+                            Sample &sample) {
+  Cairo::RefPtr<Cairo::ImageSurface> png;
+  try {
+    png = Cairo::ImageSurface::create_from_png(path);
+  } catch (const std::exception &e) {
+    std::cerr << "Failed to load " << path << ": " << e.what() << std::endl;
+    return false;
+  }
+
+  Cairo::RefPtr<Cairo::ImageSurface> argb = Cairo::ImageSurface::create(
+      Cairo::FORMAT_ARGB32, png->get_width(), png->get_height());
+  Cairo::RefPtr<Cairo::Context> context = Cairo::Context::create(argb);
+  context->set_source_rgb(0.0, 0.0, 0.0);
+  context->paint();
+  context->set_source(png, 0.0, 0.0);
+  context->paint();
+  argb->flush();
+
+  sample.width = argb->get_width();
+  sample.height = argb->get_height();
+  sample.stride = argb->get_stride();
+  sample.label = label;
+  const uint8_t *data = argb->get_data();
+  sample.argb.assign(data, data + sample.stride * sample.height);
+  return true;
+}
+
+bool load_samples(const BenchConfig &config, std::vector<Sample> &samples) {
+  if (config.idx_images != nullptr) {
+    IdxData images, labels;
+    if (!read_idx(config.idx_images, images)) return false;
+    if (images.dims.size() != 3) {
+      std::cerr << "Expected count x rows x cols images" << std::endl;
+      return false;
+    }
+    if (config.idx_labels != nullptr) {
+      if (!read_idx(config.idx_labels, labels)) return false;
+      if (labels.dims.size() != 1 || labels.dims[0] != images.dims[0]) {
+        std::cerr << "Labels do not match the images" << std::endl;
+        return false;
+      }
+    }
+
+    size_t count = images.dims[0];
+    if (config.limit) count = std::min(count, config.limit);
+    int rows = images.dims[1];
+    int cols = images.dims[2];
+    samples.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      int label = labels.data.empty() ? -1 : labels.data[i];
+      samples.push_back(sample_from_gray(images.data.data() + i * rows * cols,
+                                         cols, rows, label));
+    }
+  }
+
+  if (config.input_dir != nullptr) {
+    std::vector<std::filesystem::path> paths;
+    std::error_code error;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(config.input_dir, error)) {
+      if (entry.path().extension() == ".png") paths.push_back(entry.path());
+    }
+    if (error) {
+      std::cerr << "Failed to list " << config.input_dir << ": "
+                << error.message() << std::endl;
+      return false;
+    }
+    // Keep the runs reproducible
+    std::sort(paths.begin(), paths.end());
+    for (const auto &path : paths) {
+      if (config.limit && samples.size() >= config.limit) break;
+      std::string name = path.filename().string();
+      int label = std::isdigit(static_cast<unsigned char>(name[0]))
+                      ? name[0] - '0'
+                      : -1;
+      Sample sample;
+      if (sample_from_png(path.string(), label, sample))
+        samples.push_back(std::move(sample));
+    }
+  }
+
+  if (samples.empty()) {
+    std::cerr << "No samples to run, use --input-dir or --idx" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Runs all the samples again with batch images per invoke and compares the
+// throughput against the single image run
+static size_t run_batched(NnModel &nn, Predictor &predictor,
+                          const std::vector<Sample> &samples, int batch,
+                          double single_throughput) {
+  if (!nn.set_batch_size(batch)) {
+    std::cout << "Batch " << batch << " not supported, looping instead"
+              << std::endl;
+    return 0;
+  }
+
+  std::vector<ImageView> images;
+  images.reserve(samples.size());
+  for (const Sample &sample : samples) {
+    images.push_back(
+        {sample.argb.data(), sample.width, sample.height, sample.stride});
+  }
+  std::vector<int> digits(samples.size());
+
+  // Warm up the resized graph
+  predictor.predict_batch(images.data(), std::min<size_t>(batch, images.size()),
+                          digits.data());
+
+  auto start = Clock::now();
+  size_t failed =
+      predictor.predict_batch(images.data(), images.size(), digits.data());
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  size_t labeled = 0, correct = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    if (samples[i].label < 0) continue;
+    labeled++;
+    if (digits[i] == samples[i].label) correct++;
+  }
+
+  double throughput = samples.size() / elapsed.count();
+  std::cout << "Batch " << batch << " throughput: " << throughput
+            << " images/s (" << throughput / single_throughput
+            << "x batch 1)" << std::endl;
+  if (labeled) {
+    std::cout << "Batch " << batch << " accuracy: " << correct << "/"
+              << labeled << std::endl;
+  }
+  if (failed) std::cerr << "Failed batched inferences: " << failed << std::endl;
+  return failed;
+}
+
+// Runs all the samples on pools of 1 to max_workers interpreters sharing the
+// model of nn and reports the throughput of each one and the resident memory,
+// which only grows by the interpreter arenas since the weights are shared.
+// The workers use the preprocessing of the main run so both measure the same
+// pipeline
+static size_t run_pool_scaling(NnModel &nn, const std::vector<Sample> &samples,
+                               int max_workers,
+                               const NnModelOptions &options,
+                               Preprocessing preprocessing) {
+  size_t failed = 0;
+  double baseline = 0.0;
+  std::vector<std::future<int>> results;
+  results.reserve(samples.size());
+  for (int workers = 1; workers <= max_workers; workers++) {
+    NnModelPool pool(nn.model(), options, workers, preprocessing);
+    // Warm up every interpreter
+    const Sample &first = samples.front();
+    for (int i = 0; i < workers; i++) {
+      results.push_back(pool.submit(
+          {first.argb.data(), first.width, first.height, first.stride}));
+    }
+    for (auto &result : results) result.get();
+    results.clear();
+
+    auto start = Clock::now();
+    for (const Sample &sample : samples) {
+      results.push_back(pool.submit(
+          {sample.argb.data(), sample.width, sample.height, sample.stride}));
+    }
+    size_t correct = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+      int number = results[i].get();
+      if (number < 0) failed++;
+      if (samples[i].label >= 0 && number == samples[i].label) correct++;
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    results.clear();
+
+    double throughput = samples.size() / elapsed.count();
+    if (workers == 1) baseline = throughput;
+    std::cout << "Pool " << workers << " workers: " << throughput
+              << " images/s (" << throughput / baseline << "x), correct "
+              << correct << ", RSS " << resident_memory_kb() / 1024.0 << " MB"
+              << std::endl;
+  }
+  return failed;
+}
+
+// Draws the sample on a black canvas of the window size at a random scale and
+// position, like a digit drawn small or off center. Bilinear on the gray
+static Sample shift_and_scale(const Sample &sample, int canvas,
+                              std::mt19937 &rng) {
+  std::uniform_real_distribution<double> scale(0.3, 0.9);
+  int size = static_cast<int>(canvas * scale(rng));
+  std::uniform_int_distribution<int> offset(0, canvas - size);
+  int left = offset(rng);
+  int top = offset(rng);
+
+  Sample shifted;
+  shifted.width = canvas;
+  shifted.height = canvas;
+  shifted.stride = canvas * 4;
+  shifted.label = sample.label;
+  shifted.argb.assign(shifted.stride * canvas, 0);
+  auto gray = [&sample](int x, int y) {
+    x = std::clamp(x, 0, sample.width - 1);
+    y = std::clamp(y, 0, sample.height - 1);
+    return static_cast<double>(sample.argb[y * sample.stride + x * 4 + 1]);
+  };
+  for (int y = 0; y < size; y++) {
+    double sy = (y + 0.5) * sample.height / size - 0.5;
+    int y0 = static_cast<int>(std::floor(sy));
+    double fy = sy - y0;
+    for (int x = 0; x < size; x++) {
+      double sx = (x + 0.5) * sample.width / size - 0.5;
+      int x0 = static_cast<int>(std::floor(sx));
+      double fx = sx - x0;
+      double value =
+          (1 - fy) * ((1 - fx) * gray(x0, y0) + fx * gray(x0 + 1, y0)) +
+          fy * ((1 - fx) * gray(x0, y0 + 1) + fx * gray(x0 + 1, y0 + 1));
+      uint8_t *pixel =
+          shifted.argb.data() + (top + y) * shifted.stride + (left + x) * 4;
+      pixel[0] = pixel[1] = pixel[2] = static_cast<uint8_t>(value + 0.5);
+    }
+  }
+  for (size_t i = 3; i < shifted.argb.size(); i += 4) shifted.argb[i] = 255;
+  return shifted;
+}
+
+// Accuracy and preprocessing cost of every preprocessing on the samples as
+// they are and on shifted and scaled copies of them
+static void run_preprocessing_comparison(NnModel &nn,
+                                         const std::vector<Sample> &samples) {
+  std::vector<Sample> shifted;
+  shifted.reserve(samples.size());
+  std::mt19937 rng(1234);  // Same copies on every run
+  for (const Sample &sample : samples) {
+    if (sample.label >= 0) shifted.push_back(shift_and_scale(sample, 250, rng));
+  }
+  if (shifted.empty()) {
+    std::cout << "Preprocessing comparison requires labels" << std::endl;
+    return;
+  }
+
+  const struct {
+    Preprocessing preprocessing;
+    const char *name;
+  } modes[] = {{Preprocessing::downscale, "downscale"},
+               {Preprocessing::mnist, "mnist"}};
+  const struct {
+    const std::vector<Sample> *samples;
+    const char *name;
+  } sets[] = {{&samples, "as is"}, {&shifted, "shifted/scaled 250x250"}};
+  for (const auto &mode : modes) {
+    Predictor predictor(nn, mode.preprocessing);
+    for (const auto &set : sets) {
+      size_t labeled = 0, correct = 0;
+      std::chrono::duration<double, std::micro> preprocess{0};
+      for (const Sample &sample : *set.samples) {
+        if (sample.label < 0) continue;
+        auto start = Clock::now();
+        bool ok = predictor.preprocess(sample.argb.data(), sample.width,
+                                       sample.height, sample.stride);
+        preprocess += Clock::now() - start;
+        labeled++;
+        if (ok && predictor.infer() == sample.label) correct++;
+      }
+      std::cout << "Preprocessing " << mode.name << ", " << set.name
+                << ": accuracy " << 100.0 * correct / labeled
+                << "%, preprocess mean " << preprocess.count() / labeled
+                << " us" << std::endl;
+    }
+  }
+}
+
+// Runs every sample through the same Predictor used by the window and
+// measures the preprocessing and the invoke separately
+int run_bench(NnModel &nn, const BenchConfig &config) {
+  std::vector<Sample> samples;
+  if (!load_samples(config, samples)) return 1;
+  std::cout << "Samples: " << samples.size() << std::endl;
+
+  Predictor predictor(nn, config.preprocessing);
+  // Warm up so the first invoke penalty is not part of the numbers
+  for (size_t i = 0; i < config.warmup; i++) {
+    const Sample &sample = samples[i % samples.size()];
+    predictor.predict(sample.argb.data(), sample.width, sample.height,
+                      sample.stride);
+  }
+
+  std::vector<double> latency_us, preprocess_us, invoke_us;
+  latency_us.reserve(samples.size());
+  preprocess_us.reserve(samples.size());
+  invoke_us.reserve(samples.size());
+  size_t labeled = 0, correct = 0, failed = 0;
+
+  auto bench_start = Clock::now();
+  for (const Sample &sample : samples) {
+    auto start = Clock::now();
+    bool ok = predictor.preprocess(sample.argb.data(), sample.width,
+                                   sample.height, sample.stride);
+    auto preprocessed = Clock::now();
+    int number = ok ? predictor.infer() : -1;
+    auto end = Clock::now();
+
+    preprocess_us.push_back(
+        std::chrono::duration<double, std::micro>(preprocessed - start)
+            .count());
+    invoke_us.push_back(
+        std::chrono::duration<double, std::micro>(end - preprocessed).count());
+    latency_us.push_back(
+        std::chrono::duration<double, std::micro>(end - start).count());
+
+    if (number < 0) failed++;
+    if (sample.label >= 0) {
+      labeled++;
+      if (number == sample.label) correct++;
+    }
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - bench_start;
+
+  auto mean = [](const std::vector<double> &values) {
+    double sum = 0.0;
+    for (double v : values) sum += v;
+    return values.empty() ? 0.0 : sum / values.size();
+  };
+  std::cout << "Throughput: " << samples.size() / elapsed.count()
+            << " images/s" << std::endl;
+  std::cout << "Preprocess mean: " << mean(preprocess_us) << " us"
+            << std::endl;
+  std::cout << "Invoke mean: " << mean(invoke_us) << " us" << std::endl;
+  std::sort(latency_us.begin(), latency_us.end());
+  std::cout << "Latency p50/p95/p99: " << percentile(latency_us, 50) << "/"
+            << percentile(latency_us, 95) << "/" << percentile(latency_us, 99)
+            << " us" << std::endl;
+  if (labeled) {
+    std::cout << "Accuracy: " << correct << "/" << labeled << " ("
+              << 100.0 * correct / labeled << "%)" << std::endl;
+  }
+  if (failed) std::cerr << "Failed inferences: " << failed << std::endl;
+
+  if (config.batch > 1) {
+    double single = samples.size() / elapsed.count();
+    failed += run_batched(nn, predictor, samples, config.batch, single);
+  }
+  if (config.compare_preprocessing) run_preprocessing_comparison(nn, samples);
+  if (config.workers > 0) {
+    NnModelOptions options = config.model_options;
+    options.verbose = false;
+    failed += run_pool_scaling(nn, samples, config.workers, options,
+                               config.preprocessing);
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of the headless benchmark mode, it runs a dataset through the
+// same preprocessing and inference path used by the window.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "nn_model.h"
+#include "predictor.h"
+
+// Options for the headless benchmark
+struct BenchConfig {
+  const char *input_dir = nullptr;   // Directory with PNG files
+  const char *idx_images = nullptr;  // MNIST IDX images file
+  const char *idx_labels = nullptr;  // MNIST IDX labels file, optional
+  size_t limit = 0;                  // Max samples to run, 0 runs all
+  size_t warmup = 10;                // Untimed invokes before measuring
+  int batch = 1;                     // Images per invoke for the batched run
+  int workers = 0;                   // Max workers for the pool scaling run
+  NnModelOptions model_options;      // Used to build the pool interpreters
+  Preprocessing preprocessing = Preprocessing::downscale;
+  // Compares the accuracy and the cost of every preprocessing on the samples
+  // and on copies shifted and scaled on a canvas of the window size
+  bool compare_preprocessing = false;
+};
+
+// Image in the same ARGB32 layout as the canvas and its label, -1 if unknown
+struct Sample {
+  std::vector<uint8_t> argb;
+  int width = 0;
+  int height = 0;
+  int stride = 0;
+  int label = -1;
+};
+
+/// Loads the samples described by config
+/// PNG labels are taken from the first character of the file name if it is
+/// a digit, e.g. 7_0001.png
+bool load_samples(const BenchConfig &config, std::vector<Sample> &samples);
+
+/// Runs the benchmark and prints images/s, the latency percentiles and the
+/// accuracy. With a batch bigger than 1 the samples are run again batched
+/// and the throughput gain is reported. With workers the samples are run on
+/// an NnModelPool of 1..workers interpreters to show how it scales. With
+/// compare_preprocessing the accuracy of every preprocessing is reported on
+/// the samples as they are and shifted and scaled like user drawings.
+/// Returns the process exit code
+int run_bench(NnModel &nn, const BenchConfig &config);
@@ -0,0 +1,262 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of DatasetWriter
+#include "dataset_writer.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "tracing.h"
+
+namespace {
+
+// Magic, count, rows and cols for the images, magic and count for the labels
+constexpr size_t kImagesHeader = 16;
+constexpr size_t kLabelsHeader = 8;
+constexpr size_t kImageBytes = DatasetWriter::kSize * DatasetWriter::kSize;
+
+// IDX stores the header as big endian 32 bit integers
+void put_be32(uint8_t *bytes, uint32_t value) {
+  bytes[0] = value >> 24;
+  bytes[1] = value >> 16;
+  bytes[2] = value >> 8;
+  bytes[3] = value;
+}
+
+uint32_t get_be32(const uint8_t *bytes) {
+  return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) |
+         (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+
+bool write_all(int fd, const void *data, size_t size, off_t offset) {
+  const char *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t written = pwrite(fd, bytes, size, offset);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    bytes += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+// The count is the first dimension, right after the magic
+bool write_count(int fd, uint32_t count) {
+  uint8_t bytes[4];
+  put_be32(bytes, count);
+  return write_all(fd, bytes, sizeof(bytes), 4);
+}
+
+// Creates path with the header or checks that the header of the file matches
+// it but for the count. Returns the descriptor and the number of complete
+// samples in count, or -1 and prints the reason
+int open_idx(const std::string &path, const uint8_t *header,
+             size_t header_size, size_t sample_size, uint32_t &count) {
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << path << ": " << std::strerror(errno)
+              << std::endl;
+    return -1;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    std::cerr << "Failed to stat " << path << ": " << std::strerror(errno)
+              << std::endl;
+    close(fd);
+    return -1;
+  }
+
+  count = 0;
+  if (info.st_size == 0) {
+    if (!write_all(fd, header, header_size, 0)) {
+      std::cerr << "Failed to write " << path << ": " << std::strerror(errno)
+                << std::endl;
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  uint8_t existing[kImagesHeader];
+  if (static_cast<size_t>(info.st_size) < header_size ||
+      pread(fd, existing, header_size, 0) !=
+          static_cast<ssize_t>(header_size) ||
+      std::memcmp(existing, header, 4) != 0 ||
+      std::memcmp(existing + 8, header + 8, header_size - 8) != 0) {
+    std::cerr << "Not a 28x28 capture file: " << path << std::endl;
+    close(fd);
+    return -1;
+  }
+  uint64_t complete = (info.st_size - header_size) / sample_size;
+  count = static_cast<uint32_t>(
+      std::min<uint64_t>(get_be32(existing + 4), complete));
+  return fd;
+}
+
+}  // namespace
+
+// A pair left inconsistent by a crash is cut to the samples both files hold
+DatasetWriter::DatasetWriter(const std::string &prefix,
+                             const CaptureConfig &config)
+    : images_path_(prefix + "-images-idx3-ubyte"),
+      labels_path_(prefix + "-labels-idx1-ubyte"),
+      config_(config),
+      identity_(make_input_lut<uint8_t>(0.0f, 0)) {
+  config_.max_pending = std::max<size_t>(config_.max_pending, 1);
+  uint8_t images_header[kImagesHeader] = {0, 0, 0x08, 3};
+  put_be32(images_header + 8, kSize);
+  put_be32(images_header + 12, kSize);
+  uint8_t labels_header[kLabelsHeader] = {0, 0, 0x08, 1};
+
+  uint32_t images = 0, labels = 0;
+  images_fd_ = open_idx(images_path_, images_header, kImagesHeader,
+                        kImageBytes, images);
+  if (images_fd_ >= 0) {
+    labels_fd_ =
+        open_idx(labels_path_, labels_header, kLabelsHeader, 1, labels);
+  }
+  count_ = std::min(images, labels);
+  if (labels_fd_ < 0 ||
+      ftruncate(images_fd_, kImagesHeader + count_ * kImageBytes) != 0 ||
+      ftruncate(labels_fd_, kLabelsHeader + count_) != 0 ||
+      !write_count(images_fd_, count_) || !write_count(labels_fd_, count_)) {
+    if (labels_fd_ >= 0) {
+      std::cerr << "Failed to prepare the capture files: "
+                << std::strerror(errno) << std::endl;
+      close(labels_fd_);
+    }
+    if (images_fd_ >= 0) close(images_fd_);
+    throw std::runtime_error("Unable to open the capture files");
+  }
+  std::cout << "Capturing to " << images_path_ << " and " << labels_path_
+            << ", " << count_ << " samples so far" << std::endl;
+
+  stats_.written = count_;
+  pending_.reserve(config_.max_pending);
+  last_sync_ = std::chrono::steady_clock::now();
+  thread_ = std::thread(&DatasetWriter::run, this);
+}
+
+// Signals the thread to stop, it writes what is left before exiting
+DatasetWriter::~DatasetWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+  close(images_fd_);
+  close(labels_fd_);
+}
+
+// The lock is only held to push, the caller never waits for a write
+bool DatasetWriter::add(VectorCanvas canvas, uint8_t label) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.size() >= config_.max_pending) {
+      stats_.dropped++;
+      return false;
+    }
+    pending_.push_back({std::move(canvas), label});
+  }
+  cv_.notify_one();
+  return true;
+}
+
+DatasetWriter::Stats DatasetWriter::get_stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+// Takes everything queued at once, while it is written new samples queue up
+// for the next batch. With unsynced data the thread also wakes up once the
+// sync is due, so an idle capture still reaches the disk
+void DatasetWriter::run() {
+  std::vector<Sample> samples;
+  samples.reserve(config_.max_pending);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    auto ready = [this] { return stop_ || !pending_.empty(); };
+    if (dirty_) {
+      cv_.wait_until(lock, last_sync_ + config_.sync_interval, ready);
+    } else {
+      cv_.wait(lock, ready);
+    }
+    samples.swap(pending_);
+    bool stop = stop_;
+    lock.unlock();
+
+    if (!samples.empty()) write(samples);
+    samples.clear();
+    if (dirty_ && (stop || std::chrono::steady_clock::now() - last_sync_ >=
+                               config_.sync_interval)) {
+      sync();
+    }
+
+    lock.lock();
+    if (stop && pending_.empty()) break;
+  }
+}
+
+// The data goes first and the counts last, a reader never sees a count
+// that covers data not written yet
+void DatasetWriter::write(const std::vector<Sample> &samples) {
+  TRACE_SCOPE("capture_write");
+  const size_t count = samples.size();
+  images_.resize(count * kImageBytes);
+  labels_.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    const VectorCanvas &canvas = samples[i].canvas;
+    rasterizer_.run_normalized<uint8_t>(canvas.strokes, canvas.brush,
+                                        images_.data() + i * kImageBytes,
+                                        identity_);
+    labels_[i] = samples[i].label;
+  }
+
+  const uint32_t total = count_ + static_cast<uint32_t>(count);
+  bool ok = write_all(images_fd_, images_.data(), images_.size(),
+                      kImagesHeader + count_ * kImageBytes) &&
+            write_all(labels_fd_, labels_.data(), labels_.size(),
+                      kLabelsHeader + count_) &&
+            write_count(images_fd_, total) && write_count(labels_fd_, total);
+  if (!ok) {
+    std::cerr << "Failed to write " << count << " captured samples: "
+              << std::strerror(errno) << std::endl;
+  } else {
+    count_ = total;
+    dirty_ = true;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (ok) {
+    stats_.written = count_;
+    stats_.batches++;
+  } else {
+    stats_.dropped += count;
+  }
+}
+
+void DatasetWriter::sync() {
+  TRACE_SCOPE("capture_sync");
+  if (fsync(images_fd_) != 0 || fsync(labels_fd_) != 0) {
+    std::cerr << "Failed to sync the captured samples: "
+              << std::strerror(errno) << std::endl;
+  }
+  dirty_ = false;
+  last_sync_ = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.syncs++;
+}
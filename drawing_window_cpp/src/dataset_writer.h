@@ -0,0 +1,99 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of DatasetWriter, captures labeled drawings into MNIST
+// compatible IDX files to retrain the models.
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "preprocessing.h"
+#include "strokes.h"
+
+// How the captured samples reach the disk
+struct CaptureConfig {
+  // Samples waiting to be written, more are dropped instead of waiting
+  size_t max_pending = 64;
+  // Minimum time between two fsyncs, written samples are synced at the
+  // latest this long after they were written
+  std::chrono::milliseconds sync_interval{1000};
+};
+
+// DatasetWriter appends 28x28 samples and their labels to a pair of IDX
+// files named like the MNIST ones, prefix-images-idx3-ubyte and
+// prefix-labels-idx1-ubyte, which the training scripts in models/ load with
+// --captured prefix. Existing files are appended to so a dataset grows over
+// several sessions.
+// The caller only copies the strokes into a bounded queue, a writer thread
+// rasterizes them like MNIST, writes everything queued with one write per
+// file, then updates the counts in the headers and fsyncs at most once per
+// sync_interval. The counts are written after the data so files cut short
+// by a crash are trimmed to their last complete sample when reopened.
+class DatasetWriter {
+ public:
+  static constexpr int kSize = DigitNormalizer::kSize;
+
+  struct Stats {
+    uint64_t written = 0;  // Samples in the files, including earlier ones
+    uint64_t dropped = 0;  // Samples dropped because the queue was full
+    uint64_t batches = 0;  // Writes, each with every sample queued
+    uint64_t syncs = 0;
+  };
+
+  /// Opens or creates the files of prefix and starts the writer thread.
+  /// Throws if they cannot be opened or are not 28x28 unsigned byte IDX
+  /// images and labels
+  explicit DatasetWriter(const std::string &prefix,
+                         const CaptureConfig &config = {});
+  // Writes the samples still queued, syncs and closes the files
+  ~DatasetWriter();
+
+  /// Queues the drawing with its label, never waits for the disk. Returns
+  /// false if the queue is full and the sample was dropped
+  bool add(VectorCanvas canvas, uint8_t label);
+  // Returns a copy of the counters
+  Stats get_stats();
+
+ private:
+  struct Sample {
+    VectorCanvas canvas;
+    uint8_t label;
+  };
+
+  // Writer thread loop
+  void run();
+  // Rasterizes and appends the samples, then updates the headers
+  void write(const std::vector<Sample> &samples);
+  void sync();
+
+  std::string images_path_;
+  std::string labels_path_;
+  int images_fd_ = -1;
+  int labels_fd_ = -1;
+  CaptureConfig config_;
+  // Samples in the files, only used by the writer thread once it runs
+  uint32_t count_ = 0;
+  bool dirty_ = false;  // Written since the last fsync
+  std::chrono::steady_clock::time_point last_sync_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<Sample> pending_;
+  bool stop_ = false;
+  Stats stats_;
+
+  // Used by the writer thread only
+  StrokeRasterizer rasterizer_;
+  InputLut<uint8_t> identity_;
+  std::vector<uint8_t> images_;
+  std::vector<uint8_t> labels_;
+  std::thread thread_;
+};
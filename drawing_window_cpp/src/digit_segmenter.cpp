@@ -0,0 +1,153 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of DigitSegmenter
+#include "digit_segmenter.h"
+
+#include <algorithm>
+
+#include "preprocessing.h"
+#include "tracing.h"
+
+uint32_t DigitSegmenter::find(uint32_t label) {
+  while (parent_[label] != label) {
+    parent_[label] = parent_[parent_[label]];
+    label = parent_[label];
+  }
+  return label;
+}
+
+// The lower label becomes the root so roots are ordered like the scan
+void DigitSegmenter::unite(uint32_t a, uint32_t b) {
+  a = find(a);
+  b = find(b);
+  if (a < b) {
+    parent_[b] = a;
+  } else if (b < a) {
+    parent_[a] = b;
+  }
+}
+
+static void merge_box(DigitBox &into, const DigitBox &box) {
+  into.x0 = std::min(into.x0, box.x0);
+  into.y0 = std::min(into.y0, box.y0);
+  into.x1 = std::max(into.x1, box.x1);
+  into.y1 = std::max(into.y1, box.y1);
+  into.mass += box.mass;
+}
+
+// A pixel takes the label of its left neighbour or of one of the three above
+// and joins the labels it touches, only the previous row is looked at
+size_t DigitSegmenter::run(const uint8_t *argb, int width, int height,
+                           int stride) {
+  TRACE_SCOPE("segment");
+  width_ = width;
+  height_ = height;
+  const size_t pixels = static_cast<size_t>(width) * height;
+  gray_.resize(pixels);
+  labels_.resize(pixels);
+  parent_.assign(1, 0);
+  boxes_.assign(1, {});
+
+  for (int y = 0; y < height; y++) {
+    uint8_t *gray = gray_.data() + static_cast<size_t>(y) * width;
+    uint32_t *labels = labels_.data() + static_cast<size_t>(y) * width;
+    const uint32_t *above = y > 0 ? labels - width : nullptr;
+    argb_to_luminance(argb + y * stride, gray, width);
+    for (int x = 0; x < width; x++) {
+      if (gray[x] <= kInk) {
+        labels[x] = 0;
+        continue;
+      }
+      uint32_t label = x > 0 ? labels[x - 1] : 0;
+      if (above) {
+        for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1);
+             nx++) {
+          uint32_t neighbour = above[nx];
+          if (neighbour == 0) continue;
+          if (label == 0) {
+            label = neighbour;
+          } else if (neighbour != label) {
+            unite(label, neighbour);
+          }
+        }
+      }
+      if (label == 0) {
+        label = static_cast<uint32_t>(parent_.size());
+        parent_.push_back(label);
+        boxes_.push_back({x, y, x + 1, y + 1, 0});
+      }
+      labels[x] = label;
+      DigitBox &box = boxes_[label];
+      box.x0 = std::min(box.x0, x);
+      box.x1 = std::max(box.x1, x + 1);
+      box.y1 = y + 1;
+      box.mass += gray[x];
+    }
+  }
+
+  // Fold the boxes into the roots, a root is always below its labels
+  const uint32_t count = static_cast<uint32_t>(parent_.size());
+  roots_.clear();
+  for (uint32_t label = 1; label < count; label++) {
+    uint32_t root = find(label);
+    if (root == label) {
+      roots_.push_back(label);
+    } else {
+      merge_box(boxes_[root], boxes_[label]);
+    }
+  }
+
+  uint64_t heaviest = 0;
+  for (uint32_t root : roots_) {
+    heaviest = std::max(heaviest, boxes_[root].mass);
+  }
+  std::sort(roots_.begin(), roots_.end(), [this](uint32_t a, uint32_t b) {
+    return boxes_[a].x0 < boxes_[b].x0;
+  });
+
+  // Left to right, a component joins the last digit when their columns
+  // overlap by half of the narrower one
+  digit_of_.assign(count, -1);
+  digits_.clear();
+  for (uint32_t root : roots_) {
+    const DigitBox &box = boxes_[root];
+    if (box.mass < kSpeck * heaviest) continue;
+    if (!digits_.empty()) {
+      DigitBox &last = digits_.back();
+      int overlap = std::min(last.x1, box.x1) - std::max(last.x0, box.x0);
+      int narrower = std::min(last.x1 - last.x0, box.x1 - box.x0);
+      if (2 * overlap >= narrower) {
+        merge_box(last, box);
+        digit_of_[root] = static_cast<int32_t>(digits_.size() - 1);
+        continue;
+      }
+    }
+    digit_of_[root] = static_cast<int32_t>(digits_.size());
+    digits_.push_back(box);
+  }
+  for (uint32_t label = 1; label < count; label++) {
+    digit_of_[label] = digit_of_[find(label)];
+  }
+  return digits_.size();
+}
+
+const uint8_t *DigitSegmenter::crop(size_t index) {
+  const DigitBox &box = digits_[index];
+  const int width = box.x1 - box.x0;
+  crop_.resize(static_cast<size_t>(width) * (box.y1 - box.y0));
+  uint8_t *out = crop_.data();
+  for (int y = box.y0; y < box.y1; y++) {
+    const size_t offset = static_cast<size_t>(y) * width_ + box.x0;
+    const uint8_t *gray = gray_.data() + offset;
+    const uint32_t *labels = labels_.data() + offset;
+    for (int x = 0; x < width; x++) {
+      bool own = digit_of_[labels[x]] == static_cast<int32_t>(index);
+      out[x] = own ? gray[x] : 0;
+    }
+    out += width;
+  }
+  return crop_.data();
+}
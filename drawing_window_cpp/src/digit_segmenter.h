@@ -0,0 +1,64 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of DigitSegmenter, splits a drawing of several digits into one
+// image per digit.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounding box of one digit on the canvas, x1 and y1 exclusive
+struct DigitBox {
+  int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+  uint64_t mass = 0;  // Sum of the gray levels of its ink
+};
+
+// DigitSegmenter finds the digits of a drawing written left to right. The ink
+// is labeled in a single pass with union-find over the 8 neighbours, the
+// bounding box and the mass of every label are accumulated on the way and
+// folded into their roots at the end, so the image is read only once.
+// Components whose columns overlap are merged into one digit, like the bar
+// of a 5 or a 4 drawn with two strokes that do not touch, and specks are
+// dropped. Nothing is allocated once the image size is known.
+// Not thread safe, use one per thread.
+class DigitSegmenter {
+ public:
+  // Gray level above which a pixel is ink
+  static constexpr uint8_t kInk = 32;
+  // Components lighter than this fraction of the heaviest one are specks
+  static constexpr double kSpeck = 0.02;
+
+  /// Labels the ink of the ARGB32 image and returns the number of digits,
+  /// available from digits() left to right
+  size_t run(const uint8_t *argb, int width, int height, int stride);
+
+  const std::vector<DigitBox> &digits() const { return digits_; }
+
+  /// Gray image of digit index with the ink of every other digit in its box
+  /// removed, the size of its box with a stride of its width. Valid until
+  /// the next call
+  const uint8_t *crop(size_t index);
+
+ private:
+  // Root of label, halving the path on the way
+  uint32_t find(uint32_t label);
+  void unite(uint32_t a, uint32_t b);
+
+  int width_ = 0;
+  int height_ = 0;
+  std::vector<uint8_t> gray_;
+  // Provisional label of every pixel, 0 for the background
+  std::vector<uint32_t> labels_;
+  // Union-find parent and box of every provisional label
+  std::vector<uint32_t> parent_;
+  std::vector<DigitBox> boxes_;
+  std::vector<uint32_t> roots_;
+  // Digit of every provisional label, -1 for specks
+  std::vector<int32_t> digit_of_;
+  std::vector<DigitBox> digits_;
+  std::vector<uint8_t> crop_;
+};
@@ -0,0 +1,510 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of the inference server
+#include "digit_server.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "predictor.h"
+#include "server_protocol.h"
+#include "tracing.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Initial receive buffer, grown to hold the largest request seen
+constexpr size_t kReceiveBuffer = 64 * 1024;
+// A client that does not read its responses stops being read once this much
+// is waiting to be written
+constexpr size_t kMaxPendingOutput = 1 << 20;
+
+// Connection to one client, owned by a single event loop
+struct Connection {
+  int fd = -1;
+  // Received bytes, the requests are parsed where they were received, from
+  // in_start to in_end
+  std::vector<uint8_t> in;
+  size_t in_start = 0;
+  size_t in_end = 0;
+  // Responses from out_start are not written yet
+  std::vector<uint8_t> out;
+  size_t out_start = 0;
+  uint32_t events = 0;   // Events registered in epoll
+  bool closing = false;  // Close once the responses are written
+  bool dead = false;     // Close now
+
+  size_t pending_output() const { return out.size() - out_start; }
+};
+
+struct LoopStats {
+  uint64_t connections = 0;
+  uint64_t requests = 0;
+  uint64_t images = 0;
+  uint64_t service_us = 0;
+  uint64_t max_service_us = 0;
+};
+
+// EventLoop serves its connections on one thread, the I/O and the inference
+// of a request run back to back without any hand-off between threads
+class EventLoop {
+ public:
+  EventLoop(std::shared_ptr<tflite::FlatBufferModel> model,
+            const NnModelOptions &options, const ServerConfig &config,
+            int listen_fd, int stop_fd);
+  ~EventLoop();
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  // Serves until stop_fd becomes readable
+  void run();
+  const LoopStats &stats() const { return stats_; }
+
+ private:
+  void accept_all();
+  void on_readable(Connection &connection);
+  void flush(Connection &connection);
+  // Serves every complete request in the receive buffer
+  void serve(Connection &connection);
+  void serve_request(const ServerRequest &request, const uint8_t *pixels,
+                     Connection &connection);
+  // Queues a response without digits, used for bad requests
+  void reply(Connection &connection, const ServerRequest &request,
+             ServerStatus status);
+  // Registers the events the connection waits for
+  void update_events(Connection &connection);
+  void close_connection(int fd);
+
+  NnModel nn_;
+  Predictor predictor_;
+  int epoll_fd_ = -1;
+  int listen_fd_;
+  int stop_fd_;
+  std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+  // Digits of the request being served, sized once
+  std::vector<ServerDigit> digits_;
+  bool verbose_;
+  LoopStats stats_;
+};
+
+// Only an epoll per loop is created here, the interpreter is warmed up so
+// the first request does not pay for it
+EventLoop::EventLoop(std::shared_ptr<tflite::FlatBufferModel> model,
+                     const NnModelOptions &options,
+                     const ServerConfig &config, int listen_fd, int stop_fd)
+    : nn_(std::move(model), options),
+      predictor_(nn_, Preprocessing::downscale),
+      listen_fd_(listen_fd),
+      stop_fd_(stop_fd),
+      digits_(kServerMaxCount),
+      verbose_(config.verbose) {
+  if (config.batch > 1) nn_.set_batch_size(config.batch);
+  nn_.invoke();
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Unable to create the event loop epoll");
+  }
+  // Every loop waits on the listening socket, with EPOLLEXCLUSIVE a new
+  // client only wakes one of them
+  epoll_event event{};
+  event.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+  event.events |= EPOLLEXCLUSIVE;
+#endif
+  event.data.fd = listen_fd_;
+  // A loop that misses either one would never accept or never stop, the
+  // destructor does not run when the constructor throws
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event) != 0) {
+    int error = errno;
+    close(epoll_fd_);
+    throw std::system_error(error, std::generic_category(),
+                            "Unable to watch the listening socket");
+  }
+  event.events = EPOLLIN;
+  event.data.fd = stop_fd_;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_fd_, &event) != 0) {
+    int error = errno;
+    close(epoll_fd_);
+    throw std::system_error(error, std::generic_category(),
+                            "Unable to watch the stop event");
+  }
+}
+
+EventLoop::~EventLoop() {
+  for (auto &connection : connections_) close(connection.first);
+  if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+void EventLoop::run() {
+  epoll_event events[64];
+  while (true) {
+    int ready = epoll_wait(epoll_fd_, events, 64, -1);
+    if (ready < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+      return;
+    }
+    for (int i = 0; i < ready; i++) {
+      int fd = events[i].data.fd;
+      // The stop event is never consumed so it wakes every loop
+      if (fd == stop_fd_) return;
+      if (fd == listen_fd_) {
+        accept_all();
+        continue;
+      }
+      auto found = connections_.find(fd);
+      if (found == connections_.end()) continue;
+      Connection &connection = *found->second;
+      uint32_t flags = events[i].events;
+      if (flags & EPOLLIN) {
+        on_readable(connection);
+      } else if (flags & (EPOLLERR | EPOLLHUP)) {
+        connection.dead = true;
+      }
+      if ((flags & EPOLLOUT) && !connection.dead) flush(connection);
+      if (!connection.dead) update_events(connection);
+      if (connection.dead) close_connection(fd);
+    }
+  }
+}
+
+void EventLoop::accept_all() {
+  while (true) {
+    int fd = accept4(listen_fd_, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+      }
+      return;
+    }
+    auto connection = std::make_unique<Connection>();
+    connection->fd = fd;
+    connection->in.resize(kReceiveBuffer);
+    connection->events = EPOLLIN;
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(fd);
+      continue;
+    }
+    connections_[fd] = std::move(connection);
+    stats_.connections++;
+    if (verbose_) std::cout << "Client connected" << std::endl;
+  }
+}
+
+// The bytes land in the receive buffer and are never copied again, the
+// requests are preprocessed from there into the input tensor
+void EventLoop::on_readable(Connection &connection) {
+  if (connection.closing) return;
+  if (connection.in_end == connection.in.size()) {
+    // Only a partial header can be left at the end of a full buffer, a
+    // partial request already has room for all of it
+    size_t left = connection.in_end - connection.in_start;
+    std::memmove(connection.in.data(),
+                 connection.in.data() + connection.in_start, left);
+    connection.in_start = 0;
+    connection.in_end = left;
+  }
+  ssize_t received =
+      recv(connection.fd, connection.in.data() + connection.in_end,
+           connection.in.size() - connection.in_end, 0);
+  if (received == 0) {
+    // The client is done sending, e.g. shutdown(SHUT_WR) after its last
+    // pipelined requests, their responses are still written before closing
+    connection.closing = true;
+    flush(connection);
+    return;
+  }
+  if (received < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      connection.dead = true;
+    }
+    return;
+  }
+  connection.in_end += received;
+  serve(connection);
+  flush(connection);
+}
+
+// Requests are served in the order they arrived so the responses of a
+// pipelined client come back in order
+void EventLoop::serve(Connection &connection) {
+  while (!connection.closing &&
+         connection.in_end - connection.in_start >= sizeof(ServerRequest)) {
+    ServerRequest request;
+    std::memcpy(&request, connection.in.data() + connection.in_start,
+                sizeof(request));
+    size_t payload = static_cast<size_t>(request.width) * request.height *
+                     request.count;
+    if (request.magic != kServerRequestMagic || request.width == 0 ||
+        request.height == 0 || request.width > kServerMaxSide ||
+        request.height > kServerMaxSide || request.count == 0 ||
+        request.count > kServerMaxCount || payload > kServerMaxPayload) {
+      std::cerr << "Bad request, closing the connection" << std::endl;
+      reply(connection, request, kServerBadRequest);
+      connection.closing = true;
+      break;
+    }
+
+    size_t size = sizeof(request) + payload;
+    if (connection.in_end - connection.in_start < size) {
+      // Make room for the whole request so the rest is received in place
+      if (connection.in.size() - connection.in_start < size) {
+        size_t left = connection.in_end - connection.in_start;
+        std::memmove(connection.in.data(),
+                     connection.in.data() + connection.in_start, left);
+        connection.in_start = 0;
+        connection.in_end = left;
+        if (connection.in.size() < size) connection.in.resize(size);
+      }
+      break;
+    }
+    serve_request(request,
+                  connection.in.data() + connection.in_start + sizeof(request),
+                  connection);
+    connection.in_start += size;
+  }
+  if (connection.in_start == connection.in_end) {
+    connection.in_start = connection.in_end = 0;
+  }
+}
+
+// Runs the images in batches of the interpreter batch size and appends the
+// response to the output buffer
+void EventLoop::serve_request(const ServerRequest &request,
+                              const uint8_t *pixels, Connection &connection) {
+  TRACE_SCOPE("serve");
+  auto start = Clock::now();
+  const size_t image_size = static_cast<size_t>(request.width) * request.height;
+  const int count = request.count;
+  const int batch = nn_.batch_size();
+  bool failed = false;
+  for (int first = 0; first < count; first += batch) {
+    int rows = std::min(batch, count - first);
+    bool ok = true;
+    for (int row = 0; row < rows && ok; row++) {
+      ok = predictor_.preprocess_gray(pixels + (first + row) * image_size,
+                                      request.width, request.height,
+                                      request.width, row);
+    }
+    ok = ok && nn_.invoke();
+    for (int row = 0; row < rows; row++) {
+      ClassScore top;
+      if (ok && nn_.top_k(row, &top, 1) == 1) {
+        digits_[first + row] = {top.index, top.probability};
+      } else {
+        digits_[first + row] = {-1, 0.0f};
+        failed = true;
+      }
+    }
+  }
+
+  uint32_t service_us = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                            start)
+          .count());
+  ServerResponse response{kServerResponseMagic, request.id, request.count,
+                          failed ? kServerFailed : kServerOk, service_us};
+  size_t offset = connection.out.size();
+  size_t digits_size = count * sizeof(ServerDigit);
+  connection.out.resize(offset + sizeof(response) + digits_size);
+  std::memcpy(connection.out.data() + offset, &response, sizeof(response));
+  std::memcpy(connection.out.data() + offset + sizeof(response),
+              digits_.data(), digits_size);
+
+  stats_.requests++;
+  stats_.images += count;
+  stats_.service_us += service_us;
+  stats_.max_service_us =
+      std::max<uint64_t>(stats_.max_service_us, service_us);
+}
+
+void EventLoop::reply(Connection &connection, const ServerRequest &request,
+                      ServerStatus status) {
+  ServerResponse response{kServerResponseMagic, request.id, 0, status, 0};
+  size_t offset = connection.out.size();
+  connection.out.resize(offset + sizeof(response));
+  std::memcpy(connection.out.data() + offset, &response, sizeof(response));
+}
+
+// Writes as much as the socket takes, the rest waits for EPOLLOUT
+void EventLoop::flush(Connection &connection) {
+  while (connection.pending_output() > 0) {
+    ssize_t sent = send(connection.fd,
+                        connection.out.data() + connection.out_start,
+                        connection.pending_output(), MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) connection.dead = true;
+      return;
+    }
+    connection.out_start += sent;
+  }
+  connection.out.clear();
+  connection.out_start = 0;
+  if (connection.closing) connection.dead = true;
+}
+
+void EventLoop::update_events(Connection &connection) {
+  uint32_t events = 0;
+  size_t pending = connection.pending_output();
+  if (!connection.closing && pending < kMaxPendingOutput) events |= EPOLLIN;
+  if (pending > 0) events |= EPOLLOUT;
+  if (events == connection.events) return;
+  epoll_event event{};
+  event.events = events;
+  event.data.fd = connection.fd;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+  connection.events = events;
+}
+
+void EventLoop::close_connection(int fd) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  connections_.erase(fd);
+  if (verbose_) std::cout << "Client disconnected" << std::endl;
+}
+
+// Creates the listening socket, a socket left at path by a previous run is
+// replaced, any other file is kept
+int listen_unix(const char *path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (std::strlen(path) >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path too long: " << path << std::endl;
+    return -1;
+  }
+  std::strcpy(address.sun_path, path);
+
+  struct stat info;
+  if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    std::cerr << "Failed to listen on " << path << ": " << std::strerror(errno)
+              << std::endl;
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}  // namespace
+
+int run_server(std::shared_ptr<tflite::FlatBufferModel> model,
+               const NnModelOptions &options, const ServerConfig &config) {
+  if (config.socket_path == nullptr) {
+    std::cerr << "Error: the server requires a socket path." << std::endl;
+    return 1;
+  }
+  // Blocked before any thread starts so only sigwait below receives them
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  int listen_fd = listen_unix(config.socket_path);
+  if (listen_fd < 0) return 1;
+
+  // Like the pool, the parallelism comes from the loops unless the threads
+  // are set
+  NnModelOptions loop_options = options;
+  if (loop_options.num_threads < 0) loop_options.num_threads = 1;
+  int workers = std::max(config.workers, 1);
+  std::vector<std::unique_ptr<EventLoop>> loops;
+  int stop_fd = -1;
+  try {
+    // Without it stop() could not wake the loops and the join would hang
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (stop_fd < 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "Unable to create the stop event");
+    }
+    for (int i = 0; i < workers; i++) {
+      loops.push_back(std::make_unique<EventLoop>(model, loop_options, config,
+                                                  listen_fd, stop_fd));
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Failed to start the server: " << e.what() << std::endl;
+    loops.clear();
+    if (stop_fd >= 0) close(stop_fd);
+    close(listen_fd);
+    unlink(config.socket_path);
+    return 1;
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < workers; i++) {
+    threads.emplace_back([&loops, i] {
+      // Pin the loop to its own core, best effort
+      unsigned int cores = std::thread::hardware_concurrency();
+      if (cores > 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(i % cores, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+      }
+      loops[i]->run();
+    });
+  }
+  std::cout << "Serving on " << config.socket_path << " with " << workers
+            << " workers, batch " << std::max(config.batch, 1) << std::endl;
+
+  int signal = 0;
+  sigwait(&signals, &signal);
+  std::cout << "Stopping the server" << std::endl;
+  uint64_t one = 1;
+  if (write(stop_fd, &one, sizeof(one)) != sizeof(one)) {
+    std::cerr << "Failed to stop the event loops" << std::endl;
+  }
+  for (auto &thread : threads) thread.join();
+
+  LoopStats total;
+  for (const auto &loop : loops) {
+    const LoopStats &stats = loop->stats();
+    total.connections += stats.connections;
+    total.requests += stats.requests;
+    total.images += stats.images;
+    total.service_us += stats.service_us;
+    total.max_service_us = std::max(total.max_service_us, stats.max_service_us);
+  }
+  std::cout << "Served " << total.requests << " requests, " << total.images
+            << " images on " << total.connections
+            << " connections, service time mean/max: "
+            << (total.requests ? total.service_us / total.requests : 0) << "/"
+            << total.max_service_us << " us" << std::endl;
+
+  loops.clear();
+  close(stop_fd);
+  close(listen_fd);
+  unlink(config.socket_path);
+  return 0;
+}
@@ -0,0 +1,32 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of the inference server, serves predictions to other processes
+// over a UNIX domain socket.
+#pragma once
+
+#include <memory>
+
+#include "nn_model.h"
+
+// Options of the inference server
+struct ServerConfig {
+  const char *socket_path = nullptr;
+  // Event loops, each one with its own interpreter on the shared model and
+  // its own connections
+  int workers = 1;
+  // Images per invoke for requests with several images, 1 runs them one by
+  // one. Falls back to 1 if the model cannot be resized
+  int batch = 1;
+  bool verbose = false;
+};
+
+/// Listens on config.socket_path and serves the protocol of
+/// server_protocol.h until SIGINT or SIGTERM. Every event loop runs the I/O
+/// and the inference of its connections on one thread with epoll, the
+/// requests are parsed where they were received and preprocessed straight
+/// into the input tensor. Returns the exit status
+int run_server(std::shared_ptr<tflite::FlatBufferModel> model,
+               const NnModelOptions &options, const ServerConfig &config);
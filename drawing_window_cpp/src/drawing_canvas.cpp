@@ -0,0 +1,120 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of DrawingCanvas
+#include "drawing_canvas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "tracing.h"
+
+// Creates the surface and paints it black
+DrawingCanvas::DrawingCanvas(int width, int height, double brush)
+    : width_(width), height_(height), brush_(brush) {
+  surface_ =
+      Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width_, height_);
+  context_ = Cairo::Context::create(surface_);
+  context_->set_source_rgb(0.0, 0.0, 0.0);
+  context_->paint();
+}
+
+void DrawingCanvas::press(double x, double y, uint32_t time) {
+  drawing_ = true;
+  strokes_.begin_stroke(x, y, time);
+  if (recorder_) recorder_->record(SessionEvent::press, x, y);
+}
+
+bool DrawingCanvas::move(double x, double y, uint32_t time) {
+  if (!drawing_) return false;
+  strokes_.add_point(x, y, time);
+  if (recorder_) recorder_->record(SessionEvent::motion, x, y);
+  return true;
+}
+
+void DrawingCanvas::release() {
+  drawing_ = false;
+  if (recorder_) recorder_->record(SessionEvent::release);
+}
+
+void DrawingCanvas::clear() {
+  strokes_.clear();
+  rendered_points_ = 0;
+  context_->set_source_rgb(0.0, 0.0, 0.0);
+  context_->paint();
+  if (recorder_) recorder_->record(SessionEvent::clear);
+}
+
+// Every segment is a line with round caps as wide as the brush, so fast
+// mouse moves leave no gaps. The first point of a stroke is a zero length
+// segment, which Cairo draws as a dot with round caps
+void DrawingCanvas::draw_points(const Cairo::RefPtr<Cairo::Context> &cr,
+                                const StrokeSet &strokes, size_t first,
+                                double brush) {
+  const std::vector<StrokePoint> &points = strokes.points();
+  if (first >= points.size()) return;
+  cr->set_line_width(2 * brush);
+  cr->set_line_cap(Cairo::LINE_CAP_ROUND);
+  for (size_t i = first; i < points.size(); i++) {
+    const StrokePoint &start = strokes.segment_start(i);
+    cr->move_to(start.x, start.y);
+    cr->line_to(points[i].x, points[i].y);
+  }
+  cr->stroke();
+}
+
+size_t DrawingCanvas::rasterize_pending(CanvasRect &damage) {
+  const std::vector<StrokePoint> &points = strokes_.points();
+  if (rendered_points_ >= points.size()) return 0;
+  TRACE_SCOPE("rasterize");
+
+  // The first new segment may start at the last point already drawn
+  const StrokePoint &start = strokes_.segment_start(rendered_points_);
+  double min_x = start.x;
+  double max_x = min_x;
+  double min_y = start.y;
+  double max_y = min_y;
+
+  for (size_t i = rendered_points_; i < points.size(); i++) {
+    const auto &point = points[i];
+    min_x = std::min<double>(min_x, point.x);
+    max_x = std::max<double>(max_x, point.x);
+    min_y = std::min<double>(min_y, point.y);
+    max_y = std::max<double>(max_y, point.y);
+  }
+  size_t new_points = points.size() - rendered_points_;
+  context_->set_source_rgb(1.0, 1.0, 1.0);
+  draw_points(context_, strokes_, rendered_points_, brush_);
+  rendered_points_ = points.size();
+
+  // Damaged area, padded by the brush and one pixel for anti-aliasing
+  int x0 = static_cast<int>(std::floor(min_x - brush_)) - 1;
+  int y0 = static_cast<int>(std::floor(min_y - brush_)) - 1;
+  int x1 = static_cast<int>(std::ceil(max_x + brush_)) + 1;
+  int y1 = static_cast<int>(std::ceil(max_y + brush_)) + 1;
+  damage = {x0, y0, x1 - x0, y1 - y0};
+  return new_points;
+}
+
+// Copies the surface into a new image surface owned by the caller
+Cairo::RefPtr<Cairo::ImageSurface> DrawingCanvas::snapshot() const {
+  TRACE_SCOPE("snapshot");
+  Cairo::RefPtr<Cairo::ImageSurface> copy =
+      Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width_, height_);
+  surface_->flush();
+  std::memcpy(copy->get_data(), surface_->get_data(),
+              surface_->get_stride() * height_);
+  copy->mark_dirty();
+  return copy;
+}
+
+void DrawingCanvas::start_recording(const char *path) {
+  recorder_ = std::make_unique<SessionRecorder>(path, width_, height_, brush_);
+}
+
+void DrawingCanvas::record_predict() {
+  if (recorder_) recorder_->record(SessionEvent::predict);
+}
@@ -0,0 +1,90 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of DrawingCanvas, the strokes and the surface they are drawn on,
+// without any widget so it also runs without a display.
+#pragma once
+
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+
+#include <memory>
+
+#include "session_recording.h"
+#include "strokes.h"
+
+// Area of the canvas that changed
+struct CanvasRect {
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+};
+
+// DrawingCanvas turns the pointer input into strokes and rasterizes them
+// into a persistent ARGB32 surface, white ink on black. MouseDrawing feeds
+// it the GTK events and the session replay feeds it recorded ones.
+class DrawingCanvas {
+ public:
+  DrawingCanvas(int width, int height, double brush);
+
+  // Starts a stroke at the position
+  void press(double x, double y, uint32_t time);
+  // Adds a point to the current stroke, returns false if no stroke is being
+  // drawn
+  bool move(double x, double y, uint32_t time);
+  // Ends the current stroke
+  void release();
+  // Removes every stroke and paints the surface black
+  void clear();
+
+  /// Draws the segments ending at the points added since the last call into
+  /// the surface. Returns the number of new points and sets damage to the
+  /// area they cover
+  size_t rasterize_pending(CanvasRect &damage);
+
+  /// Draws the capsules of the points of strokes from first on with the
+  /// current source of cr, each one joined to the previous point of its
+  /// stroke. Static so it can be timed on its own
+  static void draw_points(const Cairo::RefPtr<Cairo::Context> &cr,
+                          const StrokeSet &strokes, size_t first,
+                          double brush);
+
+  // Returns a copy of the surface that can be handed to another thread
+  Cairo::RefPtr<Cairo::ImageSurface> snapshot() const;
+  // Returns a copy of the strokes, much cheaper than snapshot()
+  VectorCanvas vector_snapshot() const {
+    return {strokes_, width_, height_, brush_};
+  }
+  const Cairo::RefPtr<Cairo::ImageSurface> &surface() const {
+    return surface_;
+  }
+  const StrokeSet &strokes() const { return strokes_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  double brush() const { return brush_; }
+
+  /// Records every event from now on to path, throws if the file cannot be
+  /// created
+  void start_recording(const char *path);
+  // Records a prediction request, replayed as a prediction
+  void record_predict();
+
+ private:
+  int width_;
+  int height_;
+  double brush_;
+  // Set while the button is pressed
+  bool drawing_ = false;
+  // Persistent surface holding everything drawn so far
+  Cairo::RefPtr<Cairo::ImageSurface> surface_;
+  // Context bound to the surface, kept to avoid re-creating it per event
+  Cairo::RefPtr<Cairo::Context> context_;
+  // One polyline per press
+  StrokeSet strokes_;
+  // Number of points of strokes_ already rasterized into the surface
+  size_t rendered_points_ = 0;
+  std::unique_ptr<SessionRecorder> recorder_;
+};
@@ -0,0 +1,52 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of the IDX helpers
+#include "idx_file.h"
+
+#include <fstream>
+#include <iostream>
+
+// IDX stores the header as big endian 32 bit integers
+static uint32_t read_be32(const unsigned char *bytes) {
+  return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) |
+         (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+
+// The magic number is 0x00 0x00 type dims, only unsigned byte (0x08) data
+// is supported
+bool read_idx(const char *path, IdxData &out) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::cerr << "Failed to open IDX file: " << path << std::endl;
+    return false;
+  }
+
+  unsigned char magic[4];
+  if (!file.read(reinterpret_cast<char *>(magic), 4) || magic[0] != 0 ||
+      magic[1] != 0 || magic[2] != 0x08 || magic[3] == 0) {
+    std::cerr << "Not an unsigned byte IDX file: " << path << std::endl;
+    return false;
+  }
+
+  out.dims.resize(magic[3]);
+  size_t count = 1;
+  for (auto &dim : out.dims) {
+    unsigned char bytes[4];
+    if (!file.read(reinterpret_cast<char *>(bytes), 4)) {
+      std::cerr << "Truncated IDX header: " << path << std::endl;
+      return false;
+    }
+    dim = read_be32(bytes);
+    count *= dim;
+  }
+
+  out.data.resize(count);
+  if (!file.read(reinterpret_cast<char *>(out.data.data()), count)) {
+    std::cerr << "Truncated IDX data: " << path << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,21 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Helpers for the IDX format used by the MNIST dataset.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Content of an unsigned byte IDX file, e.g. the MNIST images (dims are
+// count, rows, cols) or labels (dims is count)
+struct IdxData {
+  std::vector<uint32_t> dims;
+  std::vector<uint8_t> data;
+};
+
+/// Reads an unsigned byte IDX file into out
+/// Returns false and prints the reason if the file cannot be read
+bool read_idx(const char *path, IdxData &out);
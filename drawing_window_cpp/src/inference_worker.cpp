@@ -0,0 +1,305 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of InferenceWorker
+#include "inference_worker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+// Connects the dispatcher and starts the worker thread
+InferenceWorker::InferenceWorker(
+    std::shared_future<std::shared_ptr<NnModel>> model,
+    Preprocessing preprocessing, size_t max_pending, size_t max_digits)
+    : model_future_(std::move(model)),
+      preprocessing_(preprocessing),
+      max_pending_(std::max<size_t>(max_pending, 1)),
+      max_digits_(max_digits) {
+  dispatcher_.connect(sigc::mem_fun(*this, &InferenceWorker::on_dispatch));
+  thread_ = std::thread(&InferenceWorker::run, this);
+}
+
+// Signals the thread to stop and waits for the current inference to finish
+InferenceWorker::~InferenceWorker() {
+  if (loader_.valid()) loader_.wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void InferenceWorker::submit(Cairo::RefPtr<Cairo::ImageSurface> canvas,
+                             Clock::time_point origin, uint64_t content) {
+  enqueue({std::move(canvas), {}, origin, Clock::now(), content});
+}
+
+void InferenceWorker::submit(VectorCanvas canvas, Clock::time_point origin,
+                             uint64_t content) {
+  enqueue({{}, std::move(canvas), origin, Clock::now(), content});
+}
+
+// Only while idle, a request in flight would be delivered after the cached
+// result and replace it with the one of an older drawing
+bool InferenceWorker::submit_cached(uint64_t content, bool vector,
+                                    Clock::time_point origin) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_ || !requests_.empty()) return false;
+    const Prediction *hit = cache_.find({content, model_id_, vector});
+    if (!hit) return false;
+    stats_.submitted++;
+    stats_.cache_hits++;
+    results_.push_back(from_cache(*hit, origin));
+  }
+  dispatcher_.emit();
+  return true;
+}
+
+InferenceWorker::Prediction InferenceWorker::from_cache(
+    const Prediction &hit, Clock::time_point origin) {
+  Prediction prediction = hit;
+  prediction.origin = origin;
+  prediction.submitted = Clock::now();
+  prediction.queue_wait = microseconds{0};
+  prediction.invoke = microseconds{0};
+  prediction.cached = true;
+  return prediction;
+}
+
+// Queues the snapshot, if the queue is full the oldest request is stale and
+// gets dropped
+void InferenceWorker::enqueue(Request request) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(std::move(request));
+    stats_.submitted++;
+    while (requests_.size() > max_pending_) {
+      requests_.pop_front();
+      stats_.coalesced++;
+    }
+  }
+  cv_.notify_one();
+}
+
+// The model is built and warmed up on its own thread so neither the GUI nor
+// the predictions wait for it, the worker thread picks it up when it is free
+bool InferenceWorker::load(std::string path, const NnModelOptions &options) {
+  if (loader_.valid() && loader_.wait_for(std::chrono::seconds(0)) !=
+                             std::future_status::ready) {
+    return false;
+  }
+  loader_ = std::async(std::launch::async, [this, path = std::move(path),
+                                            options] {
+    std::shared_ptr<NnModel> nn;
+    std::unique_ptr<Predictor> predictor;
+    std::unique_ptr<NumberReader> reader;
+    try {
+      nn = load_warm_model(path.c_str(), options, preprocessing_);
+      predictor = std::make_unique<Predictor>(*nn, preprocessing_);
+      if (max_digits_) {
+        reader = std::make_unique<NumberReader>(*nn, max_digits_);
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "Model " << path << " failed to load: " << e.what()
+                << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (predictor) {
+      next_nn_ = std::move(nn);
+      next_predictor_ = std::move(predictor);
+      next_reader_ = std::move(reader);
+      cv_.notify_one();
+    } else {
+      model_ok_ = false;
+      ready_pending_ = true;
+      dispatcher_.emit();
+    }
+  });
+  return true;
+}
+
+bool InferenceWorker::busy() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return running_ || !requests_.empty();
+}
+
+InferenceWorker::Stats InferenceWorker::get_stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+// Waits for requests and always infers the newest one, anything older that
+// is still queued is dropped since its result would be overwritten anyway
+void InferenceWorker::run() {
+  // Wait for the model here and not on the GUI thread, snapshots submitted
+  // meanwhile stay queued
+  bool ok = false;
+  try {
+    nn_ = model_future_.get();
+    predictor_ = std::make_unique<Predictor>(*nn_, preprocessing_);
+    if (max_digits_) {
+      reader_ = std::make_unique<NumberReader>(*nn_, max_digits_);
+    }
+    ok = true;
+  } catch (const std::exception &e) {
+    std::cerr << "Model failed to load: " << e.what() << std::endl;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  model_ok_ = ok;
+  ready_pending_ = true;
+  dispatcher_.emit();
+  while (true) {
+    cv_.wait(lock, [this] {
+      return stop_ || next_predictor_ || !requests_.empty();
+    });
+    if (stop_) break;
+
+    // Swap in a model loaded in the background, the old one is released
+    // outside of the lock, its predictor and reader first since they refer to
+    // the model.
+    // The cached results belong to the old model, the kept input stays
+    if (next_predictor_) {
+      std::swap(nn_, next_nn_);
+      std::swap(predictor_, next_predictor_);
+      std::swap(reader_, next_reader_);
+      model_id_++;
+      cache_.clear();
+      model_ok_ = true;
+      ready_pending_ = true;
+      dispatcher_.emit();
+      std::unique_ptr<Predictor> old_predictor = std::move(next_predictor_);
+      std::unique_ptr<NumberReader> old_reader = std::move(next_reader_);
+      std::shared_ptr<NnModel> old_nn = std::move(next_nn_);
+      lock.unlock();
+      old_predictor.reset();
+      old_reader.reset();
+      old_nn.reset();
+      lock.lock();
+      continue;
+    }
+
+    Request request = std::move(requests_.back());
+    stats_.coalesced += requests_.size() - 1;
+    requests_.clear();
+
+    // The drawing was already inferred by this model
+    CacheKey key{request.content, model_id_, !request.canvas};
+    if (request.content != 0) {
+      if (const Prediction *hit = cache_.find(key)) {
+        stats_.cache_hits++;
+        results_.push_back(from_cache(*hit, request.origin));
+        dispatcher_.emit();
+        continue;
+      }
+      stats_.cache_misses++;
+    }
+    running_ = true;
+    lock.unlock();
+
+    Prediction prediction{};
+    bool reused = false;
+    auto start = Clock::now();
+    prediction.number = predict(request, prediction, reused);
+    auto end = Clock::now();
+    // Release the surface on this thread, it is not shared with anyone else
+    request.canvas.clear();
+
+    prediction.origin = request.origin;
+    prediction.submitted = request.submitted;
+    prediction.queue_wait =
+        duration_cast<microseconds>(start - request.submitted);
+    prediction.invoke = duration_cast<microseconds>(end - start);
+
+    lock.lock();
+    running_ = false;
+    stats_.queue_wait.add(prediction.queue_wait);
+    stats_.invoke.add(prediction.invoke);
+    if (reused) stats_.input_reused++;
+    // The key is still the one of the model that ran, swaps only happen on
+    // this thread between requests
+    if (request.content != 0 && prediction.number >= 0) {
+      cache_.insert(key, prediction);
+    }
+    results_.push_back(prediction);
+    dispatcher_.emit();
+  }
+}
+
+// Runs the shared preprocessing and inference path on the snapshot, or on
+// the strokes rasterized at the model resolution. A drawing that was already
+// preprocessed for an input like the one of the model, typically right after
+// a model swap, is copied into the input tensor instead
+int InferenceWorker::predict(const Request &request, Prediction &prediction,
+                             bool &reused) {
+  if (!predictor_) return -1;
+  if (reader_) return read_number(request, prediction);
+  const bool vector = !request.canvas;
+  const size_t bytes = predictor_->input_bytes();
+  reused = request.content != 0 && request.content == input_content_ &&
+           vector == input_vector_ && bytes == input_.size() &&
+           predictor_->input_spec() == input_spec_;
+  if (reused) {
+    std::memcpy(predictor_->input_data(), input_.data(), bytes);
+    return predictor_->infer(prediction.top, kTopK);
+  }
+
+  bool ok;
+  if (vector) {
+    ok = predictor_->preprocess(request.vector);
+  } else {
+    const auto &canvas = request.canvas;
+    canvas->flush();
+    ok = predictor_->preprocess(canvas->get_data(), canvas->get_width(),
+                                canvas->get_height(), canvas->get_stride());
+  }
+  if (!ok) return -1;
+  if (request.content != 0) {
+    const auto *input = static_cast<const uint8_t *>(predictor_->input_data());
+    input_.assign(input, input + bytes);
+    input_content_ = request.content;
+    input_vector_ = vector;
+    input_spec_ = predictor_->input_spec();
+  }
+  return predictor_->infer(prediction.top, kTopK);
+}
+
+// The digits are cut out of the full canvas, the strokes are not enough and
+// the kept input only holds a single digit so it is not used here
+int InferenceWorker::read_number(const Request &request,
+                                 Prediction &prediction) {
+  if (!request.canvas) return -1;
+  const auto &canvas = request.canvas;
+  canvas->flush();
+  if (!reader_->read(canvas->get_data(), canvas->get_width(),
+                     canvas->get_height(), canvas->get_stride(),
+                     prediction.digits)) {
+    return -1;
+  }
+  return number_value(prediction.digits);
+}
+
+// Delivers every finished prediction to the listeners on the GUI thread
+void InferenceWorker::on_dispatch() {
+  std::deque<Prediction> results;
+  bool ready = false;
+  bool ok = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    results.swap(results_);
+    ready = ready_pending_;
+    ok = model_ok_;
+    ready_pending_ = false;
+  }
+  if (ready) signal_ready_.emit(ok);
+  for (const auto &prediction : results) signal_result_.emit(prediction);
+}
@@ -0,0 +1,225 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of InferenceWorker, a thread that runs the preprocessing and the
+// inference of canvas snapshots away from the GTK main loop.
+#pragma once
+
+#include <cairomm/surface.h>
+#include <glibmm/dispatcher.h>
+#include <sigc++/signal.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lru_cache.h"
+#include "nn_model.h"
+#include "number_reader.h"
+#include "predictor.h"
+
+// Accumulates durations to report the mean and the worst case
+struct LatencyCounter {
+  uint64_t count = 0;
+  std::chrono::microseconds total{0};
+  std::chrono::microseconds max{0};
+
+  void add(std::chrono::microseconds d) {
+    count++;
+    total += d;
+    if (d > max) max = d;
+  }
+  std::chrono::microseconds mean() const {
+    return count ? total / static_cast<int64_t>(count)
+                 : std::chrono::microseconds{0};
+  }
+};
+
+// InferenceWorker owns a thread that consumes canvas snapshots from a bounded
+// queue, runs them through the NnModel and posts the results back to the GUI
+// thread through a Glib::Dispatcher. When requests arrive faster than they
+// can be inferred the stale ones are dropped so only the latest drawing is
+// ever inferred. The model can be replaced at runtime, the new one is loaded
+// in the background and takes over between two inferences.
+// Requests carry the hash of the drawing, the results of the last drawings
+// are cached per model so an unchanged drawing is answered without running
+// anything, and the preprocessed input of the last drawing is kept so a
+// new model reuses it.
+// In number mode the canvas holds several digits, they are segmented and
+// read with a single batched invoke.
+class InferenceWorker {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Number of best classes reported with every prediction
+  static constexpr size_t kTopK = 3;
+  // Drawings whose results are kept
+  static constexpr size_t kCacheSize = 16;
+
+  // Result of one inference, delivered on the GUI thread
+  struct Prediction {
+    int number;                            // Predicted digit, -1 on failure
+    Clock::time_point origin;              // Event that caused the request
+    Clock::time_point submitted;           // When the snapshot was queued
+    std::chrono::microseconds queue_wait;  // Time spent waiting in the queue
+    std::chrono::microseconds invoke;      // Preprocessing plus inference
+    // Best classes, best first, unused entries have an index of -1
+    ClassScore top[kTopK];
+    bool cached = false;  // Answered from the cache, nothing ran
+    // Digits read left to right in number mode, number is then their value
+    std::vector<int> digits;
+  };
+
+  // Counters used to verify where the time goes
+  struct Stats {
+    uint64_t submitted = 0;  // Snapshots queued
+    uint64_t coalesced = 0;  // Snapshots dropped in favour of a newer one
+    LatencyCounter queue_wait;
+    LatencyCounter invoke;
+    uint64_t cache_hits = 0;    // Drawings answered from the cache
+    uint64_t cache_misses = 0;  // Drawings with a hash that had to run
+    uint64_t input_reused = 0;  // Preprocessing skipped after a model change
+
+    double hit_rate() const {
+      uint64_t lookups = cache_hits + cache_misses;
+      return lookups ? static_cast<double>(cache_hits) / lookups : 0.0;
+    }
+  };
+
+  /// InferenceWorker Ctor
+  /// Must be created on the GUI thread since the dispatcher delivers results
+  /// to the main context of the thread that creates it. The model may still
+  /// be loading, the worker thread waits for it so the GUI never does.
+  /// preprocessing selects how the canvas is turned into the model input.
+  /// max_pending bounds the number of snapshots waiting to be inferred.
+  /// max_digits enables the number mode, see NumberReader, 0 predicts a
+  /// single digit.
+  InferenceWorker(std::shared_future<std::shared_ptr<NnModel>> model,
+                  Preprocessing preprocessing = Preprocessing::downscale,
+                  size_t max_pending = 1, size_t max_digits = 0);
+  // Waits for a model being loaded and stops the thread, pending requests
+  // are discarded
+  ~InferenceWorker();
+
+  /// Loads and warms up the model at path in the background, the current
+  /// model keeps predicting meanwhile and is swapped for the new one once it
+  /// is ready. signal_ready is emitted with the outcome, if it fails the
+  /// current model stays. Returns false if another model is still loading
+  bool load(std::string path, const NnModelOptions &options);
+
+  // Queues a canvas snapshot, the worker takes ownership of it
+  // origin is reported back with the prediction to measure end to end latency
+  // content is the StrokeSet::hash of the drawing, 0 if it is not known and
+  // the result must not be cached
+  void submit(Cairo::RefPtr<Cairo::ImageSurface> canvas,
+              Clock::time_point origin = Clock::now(), uint64_t content = 0);
+  // Same for a vector copy of the canvas, rasterized at the model resolution
+  void submit(VectorCanvas canvas, Clock::time_point origin = Clock::now(),
+              uint64_t content = 0);
+  /// Delivers the cached result of the drawing with the content hash if the
+  /// current model already inferred it, without a snapshot or a queue, like
+  /// a prediction. vector tells which of the submits would have been used.
+  /// Returns false if it is not cached or a request is in flight, the
+  /// drawing must be submitted then
+  bool submit_cached(uint64_t content, bool vector,
+                     Clock::time_point origin = Clock::now());
+  // True while a snapshot is queued or being inferred
+  bool busy();
+  // Returns a copy of the latency counters
+  Stats get_stats();
+
+  // Signal emitted on the GUI thread for every finished prediction
+  using type_signal_result = sigc::signal<void, const Prediction &>;
+  type_signal_result signal_result() { return signal_result_; }
+  // Signal emitted on the GUI thread once the model is loaded, with false if
+  // it failed to load, and again after every load()
+  using type_signal_ready = sigc::signal<void, bool>;
+  type_signal_ready signal_ready() { return signal_ready_; }
+
+ private:
+  // Snapshot waiting to be inferred, vector is used when canvas is empty
+  struct Request {
+    Cairo::RefPtr<Cairo::ImageSurface> canvas;
+    VectorCanvas vector;
+    Clock::time_point origin;
+    Clock::time_point submitted;
+    uint64_t content;  // Hash of the drawing, 0 when not cached
+  };
+  // Drawing and model a cached result belongs to
+  struct CacheKey {
+    uint64_t content;  // StrokeSet::hash of the drawing
+    uint64_t model;    // model_id_ of the model that inferred it
+    bool vector;       // Rasterized from the strokes
+    bool operator==(const CacheKey &other) const {
+      return content == other.content && model == other.model &&
+             vector == other.vector;
+    }
+  };
+
+  // Queues a request, dropping the oldest ones over max_pending_
+  void enqueue(Request request);
+  // Worker thread loop
+  void run();
+  // Preprocesses the request for the model input, or copies the input kept
+  // for the same drawing, and returns the digit. The best classes are
+  // written into prediction. Sets reused if the input was copied
+  int predict(const Request &request, Prediction &prediction, bool &reused);
+  // Number mode, reads the digits of the canvas into prediction and returns
+  // their value
+  int read_number(const Request &request, Prediction &prediction);
+  // Result of a cache hit for a request made at origin
+  static Prediction from_cache(const Prediction &hit,
+                               Clock::time_point origin);
+  // Called on the GUI thread when the worker emits the dispatcher
+  void on_dispatch();
+
+  // Model being loaded, the worker keeps a reference once it is ready
+  std::shared_future<std::shared_ptr<NnModel>> model_future_;
+  std::shared_ptr<NnModel> nn_;
+  // Preprocessing and inference on the model, only used by the worker thread
+  std::unique_ptr<Predictor> predictor_;
+  // Set in number mode only
+  std::unique_ptr<NumberReader> reader_;
+  // Model loaded by load() waiting to replace nn_, guarded by mutex_
+  std::shared_ptr<NnModel> next_nn_;
+  std::unique_ptr<Predictor> next_predictor_;
+  std::unique_ptr<NumberReader> next_reader_;
+  std::future<void> loader_;
+  Preprocessing preprocessing_;
+  size_t max_pending_;
+  size_t max_digits_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Request> requests_;
+  std::deque<Prediction> results_;
+  bool running_ = false;
+  bool stop_ = false;
+  // Set by the worker once the model loaded (or failed), cleared on dispatch
+  bool ready_pending_ = false;
+  bool model_ok_ = false;
+  Stats stats_;
+  // Results of the last drawings, and the number of the current model which
+  // changes with every swap, both guarded by mutex_
+  LruCache<CacheKey, Prediction> cache_{kCacheSize};
+  uint64_t model_id_ = 0;
+  // Preprocessed input of the last drawing and what it was written for,
+  // only used by the worker thread
+  std::vector<uint8_t> input_;
+  uint64_t input_content_ = 0;
+  bool input_vector_ = false;
+  InputSpec input_spec_;
+
+  Glib::Dispatcher dispatcher_;
+  type_signal_result signal_result_;
+  type_signal_ready signal_ready_;
+  std::thread thread_;
+};
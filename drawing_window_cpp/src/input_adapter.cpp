@@ -0,0 +1,250 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of InputAdapter
+#include "input_adapter.h"
+
+#include <cmath>
+
+const char *layout_name(TensorLayout layout) {
+  return layout == TensorLayout::nchw ? "NCHW" : "NHWC";
+}
+
+static bool is_channels(int dim) { return dim == 1 || dim == 3; }
+
+bool describe_input(const int *dims, int rank, InputSpec &spec) {
+  spec.width = spec.height = spec.channels = 0;
+  spec.layout = TensorLayout::nhwc;
+  if (rank == 4 && is_channels(dims[3])) {
+    spec.height = dims[1];
+    spec.width = dims[2];
+    spec.channels = dims[3];
+  } else if (rank == 4 && is_channels(dims[1])) {
+    spec.layout = TensorLayout::nchw;
+    spec.channels = dims[1];
+    spec.height = dims[2];
+    spec.width = dims[3];
+  } else if (rank == 3) {
+    spec.height = dims[1];
+    spec.width = dims[2];
+    spec.channels = 1;
+  } else if (rank == 2) {
+    int side = static_cast<int>(std::lround(std::sqrt(dims[1])));
+    if (side * side != dims[1]) return false;
+    spec.width = spec.height = side;
+    spec.channels = 1;
+  } else {
+    return false;
+  }
+  return spec.width > 0 && spec.height > 0;
+}
+
+InputAdapter::InputAdapter(const InputSpec &spec, Preprocessing preprocessing)
+    : spec_(spec),
+      preprocessing_(preprocessing),
+      lut_f_(make_input_lut<float>(spec.quant.scale, spec.quant.zero_point)),
+      lut_i8_(make_input_lut<int8_t>(spec.quant.scale, spec.quant.zero_point)),
+      lut_u8_(
+          make_input_lut<uint8_t>(spec.quant.scale, spec.quant.zero_point)),
+      identity_(make_input_lut<uint8_t>(0.0f, 0)) {
+  if (!spec_.supported()) return;
+  if (spec_.channels > 1)
+    scratch_.resize(static_cast<size_t>(spec_.width) * spec_.height);
+  switch (spec_.type) {
+    case InputType::float32:
+      bind_layout<float>();
+      break;
+    case InputType::int8:
+      bind_layout<int8_t>();
+      break;
+    case InputType::uint8:
+      bind_layout<uint8_t>();
+      break;
+    default:
+      break;
+  }
+}
+
+size_t InputAdapter::bytes() const {
+  switch (spec_.type) {
+    case InputType::float32:
+      return spec_.elements() * sizeof(float);
+    case InputType::int8:
+    case InputType::uint8:
+      return spec_.elements();
+    default:
+      return 0;
+  }
+}
+
+template <typename T>
+const InputLut<T> &InputAdapter::lut() const {
+  if constexpr (std::is_same_v<T, float>) {
+    return lut_f_;
+  } else if constexpr (std::is_same_v<T, int8_t>) {
+    return lut_i8_;
+  } else {
+    return lut_u8_;
+  }
+}
+
+// One channel is the same in both layouts, it shares the NHWC kernels
+template <typename T>
+void InputAdapter::bind_layout() {
+  if (spec_.channels == 1) {
+    bind_size<T, TensorLayout::nhwc, 1>();
+  } else if (spec_.layout == TensorLayout::nchw) {
+    bind_size<T, TensorLayout::nchw, 3>();
+  } else {
+    bind_size<T, TensorLayout::nhwc, 3>();
+  }
+}
+
+template <typename T, TensorLayout L, int C>
+void InputAdapter::bind_size() {
+  if (spec_.width == 28 && spec_.height == 28) {
+    bind<T, L, C, 28>();
+  } else if (spec_.width == 32 && spec_.height == 32) {
+    bind<T, L, C, 32>();
+  } else {
+    bind<T, L, C, 0>();
+  }
+}
+
+template <typename T, TensorLayout L, int C, int S>
+void InputAdapter::bind() {
+  gray_ = &InputAdapter::gray_kernel<T, L, C, S>;
+  digit_ = &InputAdapter::digit_kernel<T, L, C, S>;
+  if (preprocessing_ == Preprocessing::mnist) {
+    image_ = &InputAdapter::image_kernel<T, L, C, S, Preprocessing::mnist>;
+    vector_ = &InputAdapter::vector_kernel<T, L, C, S, Preprocessing::mnist>;
+  } else {
+    image_ =
+        &InputAdapter::image_kernel<T, L, C, S, Preprocessing::downscale>;
+    vector_ =
+        &InputAdapter::vector_kernel<T, L, C, S, Preprocessing::downscale>;
+  }
+}
+
+template <typename T, int S, Preprocessing P>
+void InputAdapter::image_plane(const uint8_t *argb, int width, int height,
+                               int stride, T *out, const InputLut<T> &lut) {
+  const int w = S ? S : spec_.width;
+  const int h = S ? S : spec_.height;
+  if constexpr (P == Preprocessing::mnist) {
+    normalizer_.run<T>(argb, width, height, stride, out, lut, w, h);
+  } else {
+    downscaler_.configure(width, height, w, h);
+    downscaler_.run<T>(argb, stride, out, lut);
+  }
+}
+
+template <typename T, int S>
+void InputAdapter::gray_plane(const uint8_t *gray, int width, int height,
+                              int stride, T *out, const InputLut<T> &lut) {
+  const int w = S ? S : spec_.width;
+  const int h = S ? S : spec_.height;
+  if (width == w && height == h) {
+    for (int y = 0; y < h; y++) {
+      const uint8_t *src = gray + y * stride;
+      T *dst = out + y * w;
+      for (int x = 0; x < w; x++) dst[x] = lut[src[x]];
+    }
+  } else {
+    downscaler_.configure(width, height, w, h);
+    downscaler_.run_gray<T>(gray, stride, out, lut);
+  }
+}
+
+template <typename T, int S>
+void InputAdapter::digit_plane(const uint8_t *gray, int width, int height,
+                               int stride, T *out, const InputLut<T> &lut) {
+  const int w = S ? S : spec_.width;
+  const int h = S ? S : spec_.height;
+  normalizer_.run_gray<T>(gray, width, height, stride, out, lut, w, h);
+}
+
+template <typename T, int S, Preprocessing P>
+void InputAdapter::vector_plane(const VectorCanvas &canvas, T *out,
+                                const InputLut<T> &lut) {
+  const int w = S ? S : spec_.width;
+  const int h = S ? S : spec_.height;
+  if constexpr (P == Preprocessing::mnist) {
+    rasterizer_.run_normalized<T>(canvas.strokes, canvas.brush, out, lut, w,
+                                  h);
+  } else {
+    rasterizer_.run<T>(canvas.strokes, canvas.brush, canvas.width,
+                       canvas.height, w, h, out, lut);
+  }
+}
+
+// NHWC interleaves the channels of a pixel, NCHW writes one plane after the
+// other, both are plain loops with a fixed trip count when S is set
+template <typename T, TensorLayout L, int C, int S>
+void InputAdapter::spread(T *out) const {
+  const int n = S ? S * S : spec_.width * spec_.height;
+  const InputLut<T> &table = lut<T>();
+  const uint8_t *src = scratch_.data();
+  if constexpr (L == TensorLayout::nhwc) {
+    for (int i = 0; i < n; i++) {
+      T value = table[src[i]];
+      for (int c = 0; c < C; c++) out[i * C + c] = value;
+    }
+  } else {
+    for (int c = 0; c < C; c++) {
+      T *plane = out + c * n;
+      for (int i = 0; i < n; i++) plane[i] = table[src[i]];
+    }
+  }
+}
+
+template <typename T, TensorLayout L, int C, int S, Preprocessing P>
+void InputAdapter::image_kernel(const uint8_t *argb, int width, int height,
+                                int stride, void *out) {
+  if constexpr (C == 1) {
+    image_plane<T, S, P>(argb, width, height, stride, static_cast<T *>(out),
+                         lut<T>());
+  } else {
+    image_plane<uint8_t, S, P>(argb, width, height, stride, scratch_.data(),
+                               identity_);
+    spread<T, L, C, S>(static_cast<T *>(out));
+  }
+}
+
+template <typename T, TensorLayout L, int C, int S>
+void InputAdapter::gray_kernel(const uint8_t *gray, int width, int height,
+                               int stride, void *out) {
+  if constexpr (C == 1) {
+    gray_plane<T, S>(gray, width, height, stride, static_cast<T *>(out),
+                     lut<T>());
+  } else {
+    gray_plane<uint8_t, S>(gray, width, height, stride, scratch_.data(),
+                           identity_);
+    spread<T, L, C, S>(static_cast<T *>(out));
+  }
+}
+
+template <typename T, TensorLayout L, int C, int S>
+void InputAdapter::digit_kernel(const uint8_t *gray, int width, int height,
+                                int stride, void *out) {
+  if constexpr (C == 1) {
+    digit_plane<T, S>(gray, width, height, stride, static_cast<T *>(out),
+                      lut<T>());
+  } else {
+    digit_plane<uint8_t, S>(gray, width, height, stride, scratch_.data(),
+                            identity_);
+    spread<T, L, C, S>(static_cast<T *>(out));
+  }
+}
+
+template <typename T, TensorLayout L, int C, int S, Preprocessing P>
+void InputAdapter::vector_kernel(const VectorCanvas &canvas, void *out) {
+  if constexpr (C == 1) {
+    vector_plane<T, S, P>(canvas, static_cast<T *>(out), lut<T>());
+  } else {
+    vector_plane<uint8_t, S, P>(canvas, scratch_.data(), identity_);
+    spread<T, L, C, S>(static_cast<T *>(out));
+  }
+}
@@ -0,0 +1,182 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of InputAdapter, the bridge between the preprocessing kernels and
+// the input tensor of whatever shape, layout and type the model has.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "preprocessing.h"
+#include "strokes.h"
+
+// How the image is turned into the model input
+enum class Preprocessing {
+  downscale,  // The whole image is scaled down to the input size
+  mnist       // The ink is cropped, scaled to 20/28 of the input and centered
+              // by its mass
+};
+
+// Per-tensor quantization, real = scale * (q - zero_point)
+// a scale of 0 means the tensor is not quantized
+struct QuantParams {
+  float scale = 0.0f;
+  int32_t zero_point = 0;
+};
+
+// Element type of the input tensor
+enum class InputType { unsupported, float32, int8, uint8 };
+
+// Order of the dimensions of an image input, the batch always comes first
+enum class TensorLayout {
+  nhwc,  // TensorFlow, the Keras exports
+  nchw   // PyTorch exports that keep the channels first
+};
+const char *layout_name(TensorLayout layout);
+
+// One image of the input tensor as the preprocessing sees it
+struct InputSpec {
+  InputType type = InputType::unsupported;
+  TensorLayout layout = TensorLayout::nhwc;
+  int width = 0;
+  int height = 0;
+  int channels = 0;  // 1 for gray, 3 for RGB where every channel gets the gray
+  QuantParams quant;
+
+  size_t elements() const {
+    return static_cast<size_t>(width) * height * channels;
+  }
+  // Same input, a tensor written for one can be copied into the other
+  bool operator==(const InputSpec &other) const {
+    return type == other.type && layout == other.layout &&
+           width == other.width && height == other.height &&
+           channels == other.channels && quant.scale == other.quant.scale &&
+           quant.zero_point == other.quant.zero_point;
+  }
+  // True if there is a kernel for the input
+  bool supported() const {
+    return type != InputType::unsupported && width > 0 && height > 0 &&
+           (channels == 1 || channels == 3);
+  }
+};
+
+/// Reads the layout and the size of the image from the shape of the input,
+/// dims includes the batch. 4D shapes are NHWC when the last dimension has 1
+/// or 3 channels and NCHW when the second one has, 3D shapes are NHW and 2D
+/// shapes a flattened square image. Returns false if the shape is not an
+/// image
+bool describe_input(const int *dims, int rank, InputSpec &spec);
+
+// InputAdapter writes an ARGB32 image, a gray image or strokes into one image
+// of the input tensor in the size, layout and type of the model. A kernel is
+// generated at compile time for every combination of type, layout, channels,
+// size and preprocessing, and the constructor picks the one of the model, so
+// a call is a single indirect call without any dispatch per call or per
+// pixel. 28x28 and 32x32 inputs get kernels with the size fixed, any other
+// size uses the kernel that reads it from the spec. One channel inputs are
+// written by the preprocessing straight through the quantization table,
+// three channel inputs go through a gray scratch image that is then spread
+// over the channels.
+// Not thread safe, use one per thread.
+class InputAdapter {
+ public:
+  InputAdapter(const InputSpec &spec, Preprocessing preprocessing);
+
+  // False if the spec is not supported, nothing may be written then
+  bool valid() const { return image_ != nullptr; }
+  const InputSpec &spec() const { return spec_; }
+  // Bytes of one image of the input tensor
+  size_t bytes() const;
+
+  /// Downscales, or normalizes with Preprocessing::mnist, and quantizes the
+  /// ARGB32 image into out, one image of the input tensor
+  void write_image(const uint8_t *argb, int width, int height, int stride,
+                   void *out) {
+    (this->*image_)(argb, width, height, stride, out);
+  }
+  /// Maps a one byte per pixel gray image into out. Images of the size of
+  /// the input only go through the quantization table, other sizes are
+  /// downscaled, whatever the preprocessing
+  void write_gray(const uint8_t *gray, int width, int height, int stride,
+                  void *out) {
+    (this->*gray_)(gray, width, height, stride, out);
+  }
+  /// Normalizes a gray image of a single digit like Preprocessing::mnist
+  /// into out, whatever the preprocessing. Used for the digits cut out of a
+  /// wider drawing, which only fill a small part of it
+  void write_digit(const uint8_t *gray, int width, int height, int stride,
+                   void *out) {
+    (this->*digit_)(gray, width, height, stride, out);
+  }
+  /// Rasterizes the strokes into out at the input resolution
+  void write_vector(const VectorCanvas &canvas, void *out) {
+    (this->*vector_)(canvas, out);
+  }
+
+ private:
+  using ImageKernel = void (InputAdapter::*)(const uint8_t *, int, int, int,
+                                             void *);
+  using VectorKernel = void (InputAdapter::*)(const VectorCanvas &, void *);
+
+  // Picks the kernels, one template level per property of the spec
+  template <typename T>
+  void bind_layout();
+  template <typename T, TensorLayout L, int C>
+  void bind_size();
+  template <typename T, TensorLayout L, int C, int S>
+  void bind();
+
+  // S is the side of the input, 0 when it is read from the spec
+  template <typename T, TensorLayout L, int C, int S, Preprocessing P>
+  void image_kernel(const uint8_t *argb, int width, int height, int stride,
+                    void *out);
+  template <typename T, TensorLayout L, int C, int S>
+  void gray_kernel(const uint8_t *gray, int width, int height, int stride,
+                   void *out);
+  template <typename T, TensorLayout L, int C, int S>
+  void digit_kernel(const uint8_t *gray, int width, int height, int stride,
+                    void *out);
+  template <typename T, TensorLayout L, int C, int S, Preprocessing P>
+  void vector_kernel(const VectorCanvas &canvas, void *out);
+  // One channel of the input, through lut into out
+  template <typename T, int S, Preprocessing P>
+  void image_plane(const uint8_t *argb, int width, int height, int stride,
+                   T *out, const InputLut<T> &lut);
+  template <typename T, int S>
+  void gray_plane(const uint8_t *gray, int width, int height, int stride,
+                  T *out, const InputLut<T> &lut);
+  template <typename T, int S>
+  void digit_plane(const uint8_t *gray, int width, int height, int stride,
+                   T *out, const InputLut<T> &lut);
+  template <typename T, int S, Preprocessing P>
+  void vector_plane(const VectorCanvas &canvas, T *out,
+                    const InputLut<T> &lut);
+  // Writes scratch_ into every channel of out through the input table
+  template <typename T, TensorLayout L, int C, int S>
+  void spread(T *out) const;
+  template <typename T>
+  const InputLut<T> &lut() const;
+
+  InputSpec spec_;
+  Preprocessing preprocessing_;
+  ImageKernel image_ = nullptr;
+  ImageKernel gray_ = nullptr;
+  ImageKernel digit_ = nullptr;
+  VectorKernel vector_ = nullptr;
+  // Gray levels to input values, built once from the input quantization so
+  // it is fused into the preprocessing
+  InputLut<float> lut_f_;
+  InputLut<int8_t> lut_i8_;
+  InputLut<uint8_t> lut_u8_;
+  // Gray levels kept as they are, used to fill scratch_
+  InputLut<uint8_t> identity_;
+  GrayDownscaler downscaler_;
+  DigitNormalizer normalizer_;
+  StrokeRasterizer rasterizer_;
+  // Gray image of the multi channel inputs before it is spread
+  std::vector<uint8_t> scratch_;
+};
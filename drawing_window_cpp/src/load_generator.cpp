@@ -0,0 +1,335 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Load generator for the inference server, opens several connections that
+// keep a number of requests in flight each and reports the throughput and
+// the latency seen by the clients.
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>  // Required for atoi
+#include <cstring>  // Required for strcmp
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "idx_file.h"
+#include "percentile.h"
+#include "server_protocol.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadConfig {
+  const char *socket_path = nullptr;
+  int connections = 1;
+  int depth = 1;       // Requests in flight per connection
+  int requests = 1000;  // Requests per connection
+  int size = 28;       // Side of the images sent
+  int batch = 1;       // Images per request
+};
+
+// Images sent round robin, with their labels when known
+struct Images {
+  int size = 0;
+  std::vector<uint8_t> pixels;
+  std::vector<int> labels;
+  size_t count() const { return pixels.size() / (size * size); }
+};
+
+// Per connection results
+struct ClientResult {
+  std::vector<double> latency_us;
+  uint64_t images = 0;
+  uint64_t correct = 0;
+  uint64_t labeled = 0;
+  uint64_t failed = 0;
+  uint64_t service_us = 0;
+  bool error = false;
+};
+
+// Scales the 28x28 MNIST digits to size with nearest neighbour, or draws a
+// ring, a zero, when no dataset is given
+static bool make_images(const char *idx_images, const char *idx_labels,
+                        int size, Images &images) {
+  images.size = size;
+  if (idx_images == nullptr) {
+    images.pixels.assign(size * size, 0);
+    double center = size / 2.0, radius = size * 0.3, width = size * 0.06;
+    for (int y = 0; y < size; y++) {
+      for (int x = 0; x < size; x++) {
+        double d = std::hypot(x + 0.5 - center, (y + 0.5 - center) * 0.8);
+        if (std::fabs(d - radius) < width) images.pixels[y * size + x] = 255;
+      }
+    }
+    images.labels.push_back(0);
+    return true;
+  }
+
+  IdxData data;
+  if (!read_idx(idx_images, data)) return false;
+  if (data.dims.size() != 3) {
+    std::cerr << "Expected an IDX file of images: " << idx_images << std::endl;
+    return false;
+  }
+  // The images are sent round robin, there must be at least one, e.g. a
+  // fresh --capture prefix has none yet
+  if (data.dims[0] == 0) {
+    std::cerr << "No images in " << idx_images << std::endl;
+    return false;
+  }
+  size_t count = std::min<size_t>(data.dims[0], 10000);
+  int rows = data.dims[1], cols = data.dims[2];
+  images.pixels.resize(count * size * size);
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *src = data.data.data() + i * rows * cols;
+    uint8_t *dst = images.pixels.data() + i * size * size;
+    for (int y = 0; y < size; y++) {
+      for (int x = 0; x < size; x++) {
+        dst[y * size + x] = src[(y * rows / size) * cols + x * cols / size];
+      }
+    }
+  }
+  IdxData labels;
+  if (idx_labels && read_idx(idx_labels, labels)) {
+    for (size_t i = 0; i < count && i < labels.data.size(); i++) {
+      images.labels.push_back(labels.data[i]);
+    }
+  }
+  return true;
+}
+
+static bool send_all(int fd, const uint8_t *data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+static bool recv_all(int fd, void *data, size_t size) {
+  uint8_t *dst = static_cast<uint8_t *>(data);
+  while (size > 0) {
+    ssize_t received = recv(fd, dst, size, 0);
+    if (received < 0 && errno == EINTR) continue;
+    if (received <= 0) return false;
+    dst += received;
+    size -= received;
+  }
+  return true;
+}
+
+// Keeps depth requests in flight, every response is matched with the oldest
+// request since the server answers in order
+static void run_client(const LoadConfig &config, const Images &images,
+                       int index, ClientResult &result) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, config.socket_path,
+               sizeof(address.sun_path) - 1);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address),
+                        sizeof(address)) != 0) {
+    std::cerr << "Failed to connect to " << config.socket_path << ": "
+              << std::strerror(errno) << std::endl;
+    if (fd >= 0) close(fd);
+    result.error = true;
+    return;
+  }
+
+  struct InFlight {
+    Clock::time_point sent;
+    size_t first;  // First image of the request
+  };
+  const size_t image_size = static_cast<size_t>(images.size) * images.size;
+  std::vector<uint8_t> request(sizeof(ServerRequest) +
+                               config.batch * image_size);
+  std::vector<ServerDigit> digits(config.batch);
+  std::deque<InFlight> in_flight;
+  // Every connection starts at a different image
+  size_t next_image = index * 997 % images.count();
+  int sent = 0, received = 0;
+  result.latency_us.reserve(config.requests);
+
+  while (received < config.requests) {
+    while (sent < config.requests &&
+           static_cast<int>(in_flight.size()) < config.depth) {
+      ServerRequest header{kServerRequestMagic,
+                           static_cast<uint32_t>(sent),
+                           static_cast<uint16_t>(images.size),
+                           static_cast<uint16_t>(images.size),
+                           static_cast<uint16_t>(config.batch), 0};
+      std::memcpy(request.data(), &header, sizeof(header));
+      for (int i = 0; i < config.batch; i++) {
+        size_t image = (next_image + i) % images.count();
+        std::memcpy(request.data() + sizeof(header) + i * image_size,
+                    images.pixels.data() + image * image_size, image_size);
+      }
+      in_flight.push_back({Clock::now(), next_image});
+      next_image = (next_image + config.batch) % images.count();
+      if (!send_all(fd, request.data(), request.size())) {
+        result.error = true;
+        break;
+      }
+      sent++;
+    }
+    if (result.error) break;
+
+    ServerResponse response;
+    if (!recv_all(fd, &response, sizeof(response)) ||
+        response.magic != kServerResponseMagic ||
+        response.status == kServerBadRequest ||
+        response.count != config.batch ||
+        !recv_all(fd, digits.data(), config.batch * sizeof(ServerDigit))) {
+      std::cerr << "Bad response from the server" << std::endl;
+      result.error = true;
+      break;
+    }
+    InFlight request_sent = in_flight.front();
+    in_flight.pop_front();
+    result.latency_us.push_back(
+        std::chrono::duration<double, std::micro>(Clock::now() -
+                                                  request_sent.sent)
+            .count());
+    result.service_us += response.service_us;
+    for (int i = 0; i < config.batch; i++) {
+      size_t image = (request_sent.first + i) % images.count();
+      if (digits[i].digit < 0) result.failed++;
+      if (image < images.labels.size()) {
+        result.labeled++;
+        if (digits[i].digit == images.labels[image]) result.correct++;
+      }
+    }
+    result.images += config.batch;
+    received++;
+  }
+  close(fd);
+}
+
+int main(int argc, char *argv[]) {
+  LoadConfig config;
+  const char *idx_images = nullptr;
+  const char *idx_labels = nullptr;
+
+  // Parse command line arguments, every option takes a value
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      std::cerr << "Error: " << argv[i] << " requires a value." << std::endl;
+      return 1;
+    }
+    // Socket of the server
+    if (std::strcmp(argv[i], "-s") == 0 ||
+        std::strcmp(argv[i], "--socket") == 0) {
+      config.socket_path = argv[++i];
+    }
+    // Concurrent connections
+    else if (std::strcmp(argv[i], "-c") == 0 ||
+             std::strcmp(argv[i], "--connections") == 0) {
+      config.connections = std::max(std::atoi(argv[++i]), 1);
+    }
+    // Requests in flight per connection
+    else if (std::strcmp(argv[i], "-p") == 0 ||
+             std::strcmp(argv[i], "--pipeline") == 0) {
+      config.depth = std::max(std::atoi(argv[++i]), 1);
+    }
+    // Requests per connection
+    else if (std::strcmp(argv[i], "-n") == 0 ||
+             std::strcmp(argv[i], "--requests") == 0) {
+      config.requests = std::max(std::atoi(argv[++i]), 1);
+    }
+    // Side of the images, 28 or the 250 of the window canvas
+    else if (std::strcmp(argv[i], "--size") == 0) {
+      config.size = std::clamp<int>(std::atoi(argv[++i]), 1, kServerMaxSide);
+    }
+    // Images per request
+    else if (std::strcmp(argv[i], "--batch") == 0) {
+      config.batch = std::clamp<int>(std::atoi(argv[++i]), 1, kServerMaxCount);
+    }
+    // MNIST IDX images and labels to send
+    else if (std::strcmp(argv[i], "--idx") == 0) {
+      idx_images = argv[++i];
+    } else if (std::strcmp(argv[i], "--labels") == 0) {
+      idx_labels = argv[++i];
+    } else {
+      std::cout << "Unknown option: " << argv[i] << "!" << std::endl;
+      std::cout << "Requires: -s socket_path" << std::endl;
+      std::cout << "Optional:\n connections -c n\n requests in flight -p n"
+                << "\n requests per connection -n n\n image side --size 28"
+                << "\n images per request --batch n"
+                << "\n MNIST images --idx images [--labels labels]"
+                << std::endl;
+      return 1;
+    }
+  }
+  if (config.socket_path == nullptr) {
+    std::cerr << "Error: Requires -s socket_path!" << std::endl;
+    return 1;
+  }
+  if (static_cast<size_t>(config.size) * config.size * config.batch >
+      kServerMaxPayload) {
+    std::cerr << "Error: requests over " << kServerMaxPayload << " bytes."
+              << std::endl;
+    return 1;
+  }
+
+  Images images;
+  if (!make_images(idx_images, idx_labels, config.size, images)) return 1;
+
+  std::vector<ClientResult> results(config.connections);
+  std::vector<std::thread> clients;
+  auto start = Clock::now();
+  for (int i = 0; i < config.connections; i++) {
+    clients.emplace_back(run_client, std::cref(config), std::cref(images), i,
+                         std::ref(results[i]));
+  }
+  for (auto &client : clients) client.join();
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  ClientResult total;
+  for (const ClientResult &result : results) {
+    total.latency_us.insert(total.latency_us.end(), result.latency_us.begin(),
+                            result.latency_us.end());
+    total.images += result.images;
+    total.correct += result.correct;
+    total.labeled += result.labeled;
+    total.failed += result.failed;
+    total.service_us += result.service_us;
+    total.error = total.error || result.error;
+  }
+  std::sort(total.latency_us.begin(), total.latency_us.end());
+  size_t requests = total.latency_us.size();
+
+  std::cout << "Connections: " << config.connections
+            << ", in flight: " << config.depth
+            << ", images per request: " << config.batch << " of "
+            << config.size << "x" << config.size << std::endl;
+  std::cout << "Requests: " << requests << " in " << elapsed.count()
+            << " s, " << requests / elapsed.count() << " req/s, "
+            << total.images / elapsed.count() << " images/s" << std::endl;
+  std::cout << "Latency p50/p95/p99/max: " << percentile(total.latency_us, 50)
+            << "/" << percentile(total.latency_us, 95) << "/"
+            << percentile(total.latency_us, 99) << "/"
+            << percentile(total.latency_us, 100) << " us, server side mean: "
+            << (requests ? total.service_us / requests : 0) << " us"
+            << std::endl;
+  if (total.labeled > 0) {
+    std::cout << "Accuracy: " << 100.0 * total.correct / total.labeled << "%"
+              << std::endl;
+  }
+  if (total.failed > 0) {
+    std::cout << "Failed images: " << total.failed << std::endl;
+  }
+  return total.error ? 1 : 0;
+}
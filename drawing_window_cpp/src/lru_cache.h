@@ -0,0 +1,56 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of LruCache, a small least recently used cache.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// LruCache keeps the capacity most recently used entries, most recent first.
+// Meant for a handful of entries, a lookup is a linear scan over a
+// contiguous array, which beats a map at these sizes. The array is reserved
+// up front, but insert copies the value so a value owning memory, e.g. the
+// digits of a Prediction, still allocates. Key needs operator==. Not thread
+// safe.
+template <typename Key, typename Value>
+class LruCache {
+ public:
+  explicit LruCache(size_t capacity)
+      : capacity_(std::max<size_t>(capacity, 1)) {
+    entries_.reserve(capacity_);
+  }
+
+  /// Returns the value of key and makes it the most recent entry, nullptr if
+  /// it is not cached. The pointer is valid until the next insert
+  const Value *find(const Key &key) {
+    auto it = std::find_if(entries_.begin(), entries_.end(),
+                           [&key](const Entry &e) { return e.first == key; });
+    if (it == entries_.end()) return nullptr;
+    std::rotate(entries_.begin(), it, it + 1);
+    return &entries_.front().second;
+  }
+
+  // Adds or replaces key as the most recent entry, evicting the least
+  // recently used one when full
+  void insert(const Key &key, const Value &value) {
+    if (find(key)) {
+      entries_.front().second = value;
+      return;
+    }
+    if (entries_.size() == capacity_) entries_.pop_back();
+    entries_.insert(entries_.begin(), {key, value});
+  }
+
+  void clear() { entries_.clear(); }
+  size_t size() const { return entries_.size(); }
+
+ private:
+  using Entry = std::pair<Key, Value>;
+  size_t capacity_;
+  std::vector<Entry> entries_;
+};
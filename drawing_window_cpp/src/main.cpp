@@ -4,10 +4,22 @@
 // details.
 //
 
+#include <algorithm>
+#include <cstdlib>  // Required for atoi
 #include <cstring>  // Required for strcmp
+#include <future>
 #include <iostream>
+#include <memory>
+#include <vector>
 
+#include "bench.h"
+#include "digit_server.h"
 #include "nn_model.h"
+#include "number_reader.h"
+#include "predictor.h"
+#include "session_replay.h"
+#include "startup_timing.h"
+#include "tracing.h"
 #include "window.h"
 
 // Creates application and runs it
@@ -16,6 +28,20 @@ int main(int argc, char* argv[]) {
   bool verbose = false;
   const char* delegate_path = nullptr;
   const char* model_path = nullptr;
+  LivePredictConfig live;
+  bool bench = false;
+  BenchConfig bench_config;
+  NnModelOptions model_options;
+  bool probe = false;
+  const char* trace_path = nullptr;
+  Preprocessing preprocessing = Preprocessing::downscale;
+  bool vector_input = false;
+  size_t max_digits = 0;
+  ModelSwapConfig models;
+  ServerConfig server_config;
+  const char* record_path = nullptr;
+  const char* capture_prefix = nullptr;
+  ReplayConfig replay;
 
   // Require model
   if (argc == 1) {
@@ -55,22 +81,401 @@ int main(int argc, char* argv[]) {
         return 1;  // Exit with an error code
       }
     }
+    // Interpreter threads
+    else if (std::strcmp(argv[i], "-t") == 0 ||
+             std::strcmp(argv[i], "--threads") == 0) {
+      if (i + 1 < argc) {
+        model_options.num_threads = std::atoi(argv[i + 1]);
+        i++;
+      } else {
+        std::cerr << "Error: --threads requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Backend fallback chain, e.g. ethos,xnnpack,builtin
+    else if (std::strcmp(argv[i], "--backend") == 0) {
+      if (i + 1 < argc) {
+        if (!parse_backends(argv[i + 1], model_options.backends)) return 1;
+        i++;
+      } else {
+        std::cerr << "Error: --backend requires a list." << std::endl;
+        return 1;
+      }
+    }
+    // XNNPACK threads, defaults to the interpreter threads
+    else if (std::strcmp(argv[i], "--xnnpack-threads") == 0) {
+      if (i + 1 < argc) {
+        model_options.xnnpack_threads = std::atoi(argv[i + 1]);
+        i++;
+      } else {
+        std::cerr << "Error: --xnnpack-threads requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Force fp16 on XNNPACK
+    else if (std::strcmp(argv[i], "--fp16") == 0) {
+      model_options.xnnpack_fp16 = true;
+    }
+    // XNNPACK weight cache file
+    else if (std::strcmp(argv[i], "--weight-cache") == 0) {
+      if (i + 1 < argc) {
+        model_options.xnnpack_weight_cache = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --weight-cache requires a filename." << std::endl;
+        return 1;
+      }
+    }
+    // Time every backend of the chain and exit
+    else if (std::strcmp(argv[i], "--probe") == 0) {
+      probe = true;
+    }
+    // Fault the whole model file in when it is mapped
+    else if (std::strcmp(argv[i], "--mmap-populate") == 0) {
+      model_options.map.populate = true;
+    }
+    // Access pattern hint for the model file mapping
+    else if (std::strcmp(argv[i], "--madvise") == 0) {
+      if (i + 1 < argc) {
+        if (!parse_map_advice(argv[i + 1], model_options.map.advice)) return 1;
+        i++;
+      } else {
+        std::cerr << "Error: --madvise requires a hint." << std::endl;
+        return 1;
+      }
+    }
+    // Per-stage trace in the Chrome trace format
+    else if (std::strcmp(argv[i], "--trace") == 0) {
+      if (i + 1 < argc) {
+        trace_path = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --trace requires a filename." << std::endl;
+        return 1;
+      }
+    }
+    // Adds the TFLite op timings to the trace
+    else if (std::strcmp(argv[i], "--trace-ops") == 0) {
+      model_options.op_profiling = true;
+    }
+    // Crop, scale and center the digit like MNIST before the inference
+    else if (std::strcmp(argv[i], "--mnist") == 0) {
+      preprocessing = Preprocessing::mnist;
+    }
+    // Rasterize the strokes at the model resolution for the inference
+    else if (std::strcmp(argv[i], "--vector") == 0) {
+      vector_input = true;
+    }
+    // Read a number of up to n digits from a wide canvas
+    else if (std::strcmp(argv[i], "--number") == 0) {
+      if (i + 1 < argc) {
+        max_digits = std::clamp(std::atoi(argv[i + 1]), 0,
+                                static_cast<int>(NumberReader::kMaxDigits));
+        i++;
+      } else {
+        std::cerr << "Error: --number requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Accuracy of every preprocessing on shifted and scaled samples
+    else if (std::strcmp(argv[i], "--compare-preprocessing") == 0) {
+      bench = true;
+      bench_config.compare_preprocessing = true;
+    }
+    // Second model predicting next to the first one
+    else if (std::strcmp(argv[i], "--compare") == 0) {
+      if (i + 1 < argc) {
+        models.compare_path = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --compare requires a filename." << std::endl;
+        return 1;
+      }
+    }
+    // Reload the models when their files are replaced
+    else if (std::strcmp(argv[i], "--watch") == 0) {
+      models.watch = true;
+    }
+    // Probability under which a prediction is shown as not sure
+    else if (std::strcmp(argv[i], "--min-confidence") == 0) {
+      if (i + 1 < argc) {
+        models.min_confidence = std::atof(argv[i + 1]);
+        i++;
+      } else {
+        std::cerr << "Error: --min-confidence requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Live prediction while drawing
+    else if (std::strcmp(argv[i], "-l") == 0 ||
+             std::strcmp(argv[i], "--live") == 0) {
+      live.enabled = true;
+    }
+    // Live prediction interval in milliseconds
+    else if (std::strcmp(argv[i], "--live-ms") == 0) {
+      if (i + 1 < argc) {
+        live.enabled = true;
+        live.interval_ms = std::atoi(argv[i + 1]);
+        i++;
+      } else {
+        std::cerr << "Error: --live-ms requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Live prediction every N new points
+    else if (std::strcmp(argv[i], "--live-points") == 0) {
+      if (i + 1 < argc) {
+        live.enabled = true;
+        live.min_points = std::atoi(argv[i + 1]);
+        i++;
+      } else {
+        std::cerr << "Error: --live-points requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Headless benchmark, no window is created
+    else if (std::strcmp(argv[i], "--bench") == 0) {
+      bench = true;
+    }
+    // Directory of PNG files for the benchmark
+    else if (std::strcmp(argv[i], "--input-dir") == 0) {
+      if (i + 1 < argc) {
+        bench = true;
+        bench_config.input_dir = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --input-dir requires a directory." << std::endl;
+        return 1;
+      }
+    }
+    // MNIST IDX images for the benchmark
+    else if (std::strcmp(argv[i], "--idx") == 0) {
+      if (i + 1 < argc) {
+        bench = true;
+        bench_config.idx_images = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --idx requires a filename." << std::endl;
+        return 1;
+      }
+    }
+    // MNIST IDX labels for the benchmark accuracy
+    else if (std::strcmp(argv[i], "--labels") == 0) {
+      if (i + 1 < argc) {
+        bench_config.idx_labels = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --labels requires a filename." << std::endl;
+        return 1;
+      }
+    }
+    // Max number of samples for the benchmark
+    else if (std::strcmp(argv[i], "--limit") == 0) {
+      if (i + 1 < argc) {
+        bench_config.limit = std::atoi(argv[i + 1]);
+        i++;
+      } else {
+        std::cerr << "Error: --limit requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Images per invoke for the batched benchmark
+    else if (std::strcmp(argv[i], "--batch") == 0) {
+      if (i + 1 < argc) {
+        bench_config.batch = std::atoi(argv[i + 1]);
+        server_config.batch = bench_config.batch;
+        i++;
+      } else {
+        std::cerr << "Error: --batch requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Max workers for the pool scaling benchmark
+    else if (std::strcmp(argv[i], "--workers") == 0) {
+      if (i + 1 < argc) {
+        bench_config.workers = std::atoi(argv[i + 1]);
+        i++;
+      } else {
+        std::cerr << "Error: --workers requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Serve predictions over a UNIX domain socket, no window is created
+    else if (std::strcmp(argv[i], "--server") == 0) {
+      if (i + 1 < argc) {
+        server_config.socket_path = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --server requires a socket path." << std::endl;
+        return 1;
+      }
+    }
+    // Event loops of the server, each with its own interpreter
+    else if (std::strcmp(argv[i], "--server-workers") == 0) {
+      if (i + 1 < argc) {
+        server_config.workers = std::atoi(argv[i + 1]);
+        i++;
+      } else {
+        std::cerr << "Error: --server-workers requires a value." << std::endl;
+        return 1;
+      }
+    }
+    // Record the drawing session to a file
+    else if (std::strcmp(argv[i], "--record") == 0) {
+      if (i + 1 < argc) {
+        record_path = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --record requires a file." << std::endl;
+        return 1;
+      }
+    }
+    // Save labeled drawings to IDX files for training
+    else if (std::strcmp(argv[i], "--capture") == 0) {
+      if (i + 1 < argc) {
+        capture_prefix = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --capture requires a prefix." << std::endl;
+        return 1;
+      }
+    }
+    // Replay a recorded session without a display
+    else if (std::strcmp(argv[i], "--replay") == 0) {
+      if (i + 1 < argc) {
+        replay.path = argv[i + 1];
+        i++;
+      } else {
+        std::cerr << "Error: --replay requires a file." << std::endl;
+        return 1;
+      }
+    }
+    // Keep the recorded timing of the replayed events
+    else if (std::strcmp(argv[i], "--replay-realtime") == 0) {
+      replay.realtime = true;
+    }
     // Handle other arguments or positional arguments
     else {
       std::cout << "Unknown option: " << argv[i] << "!" << std::endl;
       std::cout << "Requires: -m model_path " << std::endl;
       std::cout << "Optional:\n -d delegate_path -d\n verbose mode -v"
+                << "\n live prediction -l [--live-ms ms] [--live-points n]"
+                << "\n headless benchmark --bench --input-dir dir | --idx "
+                   "images [--labels labels] [--limit n] [--batch n]"
+                   " [--workers n]"
+                << "\n threads -t n\n backends --backend ethos,xnnpack,builtin"
+                << "\n xnnpack --xnnpack-threads n --fp16 --weight-cache file"
+                << "\n time every backend --probe"
+                << "\n record --record file, replay --replay file"
+                   " [--replay-realtime]"
+                << "\n dataset capture --capture prefix"
+                << "\n server --server socket_path [--server-workers n]"
+                   " [--batch n]"
+                << "\n model mapping --mmap-populate --madvise "
+                   "normal|willneed|sequential|random"
+                << "\n trace --trace file.json [--trace-ops]"
+                << "\n MNIST preprocessing --mnist [--compare-preprocessing]"
+                << "\n vector input --vector"
+                << "\n multi-digit number --number n, up to 9 digits"
+                << "\n compare models --compare model_path [--watch]"
+                << "\n reload model files moved over with mv --watch, files"
+                   " rewritten in place are not reloaded"
+                << "\n confidence threshold --min-confidence 0..1"
                 << std::endl;
     }
   }
 
-  // Create model with parsed parameters
-  NnModel nn(model_path, delegate_path, verbose);
+  if (!model_path) {
+    std::cerr << "Error: Requires -m model_path!" << std::endl;
+    return 1;
+  }
+  model_options.delegate_path = delegate_path;
+  model_options.verbose = verbose;
+  // Enabled before any thread starts, the events of the last minutes of a
+  // session fit in the ring
+  if (trace_path) trace_enable(1 << 18);
+  startup_mark("arguments parsed");
+
+  // Exports the trace once the run is over
+  auto finish = [trace_path](int status) {
+    if (trace_path) {
+      trace_write_chrome_json(trace_path);
+      trace_print_summary();
+    }
+    return status;
+  };
+
+  // Time the backends and exit
+  if (probe) {
+    NnModel::probe_backends(NnModel::load_model(model_path, model_options.map),
+                            model_options, 50);
+    return 0;
+  }
+
+  // The server runs without a display until it is interrupted
+  if (server_config.socket_path) {
+    server_config.verbose = verbose;
+    return finish(
+        run_server(NnModel::load_model(model_path, model_options.map),
+                   model_options, server_config));
+  }
+
+  // The benchmark runs without a display
+  if (bench) {
+    // Create model with parsed parameters
+    NnModel nn(NnModel::load_model(model_path, model_options.map),
+               model_options);
+    bench_config.model_options = model_options;
+    bench_config.preprocessing = preprocessing;
+    return finish(run_bench(nn, bench_config));
+  }
+
+  // The replay runs without a display, with live prediction every
+  // --live-points points when given
+  if (replay.path) {
+    NnModel nn(NnModel::load_model(model_path, model_options.map),
+               model_options);
+    replay.preprocessing = preprocessing;
+    replay.vector_input = vector_input;
+    if (live.enabled) replay.live_points = live.min_points;
+    return finish(run_replay(nn, replay));
+  }
+
+  // Load and warm up the model while GTK and the window are set up, the
+  // window is interactive before the model is ready
+  std::shared_future<std::shared_ptr<NnModel>> model =
+      std::async(std::launch::async, [model_path, model_options,
+                                      preprocessing] {
+        return load_warm_model(model_path, model_options, preprocessing,
+                               true);
+      }).share();
+  models.path = model_path;
+  models.options = model_options;
 
   // Create execution window
   char* program_name_only[] = {argv[0], nullptr};
   int modified_argc = 1;
   auto app = Gtk::Application::create("org.gtkmm.examples.base");
-  Window window(nn);
-  return app->run(window, modified_argc, program_name_only);
+  startup_mark("gtk initialized");
+  Window window(model, models, verbose, live, preprocessing, vector_input,
+                max_digits);
+  // A file that cannot be created ends the run before the window shows
+  if (record_path) {
+    try {
+      window.record_session(record_path);
+    } catch (const std::exception& e) {
+      std::cerr << "Failed to record the session: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+  if (capture_prefix) {
+    try {
+      window.capture_dataset(capture_prefix);
+    } catch (const std::exception& e) {
+      std::cerr << "Failed to start the capture: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+  startup_mark("window constructed");
+  return finish(app->run(window, modified_argc, program_name_only));
 }
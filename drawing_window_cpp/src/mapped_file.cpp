@@ -0,0 +1,88 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of MappedFile
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+bool parse_map_advice(const char *name, MapAdvice &advice) {
+  if (std::strcmp(name, "normal") == 0) {
+    advice = MapAdvice::normal;
+  } else if (std::strcmp(name, "willneed") == 0) {
+    advice = MapAdvice::willneed;
+  } else if (std::strcmp(name, "sequential") == 0) {
+    advice = MapAdvice::sequential;
+  } else if (std::strcmp(name, "random") == 0) {
+    advice = MapAdvice::random;
+  } else {
+    std::cerr << "Unknown madvise hint: " << name << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// The descriptor is only needed to create the mapping
+MappedFile::MappedFile(const char *path, const MapOptions &options) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << path << ": " << std::strerror(errno)
+              << std::endl;
+    throw std::runtime_error("Unable to open file");
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    std::cerr << "Failed to stat " << path << " or it is empty" << std::endl;
+    close(fd);
+    throw std::runtime_error("Unable to map file");
+  }
+  size_ = static_cast<size_t>(info.st_size);
+
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (options.populate) flags |= MAP_POPULATE;
+#endif
+  data_ = mmap(nullptr, size_, PROT_READ, flags, fd, 0);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    std::cerr << "Failed to map " << path << ": " << std::strerror(errno)
+              << std::endl;
+    close(fd);
+    throw std::runtime_error("Unable to map file");
+  }
+  close(fd);
+
+  int advice = MADV_NORMAL;
+  switch (options.advice) {
+    case MapAdvice::normal:
+      break;
+    case MapAdvice::willneed:
+      advice = MADV_WILLNEED;
+      break;
+    case MapAdvice::sequential:
+      advice = MADV_SEQUENTIAL;
+      break;
+    case MapAdvice::random:
+      advice = MADV_RANDOM;
+      break;
+  }
+  // Only a hint, the mapping works the same if it is refused
+  if (advice != MADV_NORMAL && madvise(data_, size_, advice) != 0) {
+    std::cerr << "madvise failed on " << path << ": " << std::strerror(errno)
+              << std::endl;
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) munmap(data_, size_);
+}
@@ -0,0 +1,46 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of MappedFile, a read-only memory mapping of a whole file.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Access pattern hint passed to madvise
+enum class MapAdvice {
+  normal,      // No hint
+  willneed,    // Read ahead the whole file in the background
+  sequential,  // Aggressive read ahead, pages can be dropped once read
+  random       // No read ahead
+};
+// Parses normal, willneed, sequential or random
+bool parse_map_advice(const char *name, MapAdvice &advice);
+
+// How a file is mapped
+struct MapOptions {
+  bool populate = false;  // Fault every page in at map time (MAP_POPULATE)
+  MapAdvice advice = MapAdvice::normal;
+};
+
+// MappedFile maps a file read-only and shared, so every mapping of the same
+// file, in this process or another one, is backed by the same page cache
+// pages and the data does not count once per copy. The mapping is released
+// when the object is destroyed.
+class MappedFile {
+ public:
+  /// Maps the file at path, throws if it cannot be opened or mapped
+  MappedFile(const char *path, const MapOptions &options);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return static_cast<const char *>(data_); }
+  size_t size() const { return size_; }
+
+ private:
+  void *data_ = nullptr;
+  size_t size_ = 0;
+};
@@ -9,29 +9,41 @@
 
 #include <gtkmm/drawingarea.h>
 
-#include <vector>
+#include "drawing_canvas.h"
 
 // MouseDrawing Definition
-// It handles mouse events and defines a default drawing area
-// it also keeps state betwen different on_draw calls
+// It handles mouse events and defines a default drawing area, the strokes
+// and the surface live in a DrawingCanvas that keeps the state between
+// different on_draw calls
 class MouseDrawing : public Gtk::DrawingArea {
  public:
-  MouseDrawing();
+  // width widens the drawing area, e.g. to write a number
+  explicit MouseDrawing(int width = 250);
   // Used to clear the screen
   void clear_screen(void);
   // Used to generate an image file from the current screen
   void save_screen(void);
-  // Exports screen to a grayscale vector
-  // takes the width and height to be scaled to
-  template <typename T>
-  std::vector<T> export_to_vector(int w, int h, double scale);
+  // Returns a copy of the current screen that can be handed to another
+  // thread while the user keeps drawing
+  Cairo::RefPtr<Cairo::ImageSurface> snapshot(void) {
+    return canvas.snapshot();
+  }
+  // Strokes drawn so far, e.g. to rasterize them at the model resolution
+  const StrokeSet &strokes() const { return canvas.strokes(); }
+  // Returns a copy of the strokes, much cheaper than snapshot() and enough
+  // to rasterize the drawing at the model resolution
+  VectorCanvas vector_snapshot() const { return canvas.vector_snapshot(); }
+  // Records the session to path so it can be replayed, throws if the file
+  // cannot be created
+  void start_recording(const char *path) { canvas.start_recording(path); }
+  // Records that a prediction was requested
+  void record_predict() { canvas.record_predict(); }
+
+  // Signal emitted after new points are drawn, with the number of new points
+  using type_signal_stroke = sigc::signal<void, size_t>;
+  type_signal_stroke signal_stroke() { return signal_stroke_; }
 
   virtual ~MouseDrawing();
-  // State definitions to decide how to handle on_draw calls
-  enum class DrawState {
-    clear,  // Clears the screen
-    draw    // Draws the points currently stored on the screen
-  };
 
  protected:
   // Draw handler
@@ -42,24 +54,20 @@ class MouseDrawing : public Gtk::DrawingArea {
   bool on_button_release_event(GdkEventButton *event);
   // Handles whenever the mouse moves over the area
   bool on_motion_notify_event(GdkEventMotion *event);
+  // Rasterizes the points not yet drawn into the surface and invalidates
+  // only the area covered by them
+  void rasterize_pending_points(void);
 
  private:
-  // Default width of the drawing area
-  int drawing_area_w = 250;
+  // Width of the drawing area
+  int drawing_area_w;
   // Default height of the drawing area
   int drawing_area_h = 250;
   // Default brush size used to draw the circles with the mouse
   double brush_size = 10.0;
-  // On the first call we clear the screen
-  DrawState state = DrawState::clear;
-  // Used to signal when the left mouse button is pressed
-  bool left_clicked = false;
-  // Used to store the cairo context between on_draw calls
-  Cairo::RefPtr<Cairo::Surface> surface;
-  // Used to store mouse activity data
-  struct Point {
-    double x, y;
-  };
-  // Stores all the mouse coordinates while the left mouse is clicked
-  std::vector<Point> points;
+  // Strokes and the persistent surface holding everything drawn so far,
+  // on_draw only composites it onto the widget
+  DrawingCanvas canvas;
+  // Notifies listeners, e.g. live prediction, about new strokes
+  type_signal_stroke signal_stroke_;
 };
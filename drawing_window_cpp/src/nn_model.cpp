@@ -6,57 +6,175 @@
 // NnModel definition
 #include "nn_model.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 
 #include "tensorflow/lite/delegates/external/external_delegate.h"
+#include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
 #include "tensorflow/lite/interpreter_builder.h"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/model_builder.h"
 #include "tensorflow/lite/optional_debug_tools.h"
 
-NnModel::NnModel(const char *model_path, const char *delegate_path,
-                 bool verbose)
-    : verbose_(verbose) {
-  // Create TFLite interpreter
-  // Load model
+// Load model
+// The model does not own the buffer it is built from, the deleter keeps the
+// mapping alive until the model is gone
+std::shared_ptr<tflite::FlatBufferModel> NnModel::load_model(
+    const char *model_path, const MapOptions &options) {
+  std::shared_ptr<MappedFile> file;
+  try {
+    file = std::make_shared<MappedFile>(model_path, options);
+  } catch (const std::exception &) {
+    std::cerr << "Failed to load model: " << model_path << std::endl;
+    throw std::invalid_argument("Invalid model");
+  }
   std::unique_ptr<tflite::FlatBufferModel> model =
-      tflite::FlatBufferModel::BuildFromFile(model_path);
+      tflite::FlatBufferModel::BuildFromBuffer(file->data(), file->size());
   if (!model) {
     std::cerr << "Failed to load model: " << model_path << std::endl;
     throw std::invalid_argument("Invalid model");
   }
+  return std::shared_ptr<tflite::FlatBufferModel>(
+      model.release(),
+      [file](tflite::FlatBufferModel *loaded) { delete loaded; });
+}
 
-  // Build the interpreter
-  // Resolver makes sure the operations in the model are available to the
-  // interpreter
-  tflite::ops::builtin::BuiltinOpResolver resolver;
-  tflite::InterpreterBuilder(*model, resolver)(&interpreter_);
-  if (interpreter_ == nullptr) {
-    std::cerr << "Failed to build interpreter" << std::endl;
-    throw std::invalid_argument("Invalid interpreter");
+const char *backend_name(Backend backend) {
+  switch (backend) {
+    case Backend::external:
+      return "external";
+    case Backend::xnnpack:
+      return "xnnpack";
+    case Backend::builtin:
+      return "builtin";
   }
+  return "unknown";
+}
 
-  // Setup delegate if required
-  if (delegate_path != nullptr) {
-    // Create external delegate option and pass the delegate library
-    TfLiteExternalDelegateOptions external_delegate_options =
-        TfLiteExternalDelegateOptionsDefault(delegate_path);
-    // Create the External Delegate. This will load the delegate.
-    TfLiteDelegate *external_delegate =
-        TfLiteExternalDelegateCreate(&external_delegate_options);
+bool parse_backends(const char *list, std::vector<Backend> &backends) {
+  backends.clear();
+  std::string names(list);
+  size_t start = 0;
+  while (start <= names.size()) {
+    size_t end = names.find(',', start);
+    if (end == std::string::npos) end = names.size();
+    std::string name = names.substr(start, end - start);
+    if (name == "external" || name == "ethos") {
+      backends.push_back(Backend::external);
+    } else if (name == "xnnpack") {
+      backends.push_back(Backend::xnnpack);
+    } else if (name == "builtin") {
+      backends.push_back(Backend::builtin);
+    } else {
+      std::cerr << "Unknown backend: " << name << std::endl;
+      return false;
+    }
+    start = end + 1;
+  }
+  return !backends.empty();
+}
 
-    // Add External Delegate into TFLite Interpreter to automatically delegate
-    // nodes.
-    if (interpreter_->ModifyGraphWithDelegate(external_delegate) != kTfLiteOk) {
-      std::cerr << "Failed to add delegate" << std::endl;
-      throw std::runtime_error("Unable to add delegate");
+// Backends of options, or the default chain if it sets none, e.g. Ethos-U ->
+// XNNPACK -> builtin kernels
+static std::vector<Backend> backend_chain(const NnModelOptions &options) {
+  if (!options.backends.empty()) return options.backends;
+  std::vector<Backend> backends;
+  if (options.delegate_path != nullptr) backends.push_back(Backend::external);
+  backends.push_back(Backend::xnnpack);
+  backends.push_back(Backend::builtin);
+  return backends;
+}
+
+NnModel::NnModel(const char *model_path, const char *delegate_path,
+                 bool verbose)
+    : NnModel(load_model(model_path), delegate_path, verbose) {}
+
+NnModel::NnModel(std::shared_ptr<tflite::FlatBufferModel> model,
+                 const char *delegate_path, bool verbose)
+    : NnModel(std::move(model), [&] {
+        NnModelOptions options;
+        options.delegate_path = delegate_path;
+        options.verbose = verbose;
+        return options;
+      }()) {}
+
+// Tries the backends in order and keeps the first one that can run the model
+// the time spent on each attempt is printed when verbose or when there is a
+// chain, so the configurations can be compared on every board
+NnModel::NnModel(std::shared_ptr<tflite::FlatBufferModel> model,
+                 const NnModelOptions &options)
+    : model_(std::move(model)), verbose_(options.verbose) {
+  const std::vector<Backend> backends = backend_chain(options);
+  // With a single candidate there is nothing to compare, e.g. the probes
+  const bool report = verbose_ || backends.size() > 1;
+  for (Backend candidate : backends) {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = build(candidate, options);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    if (report) {
+      std::cout << "Backend " << backend_name(candidate)
+                << (ok ? " ready in " : " failed after ")
+                << elapsed.count() / 1000.0 << " ms" << std::endl;
+    }
+    if (ok) {
+      backend_ = candidate;
+      break;
     }
   }
+  if (interpreter_ == nullptr) {
+    std::cerr << "No backend can run the model" << std::endl;
+    throw std::runtime_error("Unable to build interpreter");
+  }
+  if (options.op_profiling) {
+    // Sized for a few invokes of a small model, the events are drained after
+    // every invoke
+    profiler_ = std::make_unique<tflite::profiling::BufferedProfiler>(1024);
+    interpreter_->SetProfiler(profiler_.get());
+    op_trace_names_.assign(interpreter_->nodes_size(), nullptr);
+  }
 
-  // Allocate tensors for the model
-  if (interpreter_->AllocateTensors() != kTfLiteOk) {
-    std::cerr << "Failed to allocate tensors" << std::endl;
-    throw std::runtime_error("Unable to allocate tensors");
+  // Read the quantization of the input and output and describe the input
+  const TfLiteTensor *input = interpreter_->input_tensor(0);
+  const TfLiteTensor *output = interpreter_->output_tensor(0);
+  input_dims_.assign(input->dims->data, input->dims->data + input->dims->size);
+  if (!input_dims_.empty()) batch_size_ = input_dims_[0];
+  if (input->quantization.type == kTfLiteAffineQuantization)
+    input_quant_ = {input->params.scale, input->params.zero_point};
+  if (output->quantization.type == kTfLiteAffineQuantization)
+    output_quant_ = {output->params.scale, output->params.zero_point};
+  input_spec_ = {};
+  input_spec_.quant = input_quant_;
+  switch (input->type) {
+    case kTfLiteFloat32:
+      input_spec_.type = InputType::float32;
+      break;
+    case kTfLiteInt8:
+      input_spec_.type = InputType::int8;
+      break;
+    case kTfLiteUInt8:
+      input_spec_.type = InputType::uint8;
+      break;
+    default:
+      std::cerr << "Cannot handle input type: " << std::to_string(input->type)
+                << std::endl;
+  }
+  if (!describe_input(input_dims_.data(), input_dims_.size(), input_spec_)) {
+    std::cerr << "The input is not an image, cannot handle its shape"
+              << std::endl;
+  }
+
+  if (verbose_) {
+    std::cout << "Input: " << input_spec_.width << "x" << input_spec_.height
+              << "x" << input_spec_.channels << " "
+              << layout_name(input_spec_.layout) << std::endl;
+    std::cout << "Input quantization: " << input_quant_.scale << ", "
+              << input_quant_.zero_point << std::endl;
+    std::cout << "Output quantization: " << output_quant_.scale << ", "
+              << output_quant_.zero_point << std::endl;
   }
 
   if(verbose_)
@@ -86,3 +204,297 @@ NnModel::NnModel(const char *model_path, const char *delegate_path,
 
   }
 }
+
+// A single pass keeps the best k by insertion, k is small, and gathers what
+// tells a distribution from logits. Only the k best need a probability, the
+// softmax sum is a second pass over the scores
+template <typename T>
+size_t NnModel::top_k_typed(int row, ClassScore *top, size_t k) {
+  TensorSpan<const T> out = output_row<T>(row);
+  const float scale = output_quant_.scale > 0.0f ? output_quant_.scale : 1.0f;
+  const int32_t zero_point = output_quant_.zero_point;
+  k = std::min(k, out.size);
+  if (k == 0) return 0;
+  auto real = [scale, zero_point](T q) {
+    if constexpr (std::is_same_v<T, float>) {
+      return q;
+    } else {
+      return scale * (static_cast<int32_t>(q) - zero_point);
+    }
+  };
+
+  size_t count = 0;
+  float max = -INFINITY, min = INFINITY, sum = 0.0f;
+  for (size_t i = 0; i < out.size; i++) {
+    float score = real(out[i]);
+    max = std::max(max, score);
+    min = std::min(min, score);
+    sum += score;
+    if (count == k && score <= top[k - 1].probability) continue;
+    size_t j = count < k ? count++ : k - 1;
+    for (; j > 0 && top[j - 1].probability < score; j--) top[j] = top[j - 1];
+    top[j] = {static_cast<int>(i), score};
+  }
+
+  // A quantized softmax is off by up to half a step per class, outputs
+  // without quantization parameters get no allowance since their step is
+  // unknown
+  float tolerance = 0.01f;
+  if constexpr (!std::is_same_v<T, float>) {
+    if (output_quant_.scale > 0.0f) tolerance += out.size * scale * 0.5f;
+  }
+  if (min >= 0.0f && std::fabs(sum - 1.0f) <= tolerance) return count;
+  float exp_sum = 0.0f;
+  for (size_t i = 0; i < out.size; i++) {
+    exp_sum += std::exp(real(out[i]) - max);
+  }
+  for (size_t i = 0; i < count; i++) {
+    top[i].probability = std::exp(top[i].probability - max) / exp_sum;
+  }
+  return count;
+}
+
+size_t NnModel::top_k(int row, ClassScore *top, size_t k) {
+  switch (interpreter_->output_tensor(0)->type) {
+    case kTfLiteFloat32:
+      return top_k_typed<float>(row, top, k);
+    case kTfLiteInt8:
+      return top_k_typed<int8_t>(row, top, k);
+    case kTfLiteUInt8:
+      return top_k_typed<uint8_t>(row, top, k);
+    default:
+      return 0;
+  }
+}
+
+// Copies the output tensor as real values, quantized outputs are mapped back
+// with the output scale and zero point
+size_t NnModel::dequantize_output(float *scores, size_t capacity) {
+  const TfLiteTensor *output = interpreter_->output_tensor(0);
+  const float scale = output_quant_.scale > 0.0f ? output_quant_.scale : 1.0f;
+  const int32_t zero_point = output_quant_.zero_point;
+  size_t count = 0;
+  switch (output->type) {
+    case kTfLiteFloat32: {
+      TensorSpan<const float> out = output_span<float>();
+      count = std::min(out.size, capacity);
+      for (size_t i = 0; i < count; i++) scores[i] = out[i];
+      break;
+    }
+    case kTfLiteInt8: {
+      TensorSpan<const int8_t> out = output_span<int8_t>();
+      count = std::min(out.size, capacity);
+      for (size_t i = 0; i < count; i++)
+        scores[i] = scale * (out[i] - zero_point);
+      break;
+    }
+    case kTfLiteUInt8: {
+      TensorSpan<const uint8_t> out = output_span<uint8_t>();
+      count = std::min(out.size, capacity);
+      for (size_t i = 0; i < count; i++)
+        scores[i] = scale * (out[i] - zero_point);
+      break;
+    }
+    default:
+      std::cerr << "Cannot handle output type: " << output->type << std::endl;
+      break;
+  }
+  return count;
+}
+
+// Builds the interpreter for one backend, on failure everything is released
+// so the next backend starts from scratch
+bool NnModel::build(Backend backend, const NnModelOptions &options) {
+  interpreter_.reset();
+  delegate_.reset();
+
+  // Build the interpreter
+  // Resolver makes sure the operations in the model are available to the
+  // interpreter. The default resolver applies XNNPACK on its own, it is only
+  // kept for the external delegate so the ops it does not take still run on
+  // XNNPACK like before
+  if (backend == Backend::external) {
+    tflite::ops::builtin::BuiltinOpResolver resolver;
+    tflite::InterpreterBuilder(*model_, resolver)(&interpreter_);
+  } else {
+    tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+    tflite::InterpreterBuilder(*model_, resolver)(&interpreter_);
+  }
+  if (interpreter_ == nullptr) {
+    std::cerr << "Failed to build interpreter" << std::endl;
+    return false;
+  }
+  if (options.num_threads > 0 &&
+      interpreter_->SetNumThreads(options.num_threads) != kTfLiteOk) {
+    std::cerr << "Failed to set " << options.num_threads << " threads"
+              << std::endl;
+  }
+
+  // Setup delegate if required
+  if (backend == Backend::external) {
+    if (options.delegate_path == nullptr) {
+      std::cerr << "External backend requires a delegate path" << std::endl;
+      interpreter_.reset();
+      return false;
+    }
+    // Create external delegate option and pass the delegate library
+    TfLiteExternalDelegateOptions external_delegate_options =
+        TfLiteExternalDelegateOptionsDefault(options.delegate_path);
+    // Create the External Delegate. This will load the delegate.
+    delegate_ = DelegatePtr(
+        TfLiteExternalDelegateCreate(&external_delegate_options),
+        TfLiteExternalDelegateDelete);
+  } else if (backend == Backend::xnnpack) {
+    TfLiteXNNPackDelegateOptions xnnpack_options =
+        TfLiteXNNPackDelegateOptionsDefault();
+    int threads = options.xnnpack_threads > 0 ? options.xnnpack_threads
+                                              : options.num_threads;
+    if (threads > 0) xnnpack_options.num_threads = threads;
+    if (options.xnnpack_fp16)
+      xnnpack_options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_FORCE_FP16;
+    if (options.xnnpack_weight_cache != nullptr)
+      xnnpack_options.weight_cache_file_path = options.xnnpack_weight_cache;
+    delegate_ = DelegatePtr(TfLiteXNNPackDelegateCreate(&xnnpack_options),
+                            TfLiteXNNPackDelegateDelete);
+  }
+
+  // Add the delegate into TFLite Interpreter to automatically delegate nodes.
+  if (backend != Backend::builtin) {
+    if (delegate_ == nullptr ||
+        interpreter_->ModifyGraphWithDelegate(delegate_.get()) != kTfLiteOk) {
+      std::cerr << "Failed to add delegate" << std::endl;
+      interpreter_.reset();
+      delegate_.reset();
+      return false;
+    }
+  }
+
+  // Allocate tensors for the model
+  if (interpreter_->AllocateTensors() != kTfLiteOk) {
+    std::cerr << "Failed to allocate tensors" << std::endl;
+    interpreter_.reset();
+    delegate_.reset();
+    return false;
+  }
+  return true;
+}
+
+// Builds the model on every backend of the chain on its own and measures the
+// setup, the first invoke and the steady state invoke
+void NnModel::probe_backends(std::shared_ptr<tflite::FlatBufferModel> model,
+                             const NnModelOptions &options, int invokes) {
+  const std::vector<Backend> backends = backend_chain(options);
+  using Clock = std::chrono::steady_clock;
+  auto ms = [](Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+  };
+  for (Backend backend : backends) {
+    NnModelOptions single = options;
+    single.backends = {backend};
+    single.verbose = false;
+    try {
+      auto start = Clock::now();
+      NnModel nn(model, single);
+      auto built = Clock::now();
+      if (!nn.invoke()) continue;
+      auto first = Clock::now();
+      for (int i = 0; i < invokes; i++) nn.invoke();
+      auto end = Clock::now();
+      std::cout << "Probe " << backend_name(backend) << ": setup "
+                << ms(built - start) << " ms, first invoke "
+                << ms(first - built) << " ms, invoke "
+                << ms(end - first) / std::max(invokes, 1) << " ms"
+                << std::endl;
+    } catch (const std::exception &e) {
+      std::cout << "Probe " << backend_name(backend) << ": unavailable"
+                << std::endl;
+    }
+  }
+}
+
+// Changes the first dimension of the input and lets TFLite propagate the new
+// shape through the graph, if it fails the exported shape is restored
+bool NnModel::set_batch_size(int batch) {
+  if (batch == batch_size_) return true;
+  if (input_dims_.empty() || batch < 1) return false;
+
+  std::vector<int> dims = input_dims_;
+  dims[0] = batch;
+  int input_index = interpreter_->inputs()[0];
+  if (interpreter_->ResizeInputTensor(input_index, dims) == kTfLiteOk &&
+      interpreter_->AllocateTensors() == kTfLiteOk &&
+      interpreter_->output_tensor(0)->dims->data[0] == batch) {
+    batch_size_ = batch;
+    if (verbose_) std::cout << "Batch size: " << batch << std::endl;
+    return true;
+  }
+
+  std::cerr << "Model cannot be resized to batch " << batch
+            << ", falling back to batch " << batch_size_ << std::endl;
+  dims[0] = batch_size_;
+  if (interpreter_->ResizeInputTensor(input_index, dims) != kTfLiteOk ||
+      interpreter_->AllocateTensors() != kTfLiteOk) {
+    throw std::runtime_error("Unable to restore the input shape");
+  }
+  return false;
+}
+
+void *NnModel::input_row_data(int index) {
+  TfLiteTensor *tensor = interpreter_->input_tensor(0);
+  return tensor->data.raw + index * (tensor->bytes / batch_size_);
+}
+
+// Invoke TFLite model
+bool NnModel::invoke() {
+  if (verbose_) std::cout << "Invoking model" << std::endl;
+  const bool profile_ops = profiler_ && trace_enabled();
+  const int64_t start_ns = profile_ops ? trace_now_ns() : 0;
+  if (profile_ops) profiler_->StartProfiling();
+  TfLiteStatus status;
+  {
+    TRACE_SCOPE("invoke");
+    status = interpreter_->Invoke();
+  }
+  if (profile_ops) {
+    profiler_->StopProfiling();
+    trace_ops(start_ns);
+  }
+  if (status != kTfLiteOk) {
+    std::cerr << "Failed to invoke Interpreter!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// The profiler has its own clock, only the offsets between its events are
+// used and the first one is aligned with the start of the invoke
+void NnModel::trace_ops(int64_t invoke_start_ns) {
+  std::vector<const tflite::profiling::ProfileEvent *> events =
+      profiler_->GetProfileEvents();
+  uint64_t first_us = UINT64_MAX;
+  for (const auto *event : events)
+    first_us = std::min<uint64_t>(first_us, event->begin_timestamp_us);
+  for (const auto *event : events) {
+    trace_record(op_trace_name(*event),
+                 invoke_start_ns +
+                     int64_t(event->begin_timestamp_us - first_us) * 1000,
+                 int64_t(event->elapsed_time) * 1000);
+  }
+  profiler_->Reset();
+}
+
+// The op index is in the event metadata, its tag is compared with the cached
+// name in case another subgraph has an op at the same index
+const char *NnModel::op_trace_name(
+    const tflite::profiling::ProfileEvent &event) {
+  constexpr char kPrefix[] = "op:";
+  const size_t index = event.event_metadata;
+  const bool cacheable = index < op_trace_names_.size();
+  if (cacheable) {
+    const char *cached = op_trace_names_[index];
+    if (cached && event.tag == cached + sizeof(kPrefix) - 1) return cached;
+  }
+  const char *name = trace_intern(kPrefix + event.tag);
+  if (cacheable) op_trace_names_[index] = name;
+  return name;
+}
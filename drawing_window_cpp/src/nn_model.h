@@ -7,9 +7,63 @@
 // performs inference
 #pragma once
 
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <vector>
 
+#include "input_adapter.h"
+#include "mapped_file.h"
 #include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/model_builder.h"
+#include "tensorflow/lite/profiling/buffered_profiler.h"
+#include "tracing.h"
+
+// Non-owning view over the data of a tensor, valid until the tensors are
+// re-allocated
+template <typename T>
+struct TensorSpan {
+  T *data = nullptr;
+  size_t size = 0;
+
+  T *begin() const { return data; }
+  T *end() const { return data + size; }
+  T &operator[](size_t i) const { return data[i]; }
+  bool empty() const { return size == 0; }
+};
+
+// One of the best classes of a prediction
+struct ClassScore {
+  int index = -1;
+  float probability = 0.0f;
+};
+
+// Where the model runs
+enum class Backend {
+  external,  // External delegate library, e.g. Ethos-U
+  xnnpack,   // XNNPACK delegate created with the options below
+  builtin    // TFLite reference kernels only
+};
+const char *backend_name(Backend backend);
+// Parses a comma separated list of backends, e.g. "ethos,xnnpack,builtin"
+bool parse_backends(const char *list, std::vector<Backend> &backends);
+
+// Options used to build the interpreter
+struct NnModelOptions {
+  const char *delegate_path = nullptr;  // Library for the external backend
+  // Backends tried in order until one works, empty uses the default chain
+  // external (if delegate_path is set) -> xnnpack -> builtin
+  std::vector<Backend> backends;
+  int num_threads = -1;      // Interpreter threads, -1 keeps the default
+  int xnnpack_threads = -1;  // XNNPACK threads, -1 uses num_threads
+  bool xnnpack_fp16 = false;  // Force fp16 inference on XNNPACK
+  const char *xnnpack_weight_cache = nullptr;  // Weight cache file for XNNPACK
+  // Records the time of every op with the TFLite profiler, the ops are only
+  // traced while tracing is enabled
+  bool op_profiling = false;
+  MapOptions map;  // How load_model maps the model file
+  bool verbose = false;
+};
 
 // NnModel used to initialize the TFlite model and delegate
 // it also performs the inference
@@ -20,9 +74,51 @@ class NnModel {
   /// model provided by model_path and uses the delegate if any is passed
   /// The verbose flag can be useful in debugging since it prints more details
   NnModel(const char *model_path, const char *delegate_path, bool verbose);
+  /// Same as above but builds the interpreter on a model that is already
+  /// loaded, several NnModel instances can share the same model
+  NnModel(std::shared_ptr<tflite::FlatBufferModel> model,
+          const char *delegate_path, bool verbose);
+
+  /// Same as above with all the interpreter options
+  NnModel(std::shared_ptr<tflite::FlatBufferModel> model,
+          const NnModelOptions &options);
+
+  /// Builds the model on each backend of options on its own and prints the
+  /// setup time, the first invoke and the mean of invokes invokes
+  static void probe_backends(std::shared_ptr<tflite::FlatBufferModel> model,
+                             const NnModelOptions &options, int invokes);
+
+  /// Loads a tflite model so it can be shared between NnModel instances
+  /// throws if the model cannot be loaded. The file is memory mapped
+  /// read-only and the mapping lives as long as the returned model, so
+  /// several interpreters and processes share the same physical pages
+  static std::shared_ptr<tflite::FlatBufferModel> load_model(
+      const char *model_path, const MapOptions &options = {});
+
+  // Model shared by this instance, used to build more interpreters on it
+  std::shared_ptr<tflite::FlatBufferModel> model() const { return model_; }
+
+  // Backend the interpreter ended up on
+  Backend backend() const { return backend_; }
 
   // Method used to get the data type required by the model
   TfLiteType get_dtype() { return interpreter_->input_tensor(0)->type; };
+  // Method used to get the data type of the model scores
+  TfLiteType get_output_dtype() {
+    return interpreter_->output_tensor(0)->type;
+  };
+  // Quantization parameters of the input and output tensors
+  QuantParams input_quant() const { return input_quant_; }
+  QuantParams output_quant() const { return output_quant_; }
+
+  /// Size, layout, type and quantization of one image of the input, read
+  /// once from the input tensor. Not supported if the input is not an image
+  /// or of a type the preprocessing cannot write
+  const InputSpec &input_spec() const { return input_spec_; }
+
+  /// Writes the output scores as real values into scores, dequantizing them
+  /// for int8_t and uint8_t models. Returns the number of scores written
+  size_t dequantize_output(float *scores, size_t capacity);
 
   /// Method used to call the inference on the model
   /// It can be used for float, int8_t or uint8_t type depending on the model
@@ -30,33 +126,120 @@ class NnModel {
   template <typename T>
   std::vector<T> infer(const std::vector<T> &input);
 
+  /// Fused post-processing, writes the k best classes of one row of the batch
+  /// into top, best first, with their probabilities. Read straight from the
+  /// output tensor and dequantized on the fly for int8_t and uint8_t, nothing
+  /// is allocated. Scores that already are a distribution, like the output
+  /// of a softmax, are kept and logits, like the PyTorch export, go through
+  /// a softmax. Returns the number of classes written
+  size_t top_k(int row, ClassScore *top, size_t k);
+
+  /// Zero-copy API, the caller writes the input straight into the input
+  /// tensor, calls invoke() and reads the scores from the output tensor.
+  /// Nothing is allocated per inference.
+  template <typename T>
+  TensorSpan<T> input_span();
+  template <typename T>
+  TensorSpan<const T> output_span();
+  // Runs the model on the current content of the input tensor
+  bool invoke();
+
+  /// Batched inference, resizes the batch dimension of the input tensor and
+  /// re-allocates the tensors. Returns false and keeps the current batch size
+  /// if the model or the delegate cannot be resized, callers then fall back
+  /// to one image per invoke. Spans taken before are invalidated
+  bool set_batch_size(int batch);
+  int batch_size() const { return batch_size_; }
+  // Input and output of one image of the batch
+  template <typename T>
+  TensorSpan<T> input_row(int index);
+  template <typename T>
+  TensorSpan<const T> output_row(int index);
+  // Start of one image of the batch in the input tensor, whatever its type
+  void *input_row_data(int index);
+
  private:
+  // Builds interpreter_ for backend, returns false if it cannot run the model
+  bool build(Backend backend, const NnModelOptions &options);
+  // Moves the op events of the last invoke into the trace, placed relative to
+  // the start of the invoke
+  void trace_ops(int64_t invoke_start_ns);
+  // Interned trace name of an op event, looked up in op_trace_names_ so the
+  // names are only interned on the first invoke
+  const char *op_trace_name(const tflite::profiling::ProfileEvent &event);
+  template <typename T>
+  size_t top_k_typed(int row, ClassScore *top, size_t k);
+
+  // Model the interpreter was built from, it must outlive the interpreter
+  std::shared_ptr<tflite::FlatBufferModel> model_;
+  // Delegate applied to the interpreter, it must outlive the interpreter
+  using DelegatePtr =
+      std::unique_ptr<TfLiteDelegate, void (*)(TfLiteDelegate *)>;
+  DelegatePtr delegate_{nullptr, [](TfLiteDelegate *) {}};
+  // Op profiler attached to the interpreter, it must outlive the interpreter
+  std::unique_ptr<tflite::profiling::BufferedProfiler> profiler_;
+  // Trace name of every op by index, filled as the ops are first traced
+  std::vector<const char *> op_trace_names_;
   // TFlite interpreter
   std::unique_ptr<tflite::Interpreter> interpreter_;
+  Backend backend_ = Backend::builtin;
   // Verbosity flag
   bool verbose_;
+  // Quantization of the first input and output
+  QuantParams input_quant_;
+  QuantParams output_quant_;
+  // Shape of the input as exported, the first dimension is the batch
+  std::vector<int> input_dims_;
+  int batch_size_ = 1;
+  InputSpec input_spec_;
 };
 
+template <typename T>
+TensorSpan<T> NnModel::input_span() {
+  TfLiteTensor *tensor = interpreter_->input_tensor(0);
+  return {interpreter_->typed_input_tensor<T>(0), tensor->bytes / sizeof(T)};
+}
+
+template <typename T>
+TensorSpan<const T> NnModel::output_span() {
+  const TfLiteTensor *tensor = interpreter_->output_tensor(0);
+  return {interpreter_->typed_output_tensor<T>(0), tensor->bytes / sizeof(T)};
+}
+
+template <typename T>
+TensorSpan<T> NnModel::input_row(int index) {
+  TensorSpan<T> input = input_span<T>();
+  size_t row = input.size / batch_size_;
+  return {input.data + index * row, row};
+}
+
+template <typename T>
+TensorSpan<const T> NnModel::output_row(int index) {
+  TensorSpan<const T> output = output_span<T>();
+  size_t row = output.size / batch_size_;
+  return {output.data + index * row, row};
+}
+
 template <typename T>
 std::vector<T> NnModel::infer(const std::vector<T> &input) {
   // Fill input buffer
   if (verbose_) std::cout << "Filling input buffer" << std::endl;
-  T *input_tensor = interpreter_->typed_input_tensor<T>(0);
-  std::memcpy(input_tensor, input.data(), input.size() * sizeof(T));
-
-  // Invoke TFLite model
-  if (verbose_) std::cout << "Invoking model" << std::endl;
-  if (interpreter_->Invoke() != kTfLiteOk) {
-    std::cerr << "Failed to invoke Interpreter!" << std::endl;
-    return {};
+  {
+    TRACE_SCOPE("fill");
+    TensorSpan<T> input_tensor = input_span<T>();
+    std::memcpy(input_tensor.data, input.data(), input.size() * sizeof(T));
   }
 
+  if (!invoke()) return {};
+
   // Get results
   if (verbose_) std::cout << "Get results!" << std::endl;
-  auto tensor_size_bytes = interpreter_->output_tensor(0)->bytes;
-  T *output_tensor = interpreter_->typed_output_tensor<T>(0);
-  size_t element_count = tensor_size_bytes / sizeof(T);
-  std::vector<T> output_vec(output_tensor, output_tensor + element_count);
+  std::vector<T> output_vec;
+  {
+    TRACE_SCOPE("readback");
+    TensorSpan<const T> output_tensor = output_span<T>();
+    output_vec.assign(output_tensor.begin(), output_tensor.end());
+  }
 
   if (verbose_) {
     for (size_t i = 0; i < output_vec.size(); i++) {
@@ -0,0 +1,89 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of NnModelPool
+#include "nn_model_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <iostream>
+
+NnModelPool::NnModelPool(const char *model_path,
+                         const NnModelOptions &options, int workers,
+                         Preprocessing preprocessing)
+    : NnModelPool(NnModel::load_model(model_path, options.map), options,
+                  workers, preprocessing) {}
+
+// The interpreters are built up front so a failing delegate is reported here
+// and not from a worker thread
+NnModelPool::NnModelPool(std::shared_ptr<tflite::FlatBufferModel> model,
+                         const NnModelOptions &options, int workers,
+                         Preprocessing preprocessing)
+    : preprocessing_(preprocessing) {
+  NnModelOptions worker_options = options;
+  if (worker_options.num_threads < 0) worker_options.num_threads = 1;
+  workers = std::max(workers, 1);
+  for (int i = 0; i < workers; i++) {
+    models_.push_back(std::make_unique<NnModel>(model, worker_options));
+    // The first worker walks the backend chain, the others take the backend
+    // it ended up on instead of trying and reporting every one again
+    worker_options.backends = {models_.front()->backend()};
+  }
+  for (int i = 0; i < workers; i++) {
+    threads_.emplace_back(&NnModelPool::run, this, i);
+  }
+}
+
+NnModelPool::~NnModelPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto &thread : threads_) thread.join();
+}
+
+std::future<int> NnModelPool::submit(const ImageView &image) {
+  std::promise<int> result;
+  std::future<int> future = result.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back({image, std::move(result)});
+  }
+  cv_.notify_one();
+  return future;
+}
+
+void NnModelPool::run(int index) {
+  // Pin the worker to its own core, best effort
+  unsigned int cores = std::thread::hardware_concurrency();
+  if (cores > 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(index % cores, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+      std::cerr << "Failed to pin pool worker " << index << std::endl;
+    }
+  }
+
+  Predictor predictor(*models_[index], preprocessing_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+    // Drain the queue before stopping so no future is left without a value
+    if (requests_.empty()) break;
+
+    Request request = std::move(requests_.front());
+    requests_.pop_front();
+    lock.unlock();
+
+    const ImageView &image = request.image;
+    request.result.set_value(predictor.predict(image.argb, image.width,
+                                               image.height, image.stride));
+    lock.lock();
+  }
+}
@@ -0,0 +1,65 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of NnModelPool, several interpreters sharing one model to run
+// inferences in parallel.
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "nn_model.h"
+#include "predictor.h"
+
+// NnModelPool loads the model once and builds one interpreter per worker
+// thread on top of it. Requests go through a single multi-producer
+// multi-consumer queue and whichever worker is free picks the next one.
+// Workers are pinned to a core each so the interpreters do not migrate.
+class NnModelPool {
+ public:
+  /// NnModelPool Ctor
+  /// Creates workers interpreters for the model in model_path, each one with
+  /// its own delegate instance. Unless options sets the number of threads
+  /// every interpreter runs on a single thread, the parallelism comes from
+  /// the workers. Every worker turns the images into the model input with
+  /// preprocessing
+  NnModelPool(const char *model_path, const NnModelOptions &options,
+              int workers,
+              Preprocessing preprocessing = Preprocessing::downscale);
+  /// Same as above with a model that is already loaded
+  NnModelPool(std::shared_ptr<tflite::FlatBufferModel> model,
+              const NnModelOptions &options, int workers,
+              Preprocessing preprocessing = Preprocessing::downscale);
+  // Stops the workers, pending requests are still served
+  ~NnModelPool();
+
+  /// Queues an image, the pixels must stay valid until the future is ready
+  /// The future holds the predicted digit or -1 on failure
+  std::future<int> submit(const ImageView &image);
+
+  int workers() const { return static_cast<int>(threads_.size()); }
+
+ private:
+  struct Request {
+    ImageView image;
+    std::promise<int> result;
+  };
+
+  // Worker loop, index selects the interpreter and the core
+  void run(int index);
+
+  Preprocessing preprocessing_;
+  std::vector<std::unique_ptr<NnModel>> models_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Request> requests_;
+  bool stop_ = false;
+};
@@ -0,0 +1,58 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of NumberReader
+#include "number_reader.h"
+
+#include <algorithm>
+
+#include "tracing.h"
+
+// The preprocessing of the predictor is not used, the digits are always
+// normalized
+NumberReader::NumberReader(NnModel &nn, size_t max_digits)
+    : nn_(nn),
+      predictor_(nn, Preprocessing::mnist),
+      max_digits_(std::clamp<size_t>(max_digits, 1, kMaxDigits)) {
+  nn_.set_batch_size(static_cast<int>(max_digits_));
+}
+
+// A number shorter than the batch still runs the whole batch, resizing the
+// tensors for every number would cost more than the unused rows
+bool NumberReader::read(const uint8_t *argb, int width, int height,
+                        int stride, std::vector<int> &digits) {
+  TRACE_SCOPE("read_number");
+  digits.clear();
+  const size_t count = segmenter_.run(argb, width, height, stride);
+  if (count == 0 || count > max_digits_) return false;
+
+  const size_t batch = nn_.batch_size();
+  digits.resize(count);
+  for (size_t first = 0; first < count; first += batch) {
+    const size_t rows = std::min(batch, count - first);
+    for (size_t row = 0; row < rows; row++) {
+      const DigitBox &box = segmenter_.digits()[first + row];
+      const int box_width = box.x1 - box.x0;
+      if (!predictor_.preprocess_digit(segmenter_.crop(first + row),
+                                       box_width, box.y1 - box.y0,
+                                       box_width, static_cast<int>(row))) {
+        return false;
+      }
+    }
+    if (!nn_.invoke()) return false;
+    for (size_t row = 0; row < rows; row++) {
+      digits[first + row] = predictor_.result(static_cast<int>(row));
+      if (digits[first + row] < 0) return false;
+    }
+  }
+  return true;
+}
+
+int number_value(const std::vector<int> &digits) {
+  if (digits.empty()) return -1;
+  int value = 0;
+  for (int digit : digits) value = value * 10 + digit;
+  return value;
+}
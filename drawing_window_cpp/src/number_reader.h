@@ -0,0 +1,50 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of NumberReader, reads a number of several digits drawn on a
+// wide canvas.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "digit_segmenter.h"
+#include "nn_model.h"
+#include "predictor.h"
+
+// NumberReader splits the drawing into digits with a DigitSegmenter, writes
+// every digit normalized like MNIST into its own row of the input tensor and
+// predicts all of them with a single invoke. The batch of the model is
+// resized once to max_digits, a model that cannot be resized reads the
+// digits one invoke at a time.
+// Not thread safe, use one per thread.
+class NumberReader {
+ public:
+  // Longest number whose value fits in an int
+  static constexpr size_t kMaxDigits = 9;
+
+  // max_digits is clamped to 1..kMaxDigits
+  NumberReader(NnModel &nn, size_t max_digits);
+
+  /// Predicts the digits of the ARGB32 image into digits, left to right.
+  /// Returns false if nothing is drawn, there are more than max_digits
+  /// digits or the inference failed
+  bool read(const uint8_t *argb, int width, int height, int stride,
+            std::vector<int> &digits);
+
+  size_t max_digits() const { return max_digits_; }
+  const DigitSegmenter &segmenter() const { return segmenter_; }
+
+ private:
+  NnModel &nn_;
+  Predictor predictor_;
+  DigitSegmenter segmenter_;
+  size_t max_digits_;
+};
+
+/// Value of the digits read as a decimal number, -1 if there are none. Fits
+/// in an int up to kMaxDigits digits
+int number_value(const std::vector<int> &digits);
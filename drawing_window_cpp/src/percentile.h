@@ -0,0 +1,13 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Percentile of a set of measurements, shared by the benchmarks and the load
+// generator, which builds without TFLite.
+#pragma once
+
+#include <vector>
+
+// Nearest rank percentile of a sorted vector, p from 0 to 100
+double percentile(const std::vector<double> &sorted, double p);
@@ -0,0 +1,124 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of Predictor
+#include "predictor.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "startup_timing.h"
+#include "tracing.h"
+
+Predictor::Predictor(NnModel &nn, Preprocessing preprocessing)
+    : nn_(nn), adapter_(nn.input_spec(), preprocessing) {}
+
+// The kernel for the type, layout and size of the input was picked when the
+// adapter was built, there is no dispatch left here
+bool Predictor::preprocess(const uint8_t *argb, int width, int height,
+                           int stride, int row) {
+  TRACE_SCOPE("preprocess");
+  if (!adapter_.valid()) return false;
+  adapter_.write_image(argb, width, height, stride, nn_.input_row_data(row));
+  return true;
+}
+
+bool Predictor::preprocess_gray(const uint8_t *gray, int width, int height,
+                                int stride, int row) {
+  TRACE_SCOPE("preprocess_gray");
+  if (!adapter_.valid()) return false;
+  adapter_.write_gray(gray, width, height, stride, nn_.input_row_data(row));
+  return true;
+}
+
+bool Predictor::preprocess_digit(const uint8_t *gray, int width, int height,
+                                 int stride, int row) {
+  TRACE_SCOPE("preprocess_digit");
+  if (!adapter_.valid()) return false;
+  adapter_.write_digit(gray, width, height, stride, nn_.input_row_data(row));
+  return true;
+}
+
+bool Predictor::preprocess(const VectorCanvas &canvas, int row) {
+  TRACE_SCOPE("preprocess_vector");
+  if (!adapter_.valid()) return false;
+  adapter_.write_vector(canvas, nn_.input_row_data(row));
+  return true;
+}
+
+// Helper function used to get the index of the maximum value in the output
+// tensor without copying it. The output scale is positive so the argmax of
+// the quantized scores is the same as the one of the dequantized scores
+template <typename T>
+int Predictor::get_max_index(int row) {
+  TensorSpan<const T> scores = nn_.output_row<T>(row);
+  if (scores.empty()) return -1;
+  auto max_iter = std::max_element(scores.begin(), scores.end());
+  return std::distance(scores.begin(), max_iter);
+}
+
+int Predictor::infer() {
+  if (!nn_.invoke()) return -1;
+  return result(0);
+}
+
+int Predictor::infer(ClassScore *top, size_t k) {
+  if (!nn_.invoke()) return -1;
+  TRACE_SCOPE("readback");
+  return nn_.top_k(0, top, k) > 0 ? top[0].index : -1;
+}
+
+int Predictor::result(int row) {
+  TRACE_SCOPE("readback");
+  switch (nn_.get_output_dtype()) {
+    case kTfLiteFloat32:
+      return get_max_index<float>(row);
+    case kTfLiteInt8:
+      return get_max_index<int8_t>(row);
+    case kTfLiteUInt8:
+      return get_max_index<uint8_t>(row);
+    default:
+      return -1;
+  }
+}
+
+// Fills as many rows of the batch as there are images left, a partial last
+// batch still runs the full batch but only its first rows are read
+size_t Predictor::predict_batch(const ImageView *images, size_t count,
+                                int *digits) {
+  const size_t batch = nn_.batch_size();
+  size_t failed = 0;
+  for (size_t first = 0; first < count; first += batch) {
+    size_t rows = std::min(batch, count - first);
+    bool ok = true;
+    for (size_t row = 0; row < rows && ok; row++) {
+      const ImageView &image = images[first + row];
+      ok = preprocess(image.argb, image.width, image.height, image.stride,
+                      row);
+    }
+    ok = ok && nn_.invoke();
+    for (size_t row = 0; row < rows; row++) {
+      digits[first + row] = ok ? result(row) : -1;
+      if (digits[first + row] < 0) failed++;
+    }
+  }
+  return failed;
+}
+
+std::shared_ptr<NnModel> load_warm_model(const char *path,
+                                         const NnModelOptions &options,
+                                         Preprocessing preprocessing,
+                                         bool startup) {
+  auto loaded = NnModel::load_model(path, options.map);
+  if (startup) startup_mark("model loaded");
+  auto nn = std::make_shared<NnModel>(loaded, options);
+  if (startup) startup_mark("interpreter ready");
+  Predictor warmup(*nn, preprocessing);
+  std::vector<uint8_t> black(28 * 28 * 4, 0);
+  warmup.predict(black.data(), 28, 28, 28 * 4);
+  if (startup) startup_mark("warmup invoke done");
+  return nn;
+}
@@ -0,0 +1,100 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of Predictor, the path from an ARGB32 image to a digit shared by
+// the window and the headless modes.
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "input_adapter.h"
+#include "nn_model.h"
+#include "strokes.h"
+
+// ARGB32 image owned by the caller
+struct ImageView {
+  const uint8_t *argb;
+  int width;
+  int height;
+  int stride;
+};
+
+// Predictor preprocesses an image straight into the input tensor of the model
+// and takes the argmax over the output tensor, nothing is copied or allocated
+// once the sizes are known. The input is written by an InputAdapter built for
+// the input of the model, so any size, layout and type it supports works.
+// Not thread safe, use one per thread.
+class Predictor {
+ public:
+  explicit Predictor(NnModel &nn,
+                     Preprocessing preprocessing = Preprocessing::downscale);
+
+  /// Downscales, or normalizes with Preprocessing::mnist, and quantizes the
+  /// ARGB32 image into the input tensor, row
+  /// selects the image of the batch. Returns false if the model input is
+  /// not supported
+  bool preprocess(const uint8_t *argb, int width, int height, int stride,
+                  int row = 0);
+  /// Runs the model on the input tensor and returns the predicted digit
+  /// or -1 on failure
+  int infer();
+  /// Same and also writes the k best classes with their probabilities into
+  /// top, see NnModel::top_k
+  int infer(ClassScore *top, size_t k);
+  // Both of the above
+  int predict(const uint8_t *argb, int width, int height, int stride) {
+    return preprocess(argb, width, height, stride) ? infer() : -1;
+  }
+  /// Rasterizes the strokes straight into the input tensor at the model
+  /// resolution, the full size canvas is never rendered
+  bool preprocess(const VectorCanvas &canvas, int row = 0);
+  int predict(const VectorCanvas &canvas) {
+    return preprocess(canvas) ? infer() : -1;
+  }
+  /// Maps a one byte per pixel gray image, 0 the background and 255 the ink,
+  /// into the input tensor. Images of the input size only go through the
+  /// quantization table, other sizes are downscaled, whatever the
+  /// preprocessing
+  bool preprocess_gray(const uint8_t *gray, int width, int height, int stride,
+                       int row = 0);
+  /// Normalizes the gray image of one digit cut out of a wider drawing into
+  /// the input tensor, see InputAdapter::write_digit
+  bool preprocess_digit(const uint8_t *gray, int width, int height,
+                        int stride, int row = 0);
+  // Predicted digit of one row of the batch after invoke
+  int result(int row);
+
+  // One image of the input tensor, kept by callers that reuse the output of
+  // preprocess, and its size in bytes, 0 if the input is not supported
+  void *input_data(int row = 0) { return nn_.input_row_data(row); }
+  size_t input_bytes() const {
+    return adapter_.valid() ? adapter_.bytes() : 0;
+  }
+  const InputSpec &input_spec() const { return adapter_.spec(); }
+
+  /// Predicts count images into digits, filling the whole batch of the model
+  /// on every invoke. With a batch size of 1 this loops over the images.
+  /// Returns the number of failed predictions
+  size_t predict_batch(const ImageView *images, size_t count, int *digits);
+
+ private:
+  template <typename T>
+  int get_max_index(int row);
+
+  // Reference to TFlite Neural Network Model
+  NnModel &nn_;
+  // Kernels picked once for the input of the model
+  InputAdapter adapter_;
+};
+
+/// Loads the model at path, builds its interpreter and runs a first invoke
+/// with the given preprocessing, the first invoke is much slower than the
+/// rest. startup records each phase in the startup timing. Throws if the
+/// model cannot be loaded
+std::shared_ptr<NnModel> load_warm_model(const char *path,
+                                         const NnModelOptions &options,
+                                         Preprocessing preprocessing,
+                                         bool startup = false);
@@ -0,0 +1,352 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of the preprocessing kernels
+#include "preprocessing.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Luminance weights in Q8, they add up to 256 so gray stays gray
+static constexpr uint32_t kLumR = 54;
+static constexpr uint32_t kLumG = 183;
+static constexpr uint32_t kLumB = 19;
+// Filter weights are in Q12, two passes leave the result in Q24
+static constexpr int kWeightBits = 12;
+
+// Cairo ARGB32 is stored as BGRA in memory on little-endian systems
+static inline uint8_t luminance(const uint8_t *pixel) {
+  return static_cast<uint8_t>(
+      (kLumR * pixel[2] + kLumG * pixel[1] + kLumB * pixel[0] + 128) >> 8);
+}
+
+void argb_to_luminance(const uint8_t *argb, uint8_t *dst, int n) {
+  int i = 0;
+#if defined(__ARM_NEON)
+  const uint8x8_t wr = vdup_n_u8(kLumR);
+  const uint8x8_t wg = vdup_n_u8(kLumG);
+  const uint8x8_t wb = vdup_n_u8(kLumB);
+  for (; i + 16 <= n; i += 16) {
+    // De-interleaves 16 pixels into B, G, R and A planes
+    uint8x16x4_t px = vld4q_u8(argb + i * 4);
+    uint16x8_t lo = vmull_u8(vget_low_u8(px.val[2]), wr);
+    lo = vmlal_u8(lo, vget_low_u8(px.val[1]), wg);
+    lo = vmlal_u8(lo, vget_low_u8(px.val[0]), wb);
+    uint16x8_t hi = vmull_u8(vget_high_u8(px.val[2]), wr);
+    hi = vmlal_u8(hi, vget_high_u8(px.val[1]), wg);
+    hi = vmlal_u8(hi, vget_high_u8(px.val[0]), wb);
+    vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weights = _mm_setr_epi16(kLumB, kLumG, kLumR, 0, kLumB, kLumG,
+                                         kLumR, 0);
+  const __m128i round = _mm_set1_epi32(128);
+  // Returns the luminance in Q8 of 4 pixels as 32 bit lanes
+  auto lum4 = [&](const uint8_t *src) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    // [B*wb + G*wg, R*wr] pairs for each pixel
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights);
+    // Adds the pairs, lanes 0 and 2 hold the result
+    lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+    hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+    lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+    hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+    __m128i sum = _mm_unpacklo_epi64(lo, hi);
+    return _mm_srli_epi32(_mm_add_epi32(sum, round), 8);
+  };
+  for (; i + 16 <= n; i += 16) {
+    const uint8_t *src = argb + i * 4;
+    __m128i a = _mm_packs_epi32(lum4(src), lum4(src + 16));
+    __m128i b = _mm_packs_epi32(lum4(src + 32), lum4(src + 48));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     _mm_packus_epi16(a, b));
+  }
+#endif
+  // Scalar fallback and tail
+  for (; i < n; i++) dst[i] = luminance(argb + i * 4);
+}
+
+GrayDownscaler::GrayDownscaler(int in_w, int in_h, int out_w, int out_h) {
+  configure(in_w, in_h, out_w, out_h);
+}
+
+// Computes for every output index the source indices it covers and how much
+// of each one is covered, the taps are written in output order. Outputs that
+// cover no source pixel get a zero weight tap so every output is written.
+// taps keeps its capacity, so mappings that change on every image, like the
+// crop of DigitNormalizer, do not allocate once warm
+void GrayDownscaler::make_taps(const AxisMapping &axis, int out,
+                               std::vector<Tap> &taps) {
+  taps.clear();
+  const uint32_t one = 1u << kWeightBits;
+  for (int o = 0; o < out; o++) {
+    double begin = axis.origin + o * axis.ratio;
+    double end = begin + axis.ratio;
+    size_t first = taps.size();
+    uint32_t total = 0;
+    int i = std::max(static_cast<int>(std::floor(begin)), axis.lo);
+    for (; i < std::min<double>(end, axis.hi); i++) {
+      double overlap = std::min<double>(i + 1, end) - std::max<double>(i, begin);
+      uint32_t weight =
+          static_cast<uint32_t>(std::lround(overlap / axis.ratio * one));
+      if (weight == 0) continue;
+      taps.push_back({static_cast<uint16_t>(i), static_cast<uint16_t>(o),
+                      weight});
+      total += weight;
+    }
+    if (taps.size() == first) {
+      int nearest = std::clamp(static_cast<int>(std::floor(begin)), axis.lo,
+                               axis.hi - 1);
+      taps.push_back({static_cast<uint16_t>(nearest),
+                      static_cast<uint16_t>(o), 0});
+      continue;
+    }
+    // Rounding may leave the sum slightly off, fix it on the biggest tap so
+    // a flat input stays flat. Outputs partly outside the source are darker
+    // on purpose
+    constexpr double kEpsilon = 1e-9;
+    if (begin < axis.lo - kEpsilon || end > axis.hi + kEpsilon) continue;
+    auto biggest = std::max_element(
+        taps.begin() + first, taps.end(),
+        [](const Tap &a, const Tap &b) { return a.weight < b.weight; });
+    biggest->weight += one - total;
+  }
+}
+
+void GrayDownscaler::configure(int in_w, int in_h, int out_w, int out_h) {
+  if (!mapped_ && in_w == in_w_ && in_h == in_h_ && out_w == out_w_ &&
+      out_h == out_h_)
+    return;
+  configure(in_w, in_h, out_w, out_h,
+            {0.0, static_cast<double>(in_w) / out_w, 0, in_w},
+            {0.0, static_cast<double>(in_h) / out_h, 0, in_h});
+  mapped_ = false;
+}
+
+void GrayDownscaler::configure(int in_w, int in_h, int out_w, int out_h,
+                               const AxisMapping &x, const AxisMapping &y) {
+  in_w_ = in_w;
+  in_h_ = in_h;
+  out_w_ = out_w;
+  out_h_ = out_h;
+  mapped_ = true;
+  make_taps(x, out_w, x_taps_);
+  col_lo_ = x.lo;
+  col_hi_ = x.hi;
+  // Rows are visited in source order so each one is filtered only once. The
+  // destination breaks the ties, which keeps the output order of the taps
+  // without the buffer of a stable sort
+  make_taps(y, out_h, y_taps_);
+  std::sort(y_taps_.begin(), y_taps_.end(), [](const Tap &a, const Tap &b) {
+    return a.src != b.src ? a.src < b.src : a.dst < b.dst;
+  });
+  lum_row_.resize(in_w);
+  row_acc_.resize(in_w * out_h);
+}
+
+// Every source row is converted to luminance once and accumulated into the
+// output rows it contributes to, this pass runs over whole rows so the
+// compiler can vectorize it. Only the columns read by the x taps are done
+void GrayDownscaler::filter_rows(const uint8_t *src, int stride, bool gray) {
+  std::fill(row_acc_.begin(), row_acc_.end(), 0);
+  const int cols = col_hi_ - col_lo_;
+  int current_row = -1;
+  const uint8_t *lum = nullptr;
+  for (const Tap &y_tap : y_taps_) {
+    if (y_tap.src != current_row) {
+      current_row = y_tap.src;
+      if (gray) {
+        lum = src + current_row * stride + col_lo_;
+      } else {
+        argb_to_luminance(src + current_row * stride + col_lo_ * 4,
+                          lum_row_.data() + col_lo_, cols);
+        lum = lum_row_.data() + col_lo_;
+      }
+    }
+    uint32_t *acc_row = row_acc_.data() + y_tap.dst * in_w_ + col_lo_;
+    const uint32_t weight = y_tap.weight;
+    for (int x = 0; x < cols; x++) acc_row[x] += lum[x] * weight;
+  }
+}
+
+// The horizontal pass only runs on the few output rows, each gray value is
+// mapped through the lut as it is written
+template <typename T>
+void GrayDownscaler::filter_columns(T *out, const InputLut<T> &lut) {
+  // The x taps are grouped by output, accumulate each group in a register.
+  // 255 * 4096 * 4096 plus the rounding still fits in 32 bits
+  const uint32_t round = 1u << (2 * kWeightBits - 1);
+  for (int y = 0; y < out_h_; y++) {
+    const uint32_t *acc_row = row_acc_.data() + y * in_w_;
+    T *out_row = out + y * out_w_;
+    uint32_t sum = round;
+    uint16_t dst = x_taps_.front().dst;
+    for (const Tap &x_tap : x_taps_) {
+      if (x_tap.dst != dst) {
+        out_row[dst] = lut[sum >> (2 * kWeightBits)];
+        sum = round;
+        dst = x_tap.dst;
+      }
+      sum += acc_row[x_tap.src] * x_tap.weight;
+    }
+    out_row[dst] = lut[sum >> (2 * kWeightBits)];
+  }
+}
+
+template <typename T>
+void GrayDownscaler::run(const uint8_t *argb, int stride, T *out,
+                         const InputLut<T> &lut) {
+  filter_rows(argb, stride, false);
+  filter_columns(out, lut);
+}
+
+template <typename T>
+void GrayDownscaler::run_gray(const uint8_t *gray, int stride, T *out,
+                              const InputLut<T> &lut) {
+  filter_rows(gray, stride, true);
+  filter_columns(out, lut);
+}
+
+void GrayDownscaler::run(const uint8_t *argb, int stride, uint8_t *out) {
+  static const InputLut<uint8_t> identity = make_input_lut<uint8_t>(0.0f, 0);
+  run<uint8_t>(argb, stride, out, identity);
+}
+
+// The row sums are plain loops over the gray row so they vectorize, the
+// x moment of a row fits in 32 bits for widths up to 4096
+void DigitNormalizer::add_row(const uint8_t *row, int width, int y,
+                              Moments &moments) {
+  uint32_t row_mass = 0, row_moment = 0;
+  for (int x = 0; x < width; x++) {
+    row_mass += row[x];
+    row_moment += row[x] * static_cast<uint32_t>(x);
+  }
+  if (row_mass == 0) return;
+
+  InkStats &stats = moments.stats;
+  stats.mass += row_mass;
+  moments.x += row_moment;
+  moments.y += static_cast<uint64_t>(row_mass) * y;
+  stats.y0 = std::min(stats.y0, y);
+  stats.y1 = y + 1;
+  int first = 0, last = width;
+  while (row[first] == 0) first++;
+  while (row[last - 1] == 0) last--;
+  stats.x0 = std::min(stats.x0, first);
+  stats.x1 = std::max(stats.x1, last);
+}
+
+void DigitNormalizer::finish(const Moments &moments) {
+  stats_ = moments.stats;
+  if (stats_.mass) {
+    stats_.cx = static_cast<double>(moments.x) / stats_.mass + 0.5;
+    stats_.cy = static_cast<double>(moments.y) / stats_.mass + 0.5;
+  }
+}
+
+void DigitNormalizer::analyze(const uint8_t *argb, int width, int height,
+                              int stride) {
+  gray_.resize(static_cast<size_t>(width) * height);
+  Moments moments;
+  moments.stats.x0 = width;
+  moments.stats.y0 = height;
+  for (int y = 0; y < height; y++) {
+    uint8_t *row = gray_.data() + static_cast<size_t>(y) * width;
+    argb_to_luminance(argb + y * stride, row, width);
+    add_row(row, width, y, moments);
+  }
+  finish(moments);
+}
+
+// The scale comes from the longest side of the bounding box and the offset
+// from the center of mass, the crop keeps the filter on the bounding box
+template <typename T>
+void DigitNormalizer::resample(const uint8_t *gray, int width, int height,
+                               int stride, T *out, const InputLut<T> &lut,
+                               int out_w, int out_h) {
+  if (stats_.empty()) {
+    std::fill(out, out + out_w * out_h, lut[0]);
+    return;
+  }
+
+  int side = std::max(stats_.x1 - stats_.x0, stats_.y1 - stats_.y0);
+  double box = static_cast<double>(std::min(out_w, out_h)) * kBox / kSize;
+  double ratio = side / box;
+  downscaler_.configure(
+      width, height, out_w, out_h,
+      {stats_.cx - out_w / 2.0 * ratio, ratio, stats_.x0, stats_.x1},
+      {stats_.cy - out_h / 2.0 * ratio, ratio, stats_.y0, stats_.y1});
+  downscaler_.run_gray<T>(gray, stride, out, lut);
+}
+
+template <typename T>
+void DigitNormalizer::run(const uint8_t *argb, int width, int height,
+                          int stride, T *out, const InputLut<T> &lut,
+                          int out_w, int out_h) {
+  analyze(argb, width, height, stride);
+  resample<T>(gray_.data(), width, height, width, out, lut, out_w, out_h);
+}
+
+template <typename T>
+void DigitNormalizer::run_gray(const uint8_t *gray, int width, int height,
+                               int stride, T *out, const InputLut<T> &lut,
+                               int out_w, int out_h) {
+  Moments moments;
+  moments.stats.x0 = width;
+  moments.stats.y0 = height;
+  for (int y = 0; y < height; y++) {
+    add_row(gray + y * stride, width, y, moments);
+  }
+  finish(moments);
+  resample<T>(gray, width, height, stride, out, lut, out_w, out_h);
+}
+
+// Allows us to separate implementation in cpp
+template void GrayDownscaler::run(const uint8_t *argb, int stride, float *out,
+                                  const InputLut<float> &lut);
+template void GrayDownscaler::run(const uint8_t *argb, int stride,
+                                  int8_t *out, const InputLut<int8_t> &lut);
+template void GrayDownscaler::run(const uint8_t *argb, int stride,
+                                  uint8_t *out, const InputLut<uint8_t> &lut);
+template void GrayDownscaler::run_gray(const uint8_t *gray, int stride,
+                                       float *out, const InputLut<float> &lut);
+template void GrayDownscaler::run_gray(const uint8_t *gray, int stride,
+                                       int8_t *out,
+                                       const InputLut<int8_t> &lut);
+template void GrayDownscaler::run_gray(const uint8_t *gray, int stride,
+                                       uint8_t *out,
+                                       const InputLut<uint8_t> &lut);
+template void DigitNormalizer::run(const uint8_t *argb, int width, int height,
+                                   int stride, float *out,
+                                   const InputLut<float> &lut, int out_w,
+                                   int out_h);
+template void DigitNormalizer::run(const uint8_t *argb, int width, int height,
+                                   int stride, int8_t *out,
+                                   const InputLut<int8_t> &lut, int out_w,
+                                   int out_h);
+template void DigitNormalizer::run(const uint8_t *argb, int width, int height,
+                                   int stride, uint8_t *out,
+                                   const InputLut<uint8_t> &lut, int out_w,
+                                   int out_h);
+template void DigitNormalizer::run_gray(const uint8_t *gray, int width,
+                                        int height, int stride, float *out,
+                                        const InputLut<float> &lut, int out_w,
+                                        int out_h);
+template void DigitNormalizer::run_gray(const uint8_t *gray, int width,
+                                        int height, int stride, int8_t *out,
+                                        const InputLut<int8_t> &lut, int out_w,
+                                        int out_h);
+template void DigitNormalizer::run_gray(const uint8_t *gray, int width,
+                                        int height, int stride, uint8_t *out,
+                                        const InputLut<uint8_t> &lut,
+                                        int out_w, int out_h);
@@ -0,0 +1,186 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of the preprocessing kernels used to turn the canvas into the
+// model input.
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Table mapping every gray level 0..255 to the value the model expects, for
+// quantized models this folds the quantization into the preprocessing
+template <typename T>
+using InputLut = std::array<T, 256>;
+
+// Builds the table for a model whose real input is gray / 255, quantized
+// types use real = scale * (q - zero_point), a zero scale means the tensor
+// has no quantization parameters and the input is taken as gray - 128 for
+// int8_t and gray for uint8_t
+template <typename T>
+InputLut<T> make_input_lut(float scale, int32_t zero_point);
+
+// GrayDownscaler converts a Cairo ARGB32 image into a smaller grayscale image
+// in a single pass. Each output pixel is the area average of the source pixels
+// it covers (box filter) and the luminance is computed with integer weights,
+// so no floating point is used per pixel. The filter taps are computed once
+// when the sizes are configured, after that run() does not allocate.
+// The luminance of a row uses NEON or SSE2 when available and a scalar loop
+// otherwise.
+class GrayDownscaler {
+ public:
+  // Maps the outputs of one axis onto the source, output o covers the source
+  // interval [origin + o * ratio, origin + (o + 1) * ratio) and source pixels
+  // outside [lo, hi) are taken as black
+  struct AxisMapping {
+    double origin;
+    double ratio;
+    int lo;
+    int hi;
+  };
+
+  GrayDownscaler() = default;
+  GrayDownscaler(int in_w, int in_h, int out_w, int out_h);
+
+  // Computes the filter taps for the given sizes, does nothing if the sizes
+  // did not change since the last call
+  void configure(int in_w, int in_h, int out_w, int out_h);
+  // Computes the filter taps for an arbitrary crop, scale and offset of the
+  // source, ratio may be below 1 to enlarge small crops
+  void configure(int in_w, int in_h, int out_w, int out_h,
+                 const AxisMapping &x, const AxisMapping &y);
+
+  int out_width() const { return out_w_; }
+  int out_height() const { return out_h_; }
+
+  /// Downscales the ARGB32 data into out, which must hold out_w * out_h bytes
+  /// stride is the number of bytes between rows of the source
+  void run(const uint8_t *argb, int stride, uint8_t *out);
+
+  /// Same as above but every gray value is mapped through lut as it is
+  /// written, so quantization costs nothing extra.
+  /// Available for float, int8_t and uint8_t
+  template <typename T>
+  void run(const uint8_t *argb, int stride, T *out, const InputLut<T> &lut);
+
+  /// Same as run with a lut but the source is already a one byte per pixel
+  /// gray image
+  template <typename T>
+  void run_gray(const uint8_t *gray, int stride, T *out,
+                const InputLut<T> &lut);
+
+ private:
+  // Contribution of a source row/column to an output row/column, weights are
+  // in Q12 and add up to 4096 for every output
+  struct Tap {
+    uint16_t src;
+    uint16_t dst;
+    uint32_t weight;
+  };
+  static void make_taps(const AxisMapping &axis, int out,
+                        std::vector<Tap> &taps);
+  // Vertical pass, leaves the filtered columns in row_acc_
+  void filter_rows(const uint8_t *src, int stride, bool gray);
+  // Horizontal pass, writes the output through the lut
+  template <typename T>
+  void filter_columns(T *out, const InputLut<T> &lut);
+
+  int in_w_ = 0, in_h_ = 0, out_w_ = 0, out_h_ = 0;
+  // Set when the taps come from a mapping instead of the plain sizes
+  bool mapped_ = false;
+  // Source columns read by the x taps
+  int col_lo_ = 0, col_hi_ = 0;
+  std::vector<Tap> x_taps_, y_taps_;
+  // Scratch buffers reused between calls
+  std::vector<uint8_t> lum_row_;
+  // Source columns filtered vertically, one row per output row
+  std::vector<uint32_t> row_acc_;
+};
+
+// Bounding box and center of mass of the ink of a gray image
+struct InkStats {
+  int x0 = 0, y0 = 0, x1 = 0, y1 = 0;  // Bounding box, x1 and y1 exclusive
+  double cx = 0.0, cy = 0.0;           // Center of mass, pixel centers at +0.5
+  uint64_t mass = 0;                   // Sum of the gray levels
+  bool empty() const { return mass == 0; }
+};
+
+// DigitNormalizer prepares a drawing the way the MNIST digits were prepared:
+// the ink bounding box is scaled to fit a 20x20 box keeping its aspect ratio
+// and placed in the 28x28 output so that its center of mass lands on the
+// center. Other output sizes keep the same 20/28 margin. A first pass
+// converts the image to gray while it accumulates the bounding box and the
+// moments, a second one resamples only the rows of the bounding box with the
+// area filter of GrayDownscaler. Nothing is allocated once the image size is
+// known. Gray images skip the conversion and are read in place.
+class DigitNormalizer {
+ public:
+  static constexpr int kSize = 28;  // Output width and height
+  static constexpr int kBox = 20;   // Box the ink bounding box is fit into
+
+  /// Normalizes the ARGB32 image into out, which must hold out_w * out_h
+  /// values. An empty image is written as lut[0]
+  template <typename T>
+  void run(const uint8_t *argb, int width, int height, int stride, T *out,
+           const InputLut<T> &lut, int out_w = kSize, int out_h = kSize);
+  /// Same for a one byte per pixel gray image, read in place
+  template <typename T>
+  void run_gray(const uint8_t *gray, int width, int height, int stride,
+                T *out, const InputLut<T> &lut, int out_w = kSize,
+                int out_h = kSize);
+
+  // Ink of the last image
+  const InkStats &stats() const { return stats_; }
+
+ private:
+  // Running sums of the ink, turned into stats_ by finish()
+  struct Moments {
+    InkStats stats;
+    uint64_t x = 0, y = 0;
+  };
+  // Gray conversion, bounding box and center of mass in one pass
+  void analyze(const uint8_t *argb, int width, int height, int stride);
+  // Adds the ink of gray row y to the moments
+  static void add_row(const uint8_t *row, int width, int y, Moments &moments);
+  void finish(const Moments &moments);
+  // Crops, scales and centers the measured ink of gray into out
+  template <typename T>
+  void resample(const uint8_t *gray, int width, int height, int stride,
+                T *out, const InputLut<T> &lut, int out_w, int out_h);
+
+  std::vector<uint8_t> gray_;
+  InkStats stats_;
+  GrayDownscaler downscaler_;
+};
+
+// Computes the luminance of n ARGB32 pixels into dst using the integer
+// weights 54/256 R + 183/256 G + 19/256 B, gray pixels are kept unchanged
+void argb_to_luminance(const uint8_t *argb, uint8_t *dst, int n);
+
+template <typename T>
+InputLut<T> make_input_lut(float scale, int32_t zero_point) {
+  InputLut<T> lut;
+  for (int gray = 0; gray < 256; gray++) {
+    if constexpr (std::is_same_v<T, float>) {
+      lut[gray] = gray / 255.0f;
+    } else {
+      int32_t q;
+      if (scale > 0.0f) {
+        q = static_cast<int32_t>(std::lround(gray / 255.0f / scale)) +
+            zero_point;
+      } else {
+        q = std::is_same_v<T, int8_t> ? gray - 128 : gray;
+      }
+      constexpr int32_t lo = std::is_same_v<T, int8_t> ? -128 : 0;
+      constexpr int32_t hi = std::is_same_v<T, int8_t> ? 127 : 255;
+      lut[gray] = static_cast<T>(q < lo ? lo : (q > hi ? hi : q));
+    }
+  }
+  return lut;
+}
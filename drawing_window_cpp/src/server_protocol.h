@@ -0,0 +1,63 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Wire format of the inference server, shared by the server and the load
+// generator.
+#pragma once
+
+#include <cstdint>
+
+// A client writes requests back to back without waiting for the responses,
+// the server answers them in the same order, so several can be in flight on
+// one connection. The structs are sent as they are in the byte order of the
+// host, every supported target is little endian.
+//
+// Request:  ServerRequest, then count images of width * height bytes, one
+//           byte per pixel, 0 is the background and 255 the ink like MNIST.
+//           28x28 images go straight into the model input, any other size
+//           is downscaled, e.g. a 250x250 capture of the window canvas
+// Response: ServerResponse, then count ServerDigit in the request order
+//
+// A malformed request gets a response with kServerBadRequest and the
+// connection is closed since the stream cannot be resynchronized.
+
+constexpr uint32_t kServerRequestMagic = 0x54474944;   // "DIGT"
+constexpr uint32_t kServerResponseMagic = 0x52474944;  // "DIGR"
+// Limits of a single request
+constexpr uint16_t kServerMaxSide = 1024;
+constexpr uint16_t kServerMaxCount = 256;
+constexpr uint32_t kServerMaxPayload = 16 << 20;  // Bytes of all the images
+
+struct ServerRequest {
+  uint32_t magic;
+  uint32_t id;  // Echoed in the response to match them
+  uint16_t width;
+  uint16_t height;
+  uint16_t count;  // Images in the request
+  uint16_t reserved;
+};
+static_assert(sizeof(ServerRequest) == 16, "ServerRequest is 16 bytes");
+
+enum ServerStatus : uint16_t {
+  kServerOk = 0,
+  kServerBadRequest = 1,  // Wrong magic or over the limits
+  kServerFailed = 2       // The model could not run, the digits are -1
+};
+
+struct ServerResponse {
+  uint32_t magic;
+  uint32_t id;
+  uint16_t count;
+  uint16_t status;
+  // Time spent on the request once it was fully received, in microseconds
+  uint32_t service_us;
+};
+static_assert(sizeof(ServerResponse) == 16, "ServerResponse is 16 bytes");
+
+struct ServerDigit {
+  int32_t digit;      // -1 on failure
+  float probability;  // Probability of the digit, see NnModel::top_k
+};
+static_assert(sizeof(ServerDigit) == 8, "ServerDigit is 8 bytes");
@@ -0,0 +1,114 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of the session recording
+#include "session_recording.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t kSessionMagic = 0x53535744;  // "DWSS"
+constexpr uint16_t kSessionVersion = 1;
+constexpr size_t kHeaderSize = 16;
+constexpr size_t kEventSize = 12;
+// Positions are stored in 1/8 pixels, enough for a pointer dragged out of
+// a drawing area of up to 4000 pixels
+constexpr float kPositionScale = 8.0f;
+
+int16_t encode_position(double value) {
+  double scaled = std::round(value * kPositionScale);
+  return static_cast<int16_t>(std::clamp(scaled, -32768.0, 32767.0));
+}
+
+}  // namespace
+
+SessionRecorder::SessionRecorder(const char *path, int width, int height,
+                                 double brush)
+    : file_(path, std::ios::binary | std::ios::trunc),
+      start_(std::chrono::steady_clock::now()) {
+  if (!file_) {
+    std::cerr << "Failed to create " << path << std::endl;
+    throw std::runtime_error("Unable to record the session");
+  }
+  uint8_t header[kHeaderSize] = {};
+  uint16_t size[2] = {static_cast<uint16_t>(width),
+                      static_cast<uint16_t>(height)};
+  float brush_size = static_cast<float>(brush);
+  std::memcpy(header, &kSessionMagic, 4);
+  std::memcpy(header + 4, &kSessionVersion, 2);
+  std::memcpy(header + 6, size, 4);
+  std::memcpy(header + 12, &brush_size, 4);
+  file_.write(reinterpret_cast<const char *>(header), sizeof(header));
+}
+
+// The stream buffers the events, the file is written in blocks
+void SessionRecorder::record(SessionEvent::Type type, double x, double y) {
+  uint32_t time = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start_)
+          .count());
+  int16_t position[2] = {encode_position(x), encode_position(y)};
+  uint8_t event[kEventSize] = {};
+  std::memcpy(event, &time, 4);
+  std::memcpy(event + 4, position, 4);
+  event[8] = type;
+  file_.write(reinterpret_cast<const char *>(event), sizeof(event));
+  events_++;
+}
+
+bool read_session(const char *path, Session &session) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::cerr << "Failed to open " << path << std::endl;
+    return false;
+  }
+  uint8_t header[kHeaderSize];
+  uint32_t magic = 0;
+  uint16_t version = 0;
+  if (file.read(reinterpret_cast<char *>(header), sizeof(header))) {
+    std::memcpy(&magic, header, 4);
+    std::memcpy(&version, header + 4, 2);
+  }
+  if (magic != kSessionMagic || version != kSessionVersion) {
+    std::cerr << "Not a drawing session: " << path << std::endl;
+    return false;
+  }
+  uint16_t size[2];
+  float brush;
+  std::memcpy(size, header + 6, 4);
+  std::memcpy(&brush, header + 12, 4);
+  session.width = size[0];
+  session.height = size[1];
+  session.brush = brush;
+
+  session.events.clear();
+  uint8_t event[kEventSize];
+  while (file.read(reinterpret_cast<char *>(event), sizeof(event))) {
+    SessionEvent decoded;
+    int16_t position[2];
+    std::memcpy(&decoded.time, event, 4);
+    std::memcpy(position, event + 4, 4);
+    if (event[8] > SessionEvent::predict) {
+      std::cerr << "Unknown event " << static_cast<int>(event[8]) << " in "
+                << path << std::endl;
+      return false;
+    }
+    decoded.type = static_cast<SessionEvent::Type>(event[8]);
+    decoded.x = position[0] / kPositionScale;
+    decoded.y = position[1] / kPositionScale;
+    session.events.push_back(decoded);
+  }
+  // A session cut short by a crash keeps its complete events
+  if (file.gcount() != 0) {
+    std::cerr << "Ignoring a truncated event at the end of " << path
+              << std::endl;
+  }
+  return true;
+}
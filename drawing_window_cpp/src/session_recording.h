@@ -0,0 +1,59 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Recording of drawing sessions, the input events of the drawing area in a
+// compact binary file that can be replayed without a display.
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+// One input event of a drawing session
+struct SessionEvent {
+  enum Type : uint8_t {
+    press,    // Left button pressed, starts a stroke
+    motion,   // Pointer moved with the button pressed
+    release,  // Left button released, ends the stroke
+    clear,    // Clear button
+    predict   // Predict button
+  };
+  Type type;
+  uint32_t time;  // Milliseconds since the recording started
+  float x;        // Position in the drawing area, 1/8 pixel resolution
+  float y;
+};
+
+// A recorded session
+struct Session {
+  int width = 0;  // Size of the drawing area
+  int height = 0;
+  double brush = 0.0;
+  std::vector<SessionEvent> events;
+};
+
+// SessionRecorder appends the events to the file as they come. The file is
+// a 16 byte header, the "DWSS" magic, a version, the drawing area size and
+// the brush, followed by 12 bytes per event: time, x and y in 1/8 pixels and
+// the type. Everything in the byte order of the host.
+class SessionRecorder {
+ public:
+  /// Creates the file and writes the header, throws if it cannot be created
+  SessionRecorder(const char *path, int width, int height, double brush);
+
+  // Records an event at the current time
+  void record(SessionEvent::Type type, double x = 0.0, double y = 0.0);
+  size_t events() const { return events_; }
+
+ private:
+  std::ofstream file_;
+  std::chrono::steady_clock::time_point start_;
+  size_t events_ = 0;
+};
+
+/// Reads a session written by SessionRecorder
+/// Returns false and prints the reason if the file cannot be read
+bool read_session(const char *path, Session &session);
@@ -0,0 +1,156 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of the session replay
+#include "session_replay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "drawing_canvas.h"
+#include "percentile.h"
+#include "session_recording.h"
+#include "tracing.h"
+
+using Clock = std::chrono::steady_clock;
+
+// A frame longer than this misses the refresh of a 60 Hz display
+static constexpr double kFrameBudgetUs = 16667.0;
+
+static void print_percentiles(const char *name, std::vector<double> &values) {
+  if (values.empty()) return;
+  std::sort(values.begin(), values.end());
+  std::cout << name << " p50/p95/p99/max: " << percentile(values, 50) << "/"
+            << percentile(values, 95) << "/" << percentile(values, 99) << "/"
+            << values.back() << " us" << std::endl;
+}
+
+static double elapsed_us(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+int run_replay(NnModel &nn, const ReplayConfig &config) {
+  Session session;
+  if (!read_session(config.path, session)) return 1;
+  if (session.width <= 0 || session.height <= 0) {
+    std::cerr << "Invalid drawing area in " << config.path << std::endl;
+    return 1;
+  }
+
+  DrawingCanvas canvas(session.width, session.height, session.brush);
+  // Stands for the widget, every frame composites the damaged area of the
+  // canvas onto it like on_draw does under the clip set by GTK
+  auto window = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32,
+                                            session.width, session.height);
+  auto window_context = Cairo::Context::create(window);
+  Predictor predictor(nn, config.preprocessing);
+
+  std::vector<double> frame_us;
+  std::vector<double> rasterize_us;
+  std::vector<double> predict_us;
+  std::vector<int> digits;
+  size_t frames_over_budget = 0;
+  size_t pending_points = 0;
+
+  // Same path as the worker, a copy of the canvas or of the strokes is
+  // preprocessed and inferred
+  auto predict = [&] {
+    auto start = Clock::now();
+    int digit;
+    if (config.vector_input) {
+      digit = predictor.predict(canvas.vector_snapshot());
+    } else {
+      auto snapshot = canvas.snapshot();
+      digit = predictor.predict(snapshot->get_data(), snapshot->get_width(),
+                                snapshot->get_height(),
+                                snapshot->get_stride());
+    }
+    predict_us.push_back(elapsed_us(start, Clock::now()));
+    digits.push_back(digit);
+    pending_points = 0;
+  };
+
+  auto frame = [&](const CanvasRect &damage) {
+    TRACE_SCOPE("on_draw");
+    window_context->save();
+    window_context->rectangle(damage.x, damage.y, damage.width,
+                              damage.height);
+    window_context->clip();
+    window_context->set_source(canvas.surface(), 0.0, 0.0);
+    window_context->paint();
+    window_context->restore();
+    window->flush();
+  };
+
+  const auto &events = session.events;
+  uint32_t first_time = events.empty() ? 0 : events.front().time;
+  auto start = Clock::now();
+  for (const SessionEvent &event : events) {
+    if (config.realtime) {
+      std::this_thread::sleep_until(
+          start + std::chrono::milliseconds(event.time - first_time));
+    }
+    auto event_start = Clock::now();
+    bool drawn = false;
+    switch (event.type) {
+      case SessionEvent::press:
+        canvas.press(event.x, event.y, event.time);
+        drawn = true;
+        break;
+      case SessionEvent::motion:
+        drawn = canvas.move(event.x, event.y, event.time);
+        break;
+      case SessionEvent::release:
+        canvas.release();
+        break;
+      case SessionEvent::clear:
+        canvas.clear();
+        pending_points = 0;
+        frame({0, 0, session.width, session.height});
+        break;
+      case SessionEvent::predict:
+        predict();
+        break;
+    }
+    if (!drawn) continue;
+
+    CanvasRect damage;
+    auto rasterize_start = Clock::now();
+    size_t new_points = canvas.rasterize_pending(damage);
+    rasterize_us.push_back(elapsed_us(rasterize_start, Clock::now()));
+    if (new_points == 0) continue;
+    frame(damage);
+    double frame_time = elapsed_us(event_start, Clock::now());
+    frame_us.push_back(frame_time);
+    if (frame_time > kFrameBudgetUs) frames_over_budget++;
+
+    pending_points += new_points;
+    if (config.live_points > 0 &&
+        pending_points >= static_cast<size_t>(config.live_points)) {
+      predict();
+    }
+  }
+  double total_ms = elapsed_us(start, Clock::now()) / 1000.0;
+
+  std::cout << "Replayed " << events.size() << " events of " << config.path
+            << " in " << total_ms << " ms"
+            << (config.realtime ? " in real time" : " at max speed")
+            << std::endl;
+  std::cout << "Frames: " << frame_us.size()
+            << ", over budget: " << frames_over_budget
+            << ", predictions: " << digits.size() << std::endl;
+  print_percentiles("Frame", frame_us);
+  print_percentiles("Rasterize", rasterize_us);
+  print_percentiles("Prediction", predict_us);
+  if (!digits.empty()) {
+    std::cout << "Predicted:";
+    for (int digit : digits) std::cout << " " << digit;
+    std::cout << std::endl;
+  }
+  return 0;
+}
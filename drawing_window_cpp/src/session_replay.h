@@ -0,0 +1,32 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of the session replay, a recorded drawing session run again
+// without a display to time the drawing and the predictions.
+#pragma once
+
+#include "nn_model.h"
+#include "predictor.h"
+
+// Options for the headless replay of a recorded session
+struct ReplayConfig {
+  const char *path = nullptr;
+  // Keeps the recorded timing between events, otherwise they are replayed
+  // as fast as possible
+  bool realtime = false;
+  Preprocessing preprocessing = Preprocessing::downscale;
+  bool vector_input = false;  // Predict from the strokes like --vector
+  // Predicts every live_points new points too, like live prediction with
+  // --live-points, 0 only predicts where the predict button was pressed
+  int live_points = 0;
+};
+
+/// Replays the session on an offscreen canvas, every event is rasterized
+/// and composited onto an offscreen window surface like the drawing area
+/// does, and the predictions run on the calling thread. Prints the frame
+/// time, the rasterization cost and the prediction latency percentiles and
+/// the predicted digits, which are the same on every run of a session.
+/// Returns the process exit code
+int run_replay(NnModel &nn, const ReplayConfig &config);
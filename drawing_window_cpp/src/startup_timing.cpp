@@ -0,0 +1,55 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of the startup timing helpers
+#include "startup_timing.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Initialized before main runs, close enough to the process start
+static const Clock::time_point process_start = Clock::now();
+
+struct Phase {
+  std::string name;
+  Clock::time_point finished;
+  size_t resident_kb;
+};
+static std::mutex phases_mutex;
+static std::vector<Phase> phases;
+
+// The second field of statm is the number of resident pages
+size_t resident_memory_kb() {
+  std::ifstream statm("/proc/self/statm");
+  size_t size = 0, resident = 0;
+  if (!(statm >> size >> resident)) return 0;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void startup_mark(const char *phase) {
+  auto now = Clock::now();
+  size_t resident = resident_memory_kb();
+  std::lock_guard<std::mutex> lock(phases_mutex);
+  phases.push_back({phase, now, resident});
+}
+
+void startup_report() {
+  std::lock_guard<std::mutex> lock(phases_mutex);
+  std::cout << "Startup timing:" << std::endl;
+  for (const auto &phase : phases) {
+    std::chrono::duration<double, std::milli> elapsed =
+        phase.finished - process_start;
+    std::cout << "  " << elapsed.count() << " ms: " << phase.name << " (RSS "
+              << phase.resident_kb / 1024.0 << " MB)" << std::endl;
+  }
+}
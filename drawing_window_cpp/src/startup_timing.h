@@ -0,0 +1,21 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Helpers used to report how long each phase of the startup takes.
+#pragma once
+
+#include <cstddef>
+
+// Records that phase finished now, the time is relative to the process
+// start. The resident memory at that point is recorded too. Can be called
+// from any thread
+void startup_mark(const char *phase);
+
+// Prints every phase recorded so far in the order they finished with the
+// resident memory after each one
+void startup_report();
+
+// Resident set size of the process in KiB, 0 if it cannot be read
+size_t resident_memory_kb();
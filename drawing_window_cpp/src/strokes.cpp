@@ -0,0 +1,179 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of the vector stroke model
+#include "strokes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// FNV-1a on 32 bit words of the position and the stroke. Two different
+// drawings may still get the same 64 bit hash, which is improbable and
+// accepted since a false cache hit only shows the digit of the other drawing
+void StrokeSet::mix(const StrokePoint &point) {
+  uint32_t words[3];
+  std::memcpy(&words[0], &point.x, 4);
+  std::memcpy(&words[1], &point.y, 4);
+  words[2] = point.stroke;
+  for (uint32_t word : words) {
+    hash_ ^= word;
+    hash_ *= 0x100000001b3ull;
+  }
+}
+
+void StrokeSet::begin_stroke(float x, float y, uint32_t time) {
+  points_.push_back({x, y, time, static_cast<uint32_t>(stroke_count_)});
+  stroke_count_++;
+  mix(points_.back());
+}
+
+void StrokeSet::add_point(float x, float y, uint32_t time) {
+  if (stroke_count_ == 0) {
+    begin_stroke(x, y, time);
+    return;
+  }
+  points_.push_back({x, y, time, static_cast<uint32_t>(stroke_count_ - 1)});
+  mix(points_.back());
+}
+
+void StrokeSet::clear() {
+  points_.clear();
+  stroke_count_ = 0;
+  hash_ = kHashSeed;
+}
+
+// Distance from p to the segment ab, a == b is a dot
+static inline float segment_distance(float px, float py, const StrokePoint &a,
+                                     const StrokePoint &b) {
+  float dx = b.x - a.x, dy = b.y - a.y;
+  float length2 = dx * dx + dy * dy;
+  float t = length2 > 0.0f ? ((px - a.x) * dx + (py - a.y) * dy) / length2
+                           : 0.0f;
+  t = std::clamp(t, 0.0f, 1.0f);
+  float ex = px - (a.x + t * dx), ey = py - (a.y + t * dy);
+  return std::sqrt(ex * ex + ey * ey);
+}
+
+// The coverage of a pixel is approximated by a ramp one output pixel wide
+// across the capsule border, the union of the capsules keeps the largest
+// coverage of each pixel so overlapping segments do not add up
+void StrokeRasterizer::cover(const StrokeSet &strokes, double radius,
+                             const AxisMapping &x, const AxisMapping &y,
+                             int out_w, int out_h) {
+  coverage_.assign(static_cast<size_t>(out_w) * out_h, 0.0f);
+  const float pixel = static_cast<float>(std::sqrt(x.ratio * y.ratio));
+  const float r = static_cast<float>(radius);
+  // Distances beyond this do not touch the pixel
+  const double reach = radius + pixel;
+  const std::vector<StrokePoint> &points = strokes.points();
+  for (size_t i = 0; i < points.size(); i++) {
+    const StrokePoint &a = strokes.segment_start(i);
+    const StrokePoint &b = points[i];
+    // Output pixels whose center is within reach of the segment
+    auto first = [](double canvas, const AxisMapping &axis) {
+      return static_cast<int>(std::ceil((canvas - axis.origin) / axis.ratio -
+                                        0.5));
+    };
+    auto last = [](double canvas, const AxisMapping &axis) {
+      return static_cast<int>(std::floor((canvas - axis.origin) / axis.ratio -
+                                         0.5));
+    };
+    int ox0 = std::max(first(std::min(a.x, b.x) - reach, x), 0);
+    int ox1 = std::min(last(std::max(a.x, b.x) + reach, x), out_w - 1);
+    int oy0 = std::max(first(std::min(a.y, b.y) - reach, y), 0);
+    int oy1 = std::min(last(std::max(a.y, b.y) + reach, y), out_h - 1);
+    for (int oy = oy0; oy <= oy1; oy++) {
+      float py = static_cast<float>(y.origin + (oy + 0.5) * y.ratio);
+      float *row = coverage_.data() + oy * out_w;
+      for (int ox = ox0; ox <= ox1; ox++) {
+        float px = static_cast<float>(x.origin + (ox + 0.5) * x.ratio);
+        float c = (r - segment_distance(px, py, a, b)) / pixel + 0.5f;
+        row[ox] = std::max(row[ox], std::min(c, 1.0f));
+      }
+    }
+  }
+}
+
+template <typename T>
+void StrokeRasterizer::run(const StrokeSet &strokes, double radius,
+                           const AxisMapping &x, const AxisMapping &y,
+                           int out_w, int out_h, T *out,
+                           const InputLut<T> &lut) {
+  cover(strokes, radius, x, y, out_w, out_h);
+  for (size_t i = 0; i < coverage_.size(); i++)
+    out[i] = lut[static_cast<int>(coverage_[i] * 255.0f + 0.5f)];
+}
+
+// The bounding box is known from the points, the center of mass is not, so
+// a first pass centers the box and a second one shifts the drawing by the
+// center of mass measured on the first
+template <typename T>
+void StrokeRasterizer::run_normalized(const StrokeSet &strokes, double radius,
+                                      T *out, const InputLut<T> &lut,
+                                      int out_w, int out_h) {
+  if (strokes.empty()) {
+    std::fill(out, out + out_w * out_h, lut[0]);
+    return;
+  }
+  float x0 = strokes.points().front().x, x1 = x0;
+  float y0 = strokes.points().front().y, y1 = y0;
+  for (const StrokePoint &p : strokes.points()) {
+    x0 = std::min(x0, p.x);
+    x1 = std::max(x1, p.x);
+    y0 = std::min(y0, p.y);
+    y1 = std::max(y1, p.y);
+  }
+  double side = std::max(x1 - x0, y1 - y0) + 2 * radius;
+  double box = static_cast<double>(std::min(out_w, out_h)) *
+               DigitNormalizer::kBox / DigitNormalizer::kSize;
+  double ratio = side / box;
+  double center_x = out_w / 2.0;
+  double center_y = out_h / 2.0;
+  AxisMapping x{(x0 + x1) / 2.0 - center_x * ratio, ratio, 0, 0};
+  AxisMapping y{(y0 + y1) / 2.0 - center_y * ratio, ratio, 0, 0};
+  cover(strokes, radius, x, y, out_w, out_h);
+
+  double mass = 0.0, moment_x = 0.0, moment_y = 0.0;
+  for (int oy = 0; oy < out_h; oy++) {
+    for (int ox = 0; ox < out_w; ox++) {
+      float c = coverage_[oy * out_w + ox];
+      mass += c;
+      moment_x += c * (ox + 0.5);
+      moment_y += c * (oy + 0.5);
+    }
+  }
+  if (mass > 0.0) {
+    x.origin += (moment_x / mass - center_x) * ratio;
+    y.origin += (moment_y / mass - center_y) * ratio;
+  }
+  run<T>(strokes, radius, x, y, out_w, out_h, out, lut);
+}
+
+// Allows us to separate implementation in cpp
+template void StrokeRasterizer::run(const StrokeSet &strokes, double radius,
+                                    const AxisMapping &x, const AxisMapping &y,
+                                    int out_w, int out_h, float *out,
+                                    const InputLut<float> &lut);
+template void StrokeRasterizer::run(const StrokeSet &strokes, double radius,
+                                    const AxisMapping &x, const AxisMapping &y,
+                                    int out_w, int out_h, int8_t *out,
+                                    const InputLut<int8_t> &lut);
+template void StrokeRasterizer::run(const StrokeSet &strokes, double radius,
+                                    const AxisMapping &x, const AxisMapping &y,
+                                    int out_w, int out_h, uint8_t *out,
+                                    const InputLut<uint8_t> &lut);
+template void StrokeRasterizer::run_normalized(const StrokeSet &strokes,
+                                               double radius, float *out,
+                                               const InputLut<float> &lut,
+                                               int out_w, int out_h);
+template void StrokeRasterizer::run_normalized(const StrokeSet &strokes,
+                                               double radius, int8_t *out,
+                                               const InputLut<int8_t> &lut,
+                                               int out_w, int out_h);
+template void StrokeRasterizer::run_normalized(const StrokeSet &strokes,
+                                               double radius, uint8_t *out,
+                                               const InputLut<uint8_t> &lut,
+                                               int out_w, int out_h);
@@ -0,0 +1,115 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Definition of the vector stroke model, the drawing is kept as polylines of
+// timestamped points and can be rasterized straight at the model resolution.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "preprocessing.h"
+
+// Mouse position on the canvas, consecutive points of the same stroke are
+// joined by a segment
+struct StrokePoint {
+  float x, y;
+  uint32_t time;    // Event time in milliseconds
+  uint32_t stroke;  // Index of the stroke the point belongs to
+};
+
+// StrokeSet stores every stroke of a drawing as one flat list of points, a
+// stroke is a polyline drawn with a round brush, i.e. a chain of capsules
+class StrokeSet {
+ public:
+  // Starts a new stroke at the point, a single point draws a dot
+  void begin_stroke(float x, float y, uint32_t time);
+  // Extends the current stroke, starts one if there is none
+  void add_point(float x, float y, uint32_t time);
+  void clear();
+
+  const std::vector<StrokePoint> &points() const { return points_; }
+  size_t size() const { return points_.size(); }
+  bool empty() const { return points_.empty(); }
+  size_t stroke_count() const { return stroke_count_; }
+  /// Hash of the drawing updated with every point, the same strokes give
+  /// the same hash whenever they are drawn since the times are left out.
+  /// Used to tell an unchanged drawing without looking at the pixels
+  uint64_t hash() const { return hash_; }
+  // Start of the segment ending at point index, the point itself when it
+  // starts its stroke
+  const StrokePoint &segment_start(size_t index) const {
+    return index > 0 && points_[index - 1].stroke == points_[index].stroke
+               ? points_[index - 1]
+               : points_[index];
+  }
+
+ private:
+  // Folds the position and the stroke of the point into hash_
+  void mix(const StrokePoint &point);
+
+  // FNV-1a offset basis, the hash of an empty drawing
+  static constexpr uint64_t kHashSeed = 0xcbf29ce484222325ull;
+
+  std::vector<StrokePoint> points_;
+  size_t stroke_count_ = 0;
+  uint64_t hash_ = kHashSeed;
+};
+
+// Strokes with everything needed to render them, a vector copy of the canvas
+// that can be handed to another thread
+struct VectorCanvas {
+  StrokeSet strokes;
+  int width = 0;
+  int height = 0;
+  double brush = 0.0;  // Brush radius
+};
+
+// StrokeRasterizer renders the capsules of a StrokeSet straight into a small
+// gray image with analytic anti-aliasing: the coverage of an output pixel is
+// derived from the distance of its center to the nearest segment, so there
+// is no full resolution render to downscale. Only the pixels around each
+// segment are visited and nothing is allocated once the size is known.
+class StrokeRasterizer {
+ public:
+  using AxisMapping = GrayDownscaler::AxisMapping;
+
+  /// Renders strokes drawn with a brush of the given radius into out, which
+  /// must hold out_w * out_h values. x and y map the outputs onto the canvas
+  /// as in GrayDownscaler, lo and hi are ignored
+  template <typename T>
+  void run(const StrokeSet &strokes, double radius, const AxisMapping &x,
+           const AxisMapping &y, int out_w, int out_h, T *out,
+           const InputLut<T> &lut);
+
+  /// Same as above for the whole canvas scaled to the output
+  template <typename T>
+  void run(const StrokeSet &strokes, double radius, int canvas_w,
+           int canvas_h, int out_w, int out_h, T *out,
+           const InputLut<T> &lut) {
+    run<T>(strokes, radius,
+           {0.0, static_cast<double>(canvas_w) / out_w, 0, canvas_w},
+           {0.0, static_cast<double>(canvas_h) / out_h, 0, canvas_h}, out_w,
+           out_h, out, lut);
+  }
+
+  /// MNIST style like DigitNormalizer, the bounding box of the strokes is
+  /// fit into 20x20 and the center of mass is moved to the center of the
+  /// 28x28 output, other sizes keep the same margin. out must hold
+  /// out_w * out_h values
+  template <typename T>
+  void run_normalized(const StrokeSet &strokes, double radius, T *out,
+                      const InputLut<T> &lut,
+                      int out_w = DigitNormalizer::kSize,
+                      int out_h = DigitNormalizer::kSize);
+
+ private:
+  // Fills coverage_ with the coverage of every output pixel
+  void cover(const StrokeSet &strokes, double radius, const AxisMapping &x,
+             const AxisMapping &y, int out_w, int out_h);
+
+  std::vector<float> coverage_;
+};
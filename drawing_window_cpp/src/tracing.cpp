@@ -0,0 +1,169 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Implementation of the instrumentation layer
+#include "tracing.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+std::atomic<bool> trace_active{false};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct TraceEvent {
+  const char *name;
+  int64_t start_ns;
+  int64_t duration_ns;
+  uint32_t thread;
+};
+
+// A slot is valid for ticket t when its sequence is t + 1. It works as a
+// seqlock: the writer clears the sequence before touching the event and
+// publishes it after, a reader copies the event between two loads of the
+// sequence and drops the copy if the slot was overwritten in between
+struct Slot {
+  std::atomic<uint64_t> sequence{0};
+  TraceEvent event;
+};
+
+Clock::time_point trace_start;
+std::unique_ptr<Slot[]> slots;
+size_t slot_count = 0;
+std::atomic<uint64_t> head{0};
+std::atomic<uint32_t> next_thread{0};
+
+// Small sequential ids read better in the trace viewer than the OS ones
+uint32_t thread_id() {
+  thread_local uint32_t id = next_thread.fetch_add(1);
+  return id;
+}
+
+// Copies the valid events out of the ring, oldest first
+std::vector<TraceEvent> snapshot_events() {
+  std::vector<TraceEvent> events;
+  if (slot_count == 0) return events;
+  uint64_t end = head.load(std::memory_order_acquire);
+  uint64_t begin = end > slot_count ? end - slot_count : 0;
+  events.reserve(end - begin);
+  for (uint64_t ticket = begin; ticket < end; ticket++) {
+    const Slot &slot = slots[ticket % slot_count];
+    if (slot.sequence.load(std::memory_order_acquire) != ticket + 1) continue;
+    TraceEvent event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == ticket + 1)
+      events.push_back(event);
+  }
+  return events;
+}
+
+// Escapes the characters that would break a JSON string
+std::string json_escape(const char *text) {
+  std::string escaped;
+  for (const char *c = text; *c; c++) {
+    if (*c == '"' || *c == '\\') escaped += '\\';
+    if (static_cast<unsigned char>(*c) >= 0x20) escaped += *c;
+  }
+  return escaped;
+}
+
+}  // namespace
+
+void trace_enable(size_t capacity) {
+  if (capacity == 0 || slots) return;
+  slot_count = capacity;
+  slots.reset(new Slot[capacity]);
+  trace_start = Clock::now();
+  trace_active.store(true, std::memory_order_release);
+}
+
+int64_t trace_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                              trace_start)
+      .count();
+}
+
+// Claims the next ticket and overwrites whatever was in its slot
+void trace_record(const char *name, int64_t start_ns, int64_t duration_ns) {
+  if (!trace_enabled()) return;
+  uint64_t ticket = head.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[ticket % slot_count];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.event = {name, start_ns, duration_ns, thread_id()};
+  slot.sequence.store(ticket + 1, std::memory_order_release);
+}
+
+const char *trace_intern(const std::string &name) {
+  static std::mutex mutex;
+  static std::set<std::string> names;
+  std::lock_guard<std::mutex> lock(mutex);
+  return names.insert(name).first->c_str();
+}
+
+bool trace_write_chrome_json(const char *path) {
+  std::ofstream file(path);
+  if (!file) {
+    std::cerr << "Failed to open trace file: " << path << std::endl;
+    return false;
+  }
+
+  std::vector<TraceEvent> events = snapshot_events();
+  file << "{\"traceEvents\":[";
+  for (size_t i = 0; i < events.size(); i++) {
+    const TraceEvent &event = events[i];
+    file << (i ? ",\n" : "\n") << "{\"name\":\"" << json_escape(event.name)
+         << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+         << ",\"ts\":" << event.start_ns / 1000.0
+         << ",\"dur\":" << event.duration_ns / 1000.0 << "}";
+  }
+  file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  std::cout << "Trace with " << events.size() << " events written to "
+            << path << std::endl;
+  return static_cast<bool>(file);
+}
+
+void trace_print_summary() {
+  std::map<std::string, std::vector<int64_t>> durations;
+  for (const TraceEvent &event : snapshot_events())
+    durations[event.name].push_back(event.duration_ns);
+
+  std::cout << "Trace summary (us): name count mean p50 p95 p99 max"
+            << std::endl;
+  for (auto &entry : durations) {
+    std::vector<int64_t> &values = entry.second;
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (int64_t v : values) sum += v;
+    auto pct = [&values](double p) {
+      size_t index = static_cast<size_t>(p / 100.0 * (values.size() - 1));
+      return values[index] / 1000.0;
+    };
+    std::cout << "  " << entry.first << " " << values.size() << " "
+              << sum / values.size() / 1000.0 << " " << pct(50) << " "
+              << pct(95) << " " << pct(99) << " " << values.back() / 1000.0
+              << std::endl;
+
+    // Log2 histogram, bucket b counts durations below 2^b us
+    std::map<int, size_t> buckets;
+    for (int64_t v : values) {
+      int bucket = 0;
+      while ((int64_t(1000) << bucket) <= v) bucket++;
+      buckets[bucket]++;
+    }
+    std::cout << "   ";
+    for (const auto &bucket : buckets)
+      std::cout << " <" << (1 << bucket.first) << "us:" << bucket.second;
+    std::cout << std::endl;
+  }
+}
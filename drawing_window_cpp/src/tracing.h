@@ -0,0 +1,66 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Lightweight instrumentation, scoped timers record events into a lock-free
+// ring buffer that can be exported as a Chrome trace or summarized.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Checked by every scope, relaxed since a few events more or less around the
+// moment tracing is enabled do not matter
+extern std::atomic<bool> trace_active;
+inline bool trace_enabled() {
+  return trace_active.load(std::memory_order_relaxed);
+}
+
+// Allocates a ring of capacity events and starts recording, the oldest events
+// are overwritten once it is full. Call before starting any thread
+void trace_enable(size_t capacity);
+
+// Nanoseconds since tracing was enabled
+int64_t trace_now_ns();
+
+// Records an event that started at start_ns and lasted duration_ns, name must
+// stay valid until the trace is exported (string literals or trace_intern)
+void trace_record(const char *name, int64_t start_ns, int64_t duration_ns);
+
+// Returns a copy of name that lives until the end of the process, used for
+// names built at runtime like the TFLite op names
+const char *trace_intern(const std::string &name);
+
+// Writes the recorded events in the Chrome trace event format, it can be
+// loaded in chrome://tracing or Perfetto. Returns false if it cannot write
+bool trace_write_chrome_json(const char *path);
+
+// Prints count, mean, percentiles and a log2 histogram for every event name
+void trace_print_summary();
+
+// Times the enclosing scope, when tracing is disabled it costs a load and a
+// branch
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name)
+      : name_(trace_enabled() ? name : nullptr),
+        start_ns_(name_ ? trace_now_ns() : 0) {}
+  ~TraceScope() {
+    if (name_) trace_record(name_, start_ns_, trace_now_ns() - start_ns_);
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+ private:
+  const char *name_;
+  int64_t start_ns_;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// Times the rest of the enclosing scope under name
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
@@ -6,15 +6,87 @@
 // Window definition, this is where the whole layout is defined
 #include "window.h"
 
+#include <glibmm/main.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <future>
 #include <iostream>
+#include <vector>
+
+#include "startup_timing.h"
+#include "tracing.h"
+
+// File name of a model, used to label its predictions
+static std::string model_name(const std::string& path) {
+  return std::filesystem::path(path).filename().string();
+}
+
+// Best classes with their probability, e.g. "3 (97%), 8 (2%), 5 (1%)"
+static std::string format_top(const InferenceWorker::Prediction& prediction) {
+  std::string text;
+  for (const ClassScore& score : prediction.top) {
+    if (score.index < 0) break;
+    if (!text.empty()) text += ", ";
+    text += std::to_string(score.index) + " (" +
+            std::to_string(std::lround(score.probability * 100.0f)) + "%)";
+  }
+  return text;
+}
+
+// Digits of a number as written, leading zeros included
+static std::string format_digits(const std::vector<int>& digits) {
+  std::string text;
+  for (int digit : digits) text += std::to_string(digit);
+  return text;
+}
+
+// A number gets a canvas wide enough for all of its digits
+static int canvas_width(size_t max_digits) {
+  return std::max(250, static_cast<int>(max_digits) * 125);
+}
 
 // Window implementation with a:
 // clear_button: used to clear the screen
 // predict_button: used to save the screen to an image and get the NN info
 // Drawing area
+// live_toggle: used to predict while drawing
+// model_chooser: used to replace the model, compare_chooser for the second
 // Everything is enclosed in a Gtk::Grid widget
-Window::Window(NnModel& nn)
-    : nn_(nn), clear_button("Clear"), predict_button("Predict") {
+Window::Window(std::shared_future<std::shared_ptr<NnModel>> model,
+               const ModelSwapConfig& models, bool verbose,
+               const LivePredictConfig& live, Preprocessing preprocessing,
+               bool vector_input, size_t max_digits)
+    : mouse_drawing(canvas_width(max_digits)),
+      clear_button("Clear"),
+      predict_button("Predict"),
+      live_toggle("Live prediction"),
+      model_chooser("Select a model"),
+      compare_chooser("Select a model to compare"),
+      verbose_(verbose),
+      worker_(std::move(model), preprocessing, 1, max_digits),
+      models_(models),
+      // The digits of a number are cut out of the rendered canvas
+      vector_input_(vector_input && max_digits == 0),
+      max_digits_(max_digits),
+      live_(live) {
+  bool compare = !models_.compare_path.empty();
+  // The second model starts loading before the widgets are built
+  if (compare) {
+    NnModelOptions options = models_.options;
+    options.xnnpack_weight_cache = nullptr;
+    compare_worker_ = std::make_unique<InferenceWorker>(
+        std::async(std::launch::async,
+                   [path = models_.compare_path, options, preprocessing] {
+                     return load_warm_model(path.c_str(), options,
+                                            preprocessing);
+                   })
+            .share(),
+        preprocessing, 1, max_digits);
+  }
+
   set_title("MNIST example");
   set_border_width(10);
 
@@ -39,8 +111,60 @@ Window::Window(NnModel& nn)
   // height of 1
   my_grid.attach_next_to(predict_button, clear_button, Gtk::POS_RIGHT, 1, 1);
 
-  my_grid.attach_next_to(text_view, clear_button, Gtk::POS_BOTTOM, 2, 1);
-  text_view.set_text("You drew: ");
+  // The predictions of both models are shown side by side when comparing
+  if (compare) {
+    my_grid.attach_next_to(text_view, clear_button, Gtk::POS_BOTTOM, 1, 1);
+    my_grid.attach_next_to(compare_view, text_view, Gtk::POS_RIGHT, 1, 1);
+    compare_view.set_text("Loading " + model_name(models_.compare_path) +
+                          "...");
+  } else {
+    my_grid.attach_next_to(text_view, clear_button, Gtk::POS_BOTTOM, 2, 1);
+  }
+  text_view.set_text("Loading model...");
+
+  // Live prediction toggle below the text
+  my_grid.attach_next_to(live_toggle, text_view, Gtk::POS_BOTTOM, 2, 1);
+  live_toggle.signal_toggled().connect(
+      sigc::mem_fun(*this, &Window::on_live_toggled));
+  mouse_drawing.signal_stroke().connect(
+      sigc::mem_fun(*this, &Window::on_stroke));
+  live_toggle.set_active(live_.enabled);
+  on_live_toggled();
+
+  // Model selectors below the toggle, one per model
+  auto filter = Gtk::FileFilter::create();
+  filter->set_name("TFLite models");
+  filter->add_pattern("*.tflite");
+  model_chooser.add_filter(filter);
+  model_chooser.set_filename(models_.path);
+  model_chooser.signal_file_set().connect(
+      sigc::bind(sigc::mem_fun(*this, &Window::on_model_selected), false));
+  my_grid.attach_next_to(model_chooser, live_toggle, Gtk::POS_BOTTOM,
+                         compare ? 1 : 2, 1);
+  model_file_.path = models_.path;
+  watch_model(false);
+  if (compare) {
+    compare_chooser.add_filter(filter);
+    compare_chooser.set_filename(models_.compare_path);
+    compare_chooser.signal_file_set().connect(
+        sigc::bind(sigc::mem_fun(*this, &Window::on_model_selected), true));
+    my_grid.attach_next_to(compare_chooser, model_chooser, Gtk::POS_RIGHT, 1,
+                           1);
+    compare_file_.path = models_.compare_path;
+    watch_model(true);
+  }
+
+  // Results from the inference workers are delivered on the GUI thread
+  worker_.signal_result().connect(
+      sigc::bind(sigc::mem_fun(*this, &Window::on_prediction), false));
+  worker_.signal_ready().connect(
+      sigc::bind(sigc::mem_fun(*this, &Window::on_model_ready), false));
+  if (compare) {
+    compare_worker_->signal_result().connect(
+        sigc::bind(sigc::mem_fun(*this, &Window::on_prediction), true));
+    compare_worker_->signal_ready().connect(
+        sigc::bind(sigc::mem_fun(*this, &Window::on_model_ready), true));
+  }
 
   // Show everything on the window
   show_all_children();
@@ -48,51 +172,344 @@ Window::Window(NnModel& nn)
 
 Window::~Window() {}
 
+// The window can be drawn on from here on, even if the model is not ready
+bool Window::on_map_event(GdkEventAny* event) {
+  if (!mapped_) {
+    mapped_ = true;
+    startup_mark("window shown");
+    if (model_ready_) startup_report();
+  }
+  return Gtk::Window::on_map_event(event);
+}
+
+void Window::on_model_ready(bool ok, bool compare) {
+  ModelFile& file = compare ? compare_file_ : model_file_;
+  Gtk::Label& view = compare ? compare_view : text_view;
+  Gtk::FileChooserButton& chooser = compare ? compare_chooser : model_chooser;
+
+  // A model picked at runtime replaced the previous one, or failed to
+  if (!file.loading.empty()) {
+    if (ok) {
+      file.path = file.loading;
+      view.set_text("Using " + model_name(file.path));
+      watch_model(compare);
+    } else {
+      view.set_text("Failed to load " + model_name(file.loading) +
+                    ", keeping " + model_name(file.path));
+      chooser.set_filename(file.path);
+    }
+    std::cout << view.get_text() << std::endl;
+    file.loading.clear();
+    return;
+  }
+
+  if (!ok) {
+    view.set_text("Model failed to load");
+  } else if (compare_worker_) {
+    view.set_text(model_name(file.path) + ": ");
+  } else {
+    view.set_text(max_digits_ ? "You wrote: " : "You drew: ");
+  }
+  if (!compare) {
+    model_ready_ = true;
+    if (mapped_) startup_report();
+  }
+}
+
+void Window::on_model_selected(bool compare) {
+  Gtk::FileChooserButton& chooser = compare ? compare_chooser : model_chooser;
+  std::string path = chooser.get_filename();
+  if (!path.empty()) swap_model(compare, path);
+}
+
+// Only a file moved over the watched one is reloaded. The model in use is
+// mapped from the file, moving a new one over it leaves the old inode intact
+// while rewriting it in place, e.g. with cp, changes the weights under the
+// running interpreter, so that is reported and not reloaded
+void Window::on_model_file_changed(const Glib::RefPtr<Gio::File>& file,
+                                   const Glib::RefPtr<Gio::File>& other,
+                                   Gio::FileMonitorEvent event, bool compare) {
+  const ModelFile& model = compare ? compare_file_ : model_file_;
+  if (event == Gio::FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+    std::cerr << model.path << " was rewritten in place, not reloading it."
+              << " Replace it with mv to swap the model" << std::endl;
+    return;
+  }
+  bool moved_in = event == Gio::FILE_MONITOR_EVENT_MOVED_IN;
+  // A file renamed in the same directory onto the watched path
+  bool renamed_over = event == Gio::FILE_MONITOR_EVENT_RENAMED && other &&
+                      other->get_path() == model.path;
+  if (!moved_in && !renamed_over) return;
+  std::cout << model.path << " replaced, reloading" << std::endl;
+  swap_model(compare, model.path);
+}
+
+// The workers keep predicting with the current model while the new one loads
+void Window::swap_model(bool compare, const std::string& path) {
+  InferenceWorker& worker = compare ? *compare_worker_ : worker_;
+  ModelFile& file = compare ? compare_file_ : model_file_;
+  NnModelOptions options = models_.options;
+  // The XNNPACK weight cache belongs to the model it was created for, it is
+  // keyed by offsets in the file and not by the weights, so even the same
+  // path retrained would reuse the old packed weights
+  options.xnnpack_weight_cache = nullptr;
+  if (!worker.load(path, options)) {
+    std::cout << "Still loading " << file.loading << ", ignoring " << path
+              << std::endl;
+    return;
+  }
+  file.loading = path;
+  (compare ? compare_view : text_view)
+      .set_text("Loading " + model_name(path) + "...");
+}
+
+void Window::watch_model(bool compare) {
+  ModelFile& file = compare ? compare_file_ : model_file_;
+  file.monitor.reset();
+  if (!models_.watch) return;
+  try {
+    // Moves are reported as such instead of as a delete and a create
+    file.monitor = Gio::File::create_for_path(file.path)->monitor_file(
+        Gio::FILE_MONITOR_WATCH_MOVES);
+    file.monitor->signal_changed().connect(sigc::bind(
+        sigc::mem_fun(*this, &Window::on_model_file_changed), compare));
+  } catch (const Glib::Error& e) {
+    std::cerr << "Unable to watch " << file.path << ": " << e.what()
+              << std::endl;
+  }
+}
+
 // Calls the clear_screen method on the MouseDrawing area
 void Window::on_clear_clicked() {
   // Clear screen
   mouse_drawing.clear_screen();
+  last_clear_ = Clock::now();
+  live_pending_points_ = 0;
   std::cout << "Clear clicked!" << std::endl;
 }
 
-// Helper function used to get the index of the
-// maximum value in a Vector
-template <typename T>
-int get_max_index(const std::vector<T>& vec) {
-  auto max_iter = std::max_element(vec.begin(), vec.end());
-  return std::distance(vec.begin(), max_iter);
+void Window::record_session(const char *path) {
+  mouse_drawing.start_recording(path);
 }
 
-// Calls the save_screen method on the MouseDrawing area
+// The row goes right below the canvas buttons, the samples are single digits
+// so it is not offered for numbers
+void Window::capture_dataset(const std::string& prefix) {
+  if (max_digits_) {
+    std::cerr << "Capture saves single digits, ignored with --number"
+              << std::endl;
+    return;
+  }
+  capture_ = std::make_unique<DatasetWriter>(prefix);
+  capture_box.set_homogeneous(true);
+  for (int digit = 0; digit < 10; digit++) {
+    Gtk::Button& button = capture_buttons[digit];
+    button.set_label(std::to_string(digit));
+    button.set_tooltip_text("Save the drawing as a " + std::to_string(digit));
+    button.signal_clicked().connect(
+        sigc::bind(sigc::mem_fun(*this, &Window::on_capture_clicked), digit));
+    capture_box.pack_start(button);
+  }
+  my_grid.insert_next_to(clear_button, Gtk::POS_BOTTOM);
+  my_grid.attach_next_to(capture_box, clear_button, Gtk::POS_BOTTOM, 2, 1);
+  capture_box.show_all();
+}
+
+// Only the strokes are copied here, the sample is rasterized and written by
+// the capture thread. The canvas is cleared for the next sample
+void Window::on_capture_clicked(int label) {
+  if (mouse_drawing.strokes().empty()) return;
+  if (!capture_->add(mouse_drawing.vector_snapshot(),
+                     static_cast<uint8_t>(label))) {
+    std::cerr << "Capture queue full, sample dropped" << std::endl;
+    return;
+  }
+  std::cout << "Captured a " << label << std::endl;
+  if (verbose_) {
+    DatasetWriter::Stats stats = capture_->get_stats();
+    std::cout << "Capture written: " << stats.written
+              << ", dropped: " << stats.dropped
+              << ", batches: " << stats.batches << ", syncs: " << stats.syncs
+              << std::endl;
+  }
+  on_clear_clicked();
+}
+
+// Takes a snapshot of the drawing and hands it to the inference worker, the
+// GUI thread only pays for the copy of the canvas
 void Window::on_predict_clicked() {
-  // Save screen to file
   std::cout << "Predict clicked!" << std::endl;
-  // Call inference on NnModel depending on the type
-  // the model expects
-  int number;
-  auto data_type = nn_.get_dtype();
-  switch (data_type) {
-    case kTfLiteFloat32: {
-      std::vector<float> drawing =
-          mouse_drawing.export_to_vector<float>(28, 28, 255.0);
-      std::vector<float> output_vec_f = nn_.infer<float>(drawing);
-      number = get_max_index<float>(output_vec_f);
-      break;
+  mouse_drawing.record_predict();
+  auto start = std::chrono::steady_clock::now();
+  submit_drawing(Clock::now());
+  if (verbose_) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << "GUI thread submit: " << elapsed.count() << " us"
+              << std::endl;
+  }
+}
+
+// Starts or stops the timer that flushes the end of the strokes
+void Window::on_live_toggled() {
+  live_.enabled = live_toggle.get_active();
+  live_timer_.disconnect();
+  live_pending_points_ = 0;
+  if (live_.enabled) {
+    rate_count_ = 0;
+    rate_since_ = Clock::now();
+    live_timer_ = Glib::signal_timeout().connect(
+        sigc::mem_fun(*this, &Window::on_live_timeout),
+        std::max(live_.interval_ms, 10));
+  }
+}
+
+// Keeps track of what has been drawn since the last live submit
+void Window::on_stroke(size_t new_points) {
+  if (!live_.enabled) return;
+  if (live_pending_points_ == 0) live_pending_since_ = Clock::now();
+  live_pending_points_ += new_points;
+  maybe_submit_live(false);
+}
+
+bool Window::on_live_timeout() {
+  maybe_submit_live(true);
+  return true;  // Keep the timer running
+}
+
+// Submits a snapshot once the points or the time trigger fires, while the
+// model is busy the trigger is dropped, the points stay pending and are
+// picked up by the next stroke or timer once the worker is free
+void Window::maybe_submit_live(bool timer) {
+  if (!live_.enabled || live_pending_points_ == 0) return;
+
+  auto now = Clock::now();
+  bool points_ready =
+      live_.min_points > 0 &&
+      live_pending_points_ >= static_cast<size_t>(live_.min_points);
+  bool interval_ready =
+      now - live_last_submit_ >= std::chrono::milliseconds(live_.interval_ms);
+  if (!points_ready && !interval_ready) return;
+
+  if (worker_.busy()) {
+    if (!timer) live_skipped_++;
+    return;
+  }
+
+  submit_drawing(live_pending_since_);
+  live_pending_points_ = 0;
+  live_last_submit_ = now;
+}
+
+// Each worker gets its own copy, the comparison runs both models at once
+void Window::submit_drawing(Clock::time_point origin) {
+  uint64_t content = mouse_drawing.strokes().hash();
+  submit_to(worker_, content, origin);
+  if (compare_worker_) submit_to(*compare_worker_, content, origin);
+}
+
+// A drawing the worker already answered skips the snapshot altogether
+void Window::submit_to(InferenceWorker& worker, uint64_t content,
+                       Clock::time_point origin) {
+  if (worker.submit_cached(content, vector_input_, origin)) return;
+  if (vector_input_) {
+    worker.submit(mouse_drawing.vector_snapshot(), origin, content);
+  } else {
+    worker.submit(mouse_drawing.snapshot(), origin, content);
+  }
+}
+
+// Displays the predicted digit and the latency counters, when comparing each
+// model shows its digit and latency and the live metrics follow the first one
+void Window::on_prediction(const InferenceWorker::Prediction& prediction,
+                           bool compare) {
+  TRACE_SCOPE("gui_update");
+  Gtk::Label& view = compare ? compare_view : text_view;
+  // The canvas was cleared after this snapshot was taken
+  if (prediction.origin < last_clear_) return;
+  if (prediction.number < 0) {
+    view.set_text(max_digits_ ? "Write up to " + std::to_string(max_digits_) +
+                                    " digits"
+                              : "Prediction failed");
+    return;
+  }
+
+  // Below the confidence threshold the drawing is most likely unfinished or
+  // not a digit, the best guesses are still shown. A number has no best
+  // classes, only its digits
+  bool sure = max_digits_ ||
+              prediction.top[0].probability >= models_.min_confidence;
+  std::string result = max_digits_ ? format_digits(prediction.digits)
+                                   : format_top(prediction);
+  std::string display;
+  if (compare_worker_) {
+    const ModelFile& file = compare ? compare_file_ : model_file_;
+    display = model_name(file.path) + (sure ? ": " : " not sure: ") + result +
+              " in " + std::to_string(prediction.invoke.count()) + " us";
+    // Both models answered for the same drawing
+    LastResult& last = last_result_[compare ? 1 : 0];
+    const LastResult& other = last_result_[compare ? 0 : 1];
+    last.origin = prediction.origin;
+    last.number = prediction.number;
+    if (other.origin == last.origin) {
+      compared_++;
+      if (other.number == last.number) agreed_++;
     }
-    case kTfLiteInt8: {
-      std::vector<int8_t> drawing =
-          mouse_drawing.export_to_vector<int8_t>(28, 28, 255.0);
-      std::vector<int8_t> output_vec_int = nn_.infer<int8_t>(drawing);
-      number = get_max_index<int8_t>(output_vec_int);
-      break;
+  } else if (max_digits_) {
+    display = "You wrote: " + result;
+  } else {
+    display = (sure ? "You drew a: " : "Not sure: ") + result;
+  }
+  std::cout << display << std::endl;
+  view.set_text(display);
+
+  if (compare) {
+    if (verbose_) {
+      InferenceWorker::Stats stats = compare_worker_->get_stats();
+      std::cout << "Compared model invoke mean/max: "
+                << stats.invoke.mean().count() << "/"
+                << stats.invoke.max.count() << " us, agreement: " << agreed_
+                << "/" << compared_ << ", cache hits: " << stats.cache_hits
+                << "/" << stats.cache_hits + stats.cache_misses << std::endl;
     }
-    default:
-      std::cerr << "Cannot handle input type: " << std::to_string(data_type)
-                << std::endl;
-      break;
+    return;
   }
 
-  std::string display = "You drew a: " + std::to_string(number);
-  std::cout << display << std::endl;
-  text_view.set_text(display);
+  if (live_.enabled) {
+    auto now = Clock::now();
+    stroke_to_label_.add(std::chrono::duration_cast<std::chrono::microseconds>(
+        now - prediction.origin));
+    rate_count_++;
+    std::chrono::duration<double> elapsed = now - rate_since_;
+    if (elapsed.count() >= 1.0) {
+      predictions_per_second_ = rate_count_ / elapsed.count();
+      rate_count_ = 0;
+      rate_since_ = now;
+    }
+    if (verbose_) {
+      std::cout << "Live: " << predictions_per_second_
+                << " predictions/s, stroke to label mean/max: "
+                << stroke_to_label_.mean().count() << "/"
+                << stroke_to_label_.max.count()
+                << " us, skipped triggers: " << live_skipped_ << std::endl;
+    }
+  }
+
+  if (verbose_) {
+    InferenceWorker::Stats stats = worker_.get_stats();
+    std::cout << "Queue wait: " << prediction.queue_wait.count()
+              << " us, invoke: " << prediction.invoke.count() << " us"
+              << std::endl;
+    std::cout << "Submitted: " << stats.submitted
+              << ", coalesced: " << stats.coalesced
+              << ", queue wait mean/max: " << stats.queue_wait.mean().count()
+              << "/" << stats.queue_wait.max.count()
+              << " us, invoke mean/max: " << stats.invoke.mean().count() << "/"
+              << stats.invoke.max.count() << " us" << std::endl;
+    std::cout << "Cache hits: " << stats.cache_hits << "/"
+              << stats.cache_hits + stats.cache_misses << " ("
+              << 100.0 * stats.hit_rate()
+              << "%), preprocessing reused: " << stats.input_reused
+              << (prediction.cached ? ", this one cached" : "") << std::endl;
+  }
 }
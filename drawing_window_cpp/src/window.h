@@ -6,36 +6,162 @@
 // Definition of a window with a grid containing 2 buttons and a drawing area.
 #pragma once
 
+#include <giomm/filemonitor.h>
+#include <gtkmm/box.h>
 #include <gtkmm/button.h>
+#include <gtkmm/checkbutton.h>
+#include <gtkmm/filechooserbutton.h>
 #include <gtkmm/grid.h>
 #include <gtkmm/label.h>
 #include <gtkmm/window.h>
 
+#include "dataset_writer.h"
+#include "inference_worker.h"
 #include "mouse_drawing.h"
 #include "nn_model.h"
 
+// Options for predicting while the user draws, a prediction is triggered
+// after min_points new points or after interval_ms, whichever comes first
+struct LivePredictConfig {
+  bool enabled = false;
+  int interval_ms = 100;
+  int min_points = 0;  // 0 disables the points trigger
+};
+
+// Models of the window, each one can be replaced at runtime from its
+// selector or, with watch, whenever its file is replaced. With a
+// compare_path a second model predicts every drawing next to the first one
+struct ModelSwapConfig {
+  std::string path;
+  std::string compare_path;  // Empty to run a single model
+  NnModelOptions options;    // Used to load every model
+  bool watch = false;
+  // Predictions whose best class is less likely are shown as not sure
+  float min_confidence = 0.0f;
+};
+
 // Window used to keep all the widgets
 // it contains a grid widget that houses
 // 2 buttons
 // 1 drawing area
-// 1 text area
+// 1 text area, 2 side by side when comparing models
+// 1 check button to toggle live prediction
+// 1 model selector per model
 class Window : public Gtk::Window {
  public:
-  Window(NnModel &nn);
+  // The model may still be loading when the window is created
+  Window(std::shared_future<std::shared_ptr<NnModel>> model,
+         const ModelSwapConfig &models, bool verbose,
+         const LivePredictConfig &live, Preprocessing preprocessing,
+         bool vector_input, size_t max_digits = 0);
   virtual ~Window();
 
+  /// Records the drawing session to path, see session_recording.h
+  void record_session(const char *path);
+  /// Adds a row of digit buttons that save the drawing with that label to
+  /// the IDX files of prefix, see dataset_writer.h. Throws if the files
+  /// cannot be opened
+  void capture_dataset(const std::string &prefix);
+
  protected:
   // Signal handlers:
   void on_clear_clicked();
   void on_predict_clicked();
+  void on_live_toggled();
+  // A digit of the capture row was clicked
+  void on_capture_clicked(int label);
+  // Called whenever new points are drawn
+  void on_stroke(size_t new_points);
+  // Periodic check so the end of a stroke is predicted once the model is free
+  bool on_live_timeout();
+  // Called on the GUI thread once a worker has a result, compare is set for
+  // the second model
+  void on_prediction(const InferenceWorker::Prediction &prediction,
+                     bool compare);
+  // Called once a model is loaded and warmed up, at startup and after a swap
+  void on_model_ready(bool ok, bool compare);
+  // A model was picked in a selector
+  void on_model_selected(bool compare);
+  // A watched model file changed
+  void on_model_file_changed(const Glib::RefPtr<Gio::File> &file,
+                             const Glib::RefPtr<Gio::File> &other,
+                             Gio::FileMonitorEvent event, bool compare);
+  // Called the first time the window is shown
+  bool on_map_event(GdkEventAny *event) override;
 
   // Child widgets:
   Gtk::Grid my_grid;
   MouseDrawing mouse_drawing;
   Gtk::Button clear_button, predict_button;
-  Gtk::Label text_view;
+  Gtk::Label text_view, compare_view;
+  Gtk::CheckButton live_toggle;
+  Gtk::FileChooserButton model_chooser, compare_chooser;
+  Gtk::Box capture_box;
+  Gtk::Button capture_buttons[10];
 
  private:
-  // Reference to TFlite Neural Network Model
-  NnModel &nn_;
+  using Clock = InferenceWorker::Clock;
+  // Verbosity flag
+  bool verbose_;
+  // Runs the inference away from the GTK main loop
+  InferenceWorker worker_;
+  // Second model of the comparison, null with a single model
+  std::unique_ptr<InferenceWorker> compare_worker_;
+
+  // Model file of each side, the one in use and the one being loaded
+  struct ModelFile {
+    std::string path;
+    std::string loading;
+    Glib::RefPtr<Gio::FileMonitor> monitor;
+  };
+  ModelSwapConfig models_;
+  ModelFile model_file_, compare_file_;
+  // Loads path in the background to replace the model of one side
+  void swap_model(bool compare, const std::string &path);
+  // Watches the file of one side if models_.watch is set
+  void watch_model(bool compare);
+  // Last result of each side, a pair with the same origin is compared
+  struct LastResult {
+    Clock::time_point origin;
+    int number = -1;
+  };
+  LastResult last_result_[2];
+  uint64_t compared_ = 0;
+  uint64_t agreed_ = 0;
+
+  // Submits a live prediction if enough has been drawn and the model is free
+  void maybe_submit_live(bool timer);
+  // Hands a copy of the drawing to the worker, the strokes with vector_input_
+  // and the rendered canvas otherwise
+  void submit_drawing(Clock::time_point origin);
+  // Same for one worker, answered from its cache if the drawing is unchanged
+  void submit_to(InferenceWorker &worker, uint64_t content,
+                 Clock::time_point origin);
+  // Predict from the strokes instead of the rendered canvas
+  bool vector_input_;
+  // Longest number read from a wide canvas, 0 for a single digit
+  size_t max_digits_;
+  // Labeled drawings saved for training, null unless capturing
+  std::unique_ptr<DatasetWriter> capture_;
+
+  // The startup report is printed once the window is shown and the model is
+  // ready, whichever comes last
+  bool mapped_ = false;
+  bool model_ready_ = false;
+
+  LivePredictConfig live_;
+  sigc::connection live_timer_;
+  // Points drawn since the last live submit and when the first of them was
+  // drawn, used as origin for the stroke to label latency
+  size_t live_pending_points_ = 0;
+  Clock::time_point live_pending_since_;
+  Clock::time_point live_last_submit_;
+  // Results for snapshots taken before the last clear are discarded
+  Clock::time_point last_clear_;
+  // Live prediction metrics
+  uint64_t live_skipped_ = 0;  // Triggers dropped because the model was busy
+  LatencyCounter stroke_to_label_;
+  uint64_t rate_count_ = 0;
+  Clock::time_point rate_since_;
+  double predictions_per_second_ = 0.0;
 };
@@ -0,0 +1,176 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks of the dataset capture, the IDX files it writes, appending over
+// several sessions and the recovery of a pair of files cut short by a crash.
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "dataset_writer.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr size_t kImageBytes = DatasetWriter::kSize * DatasetWriter::kSize;
+constexpr size_t kImagesHeader = 16;
+constexpr size_t kLabelsHeader = 8;
+
+std::vector<uint8_t> read_file(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>()};
+}
+
+void write_file(const std::string &path, const std::vector<uint8_t> &bytes) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+uint32_t get_be32(const std::vector<uint8_t> &bytes, size_t offset) {
+  return (uint32_t(bytes[offset]) << 24) | (uint32_t(bytes[offset + 1]) << 16) |
+         (uint32_t(bytes[offset + 2]) << 8) | uint32_t(bytes[offset + 3]);
+}
+
+void put_be32(std::vector<uint8_t> &bytes, size_t offset, uint32_t value) {
+  bytes[offset] = value >> 24;
+  bytes[offset + 1] = value >> 16;
+  bytes[offset + 2] = value >> 8;
+  bytes[offset + 3] = value;
+}
+
+// A stroke that depends on the label so every image differs
+VectorCanvas drawing(uint8_t label) {
+  VectorCanvas canvas;
+  canvas.width = canvas.height = 250;
+  canvas.brush = 10.0;
+  canvas.strokes.begin_stroke(60, 40, 0);
+  canvas.strokes.add_point(120 + 10 * label, 200, 16);
+  return canvas;
+}
+
+// Checks the headers of the pair and that they hold count samples with the
+// labels
+void check_files(const std::string &prefix,
+                 const std::vector<uint8_t> &labels) {
+  const uint32_t count = static_cast<uint32_t>(labels.size());
+  std::vector<uint8_t> images = read_file(prefix + "-images-idx3-ubyte");
+  std::vector<uint8_t> label_file = read_file(prefix + "-labels-idx1-ubyte");
+  CHECK_EQ(images.size(), kImagesHeader + count * kImageBytes);
+  CHECK_EQ(label_file.size(), kLabelsHeader + count);
+  if (images.size() < kImagesHeader || label_file.size() < kLabelsHeader) {
+    return;
+  }
+  CHECK_EQ(get_be32(images, 0), 0x00000803u);
+  CHECK_EQ(get_be32(images, 4), count);
+  CHECK_EQ(get_be32(images, 8), 28u);
+  CHECK_EQ(get_be32(images, 12), 28u);
+  CHECK_EQ(get_be32(label_file, 0), 0x00000801u);
+  CHECK_EQ(get_be32(label_file, 4), count);
+  CHECK(std::equal(labels.begin(), labels.end(),
+                   label_file.begin() + kLabelsHeader,
+                   label_file.begin() + label_file.size()));
+}
+
+// Sum of the ink of sample index of the images file
+uint64_t ink(const std::vector<uint8_t> &images, size_t index) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < kImageBytes; i++) {
+    sum += images[kImagesHeader + index * kImageBytes + i];
+  }
+  return sum;
+}
+
+void check_sessions(const std::string &prefix) {
+  const std::string images_path = prefix + "-images-idx3-ubyte";
+  const std::string labels_path = prefix + "-labels-idx1-ubyte";
+  {
+    DatasetWriter writer(prefix);
+    for (uint8_t label : {1, 2, 3}) CHECK(writer.add(drawing(label), label));
+  }
+  check_files(prefix, {1, 2, 3});
+  const std::vector<uint8_t> first = read_file(images_path);
+  for (size_t i = 0; i < 3; i++) CHECK(ink(first, i) > 0);
+
+  // A second session appends, the first samples stay as they were
+  {
+    DatasetWriter writer(prefix);
+    CHECK_EQ(writer.get_stats().written, 3u);
+    for (uint8_t label : {4, 5}) CHECK(writer.add(drawing(label), label));
+  }
+  check_files(prefix, {1, 2, 3, 4, 5});
+  std::vector<uint8_t> images = read_file(images_path);
+  CHECK(std::equal(first.begin() + kImagesHeader, first.end(),
+                   images.begin() + kImagesHeader));
+
+  // A crash left the last image half written, and the labels header counts
+  // samples that are not there. Both are cut to the 4 complete samples
+  images.resize(kImagesHeader + 4 * kImageBytes + kImageBytes / 2);
+  write_file(images_path, images);
+  std::vector<uint8_t> labels = read_file(labels_path);
+  put_be32(labels, 4, 7);
+  write_file(labels_path, labels);
+  {
+    DatasetWriter writer(prefix);
+    CHECK_EQ(writer.get_stats().written, 4u);
+  }
+  check_files(prefix, {1, 2, 3, 4});
+  std::vector<uint8_t> trimmed = read_file(images_path);
+  CHECK(std::equal(trimmed.begin() + kImagesHeader, trimmed.end(),
+                   images.begin() + kImagesHeader));
+
+  // The count of a header is also clamped when it is the smaller one
+  labels = read_file(labels_path);
+  put_be32(labels, 4, 2);
+  write_file(labels_path, labels);
+  { DatasetWriter writer(prefix); }
+  check_files(prefix, {1, 2});
+}
+
+// Files of another size are refused and left as they were
+void check_bad_header(const std::string &prefix) {
+  std::vector<uint8_t> images(kImagesHeader + 32 * 32, 0);
+  images[2] = 0x08;
+  images[3] = 3;
+  put_be32(images, 4, 1);
+  put_be32(images, 8, 32);
+  put_be32(images, 12, 32);
+  write_file(prefix + "-images-idx3-ubyte", images);
+  bool thrown = false;
+  try {
+    DatasetWriter writer(prefix);
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  CHECK(read_file(prefix + "-images-idx3-ubyte") == images);
+}
+
+}  // namespace
+
+int main() {
+  char dir[] = "/tmp/dataset_writer_testXXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    std::cerr << "Unable to create a temporary directory" << std::endl;
+    return 1;
+  }
+  const std::string base = dir;
+  check_sessions(base + "/captured");
+  check_bad_header(base + "/other");
+  for (const char *name :
+       {"/captured-images-idx3-ubyte", "/captured-labels-idx1-ubyte",
+        "/other-images-idx3-ubyte", "/other-labels-idx1-ubyte"}) {
+    unlink((base + name).c_str());
+  }
+  rmdir(dir);
+  return test_result("dataset_writer_test");
+}
@@ -0,0 +1,138 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks of the segmentation of a number into digits, the union-find
+// labeling, the merge of components sharing columns, the specks and the crop
+// of one digit, and of the value of the digits read.
+#include <cstdint>
+#include <vector>
+
+#include "digit_segmenter.h"
+#include "number_reader.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr int kWidth = 200;
+constexpr int kHeight = 80;
+
+// Black ARGB32 canvas, stored as BGRA like Cairo, with white ink
+struct Canvas {
+  std::vector<uint8_t> argb = std::vector<uint8_t>(kWidth * kHeight * 4, 0);
+
+  // Inks the pixels from x0, y0 to x1, y1 exclusive
+  void fill(int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+      for (int x = x0; x < x1; x++) {
+        uint8_t *pixel = &argb[(y * kWidth + x) * 4];
+        pixel[0] = pixel[1] = pixel[2] = pixel[3] = 255;
+      }
+    }
+  }
+
+  size_t run(DigitSegmenter &segmenter) const {
+    return segmenter.run(argb.data(), kWidth, kHeight, kWidth * 4);
+  }
+};
+
+void check_box(const DigitBox &box, int x0, int y0, int x1, int y1) {
+  CHECK_EQ(box.x0, x0);
+  CHECK_EQ(box.y0, y0);
+  CHECK_EQ(box.x1, x1);
+  CHECK_EQ(box.y1, y1);
+}
+
+// The arms get their own labels and only meet on the last rows
+void check_u() {
+  Canvas canvas;
+  canvas.fill(10, 10, 14, 50);
+  canvas.fill(40, 10, 44, 50);
+  canvas.fill(10, 46, 44, 50);
+  DigitSegmenter segmenter;
+  CHECK_EQ(canvas.run(segmenter), 1u);
+  check_box(segmenter.digits()[0], 10, 10, 44, 50);
+  // Every pixel is counted once, the bottom overlaps the arms
+  const uint64_t pixels = 2 * 4 * 40 + 26 * 4;
+  CHECK_EQ(segmenter.digits()[0].mass, pixels * 255);
+}
+
+// The bar of a 5 drawn apart from the body is the same digit
+void check_detached_bar() {
+  Canvas canvas;
+  canvas.fill(22, 10, 55, 14);
+  canvas.fill(20, 30, 50, 70);
+  DigitSegmenter segmenter;
+  CHECK_EQ(canvas.run(segmenter), 1u);
+  check_box(segmenter.digits()[0], 20, 10, 55, 70);
+}
+
+// The right digit starts higher so it is labeled first, the digits still
+// come left to right
+void check_two_digits() {
+  Canvas canvas;
+  canvas.fill(10, 20, 30, 70);
+  canvas.fill(80, 5, 100, 60);
+  DigitSegmenter segmenter;
+  CHECK_EQ(canvas.run(segmenter), 2u);
+  check_box(segmenter.digits()[0], 10, 20, 30, 70);
+  check_box(segmenter.digits()[1], 80, 5, 100, 60);
+
+  // Nothing drawn, no digits
+  CHECK_EQ(Canvas().run(segmenter), 0u);
+  CHECK(segmenter.digits().empty());
+}
+
+void check_speck() {
+  Canvas canvas;
+  canvas.fill(20, 20, 50, 60);
+  canvas.fill(150, 40, 152, 42);
+  DigitSegmenter segmenter;
+  CHECK_EQ(canvas.run(segmenter), 1u);
+  check_box(segmenter.digits()[0], 20, 20, 50, 60);
+}
+
+// The foot of the first digit reaches under the second one, which shares too
+// few columns to be merged, its ink is blanked from the crop of the first
+void check_crop() {
+  Canvas canvas;
+  canvas.fill(10, 0, 20, 44);
+  canvas.fill(10, 40, 40, 44);
+  canvas.fill(37, 0, 47, 30);
+  DigitSegmenter segmenter;
+  CHECK_EQ(canvas.run(segmenter), 2u);
+  check_box(segmenter.digits()[0], 10, 0, 40, 44);
+  check_box(segmenter.digits()[1], 37, 0, 47, 30);
+
+  const int width = 30;
+  const uint8_t *first = segmenter.crop(0);
+  for (int y = 0; y < 44; y++) {
+    for (int x = 10; x < 40; x++) {
+      bool own = x < 20 || y >= 40;
+      CHECK_EQ(first[y * width + (x - 10)], own ? 255 : 0);
+    }
+  }
+  const uint8_t *second = segmenter.crop(1);
+  for (int i = 0; i < 10 * 30; i++) CHECK_EQ(second[i], 255);
+}
+
+void check_number_value() {
+  CHECK_EQ(number_value({}), -1);
+  CHECK_EQ(number_value({7}), 7);
+  CHECK_EQ(number_value({4, 2}), 42);
+  CHECK_EQ(number_value({0, 7}), 7);
+  CHECK_EQ(number_value({9, 9, 9, 9, 9, 9, 9, 9, 9}), 999999999);
+}
+
+}  // namespace
+
+int main() {
+  check_u();
+  check_detached_bar();
+  check_two_digits();
+  check_speck();
+  check_crop();
+  check_number_value();
+  return test_result("digit_segmenter_test");
+}
@@ -0,0 +1,125 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks that GrayDownscaler matches the Cairo scaling it replaced within
+// one gray level on the drawings the window produces.
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "drawing_canvas.h"
+#include "preprocessing.h"
+#include "strokes.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr int kCanvasSize = 250;
+constexpr double kBrushSize = 10.0;
+
+// Former export_to_vector, Cairo scales the canvas and the luminance is
+// computed in floating point per pixel
+std::vector<uint8_t> cairo_reference(
+    const Cairo::RefPtr<Cairo::ImageSurface> &canvas, int w, int h) {
+  auto scaled = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, w, h);
+  auto cr = Cairo::Context::create(scaled);
+  cr->scale(static_cast<double>(w) / canvas->get_width(),
+            static_cast<double>(h) / canvas->get_height());
+  cr->set_source(Cairo::SurfacePattern::create(canvas));
+  cr->paint();
+  scaled->flush();
+
+  const uint8_t *data = scaled->get_data();
+  int stride = scaled->get_stride();
+  std::vector<uint8_t> pixels(w * h);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      const uint8_t *pixel = data + y * stride + x * 4;
+      pixels[y * w + x] = static_cast<uint8_t>(
+          0.2126 * pixel[2] + 0.7152 * pixel[1] + 0.0722 * pixel[0]);
+    }
+  }
+  return pixels;
+}
+
+// Black canvas with the strokes drawn like the window does
+Cairo::RefPtr<Cairo::ImageSurface> make_canvas(const StrokeSet &strokes) {
+  auto canvas = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, kCanvasSize,
+                                            kCanvasSize);
+  auto cr = Cairo::Context::create(canvas);
+  cr->set_source_rgb(0.0, 0.0, 0.0);
+  cr->paint();
+  cr->set_source_rgb(1.0, 1.0, 1.0);
+  DrawingCanvas::draw_points(cr, strokes, 0, kBrushSize);
+  canvas->flush();
+  return canvas;
+}
+
+// Drawings of the kind the model sees: a zero, a seven, a dot and random
+// scribbles over the whole canvas
+std::vector<StrokeSet> make_drawings() {
+  std::vector<StrokeSet> drawings;
+  StrokeSet zero;
+  for (int i = 0; i < 130; i++) {
+    double angle = 0.05 * i;
+    zero.add_point(kCanvasSize / 2 + 60 * std::cos(angle),
+                   kCanvasSize / 2 + 90 * std::sin(angle), i * 16);
+  }
+  drawings.push_back(zero);
+
+  StrokeSet seven;
+  seven.begin_stroke(60, 50, 0);
+  seven.add_point(190, 50, 100);
+  seven.add_point(110, 210, 200);
+  seven.begin_stroke(90, 130, 300);
+  seven.add_point(160, 130, 400);
+  drawings.push_back(seven);
+
+  StrokeSet dot;
+  dot.begin_stroke(101.5, 77.25, 0);
+  drawings.push_back(dot);
+
+  std::srand(7);
+  StrokeSet scribble;
+  for (int i = 0; i < 60; i++) {
+    float x = static_cast<float>(std::rand() % kCanvasSize);
+    float y = static_cast<float>(std::rand() % kCanvasSize);
+    if (i % 12 == 0)
+      scribble.begin_stroke(x, y, i * 16);
+    else
+      scribble.add_point(x, y, i * 16);
+  }
+  drawings.push_back(scribble);
+  return drawings;
+}
+
+}  // namespace
+
+int main() {
+  int max_difference = 0;
+  for (const StrokeSet &strokes : make_drawings()) {
+    auto canvas = make_canvas(strokes);
+    // The usual model sizes and a smaller one
+    for (int size : {28, 32, 20}) {
+      std::vector<uint8_t> reference = cairo_reference(canvas, size, size);
+      GrayDownscaler downscaler(kCanvasSize, kCanvasSize, size, size);
+      std::vector<uint8_t> out(size * size);
+      downscaler.run(canvas->get_data(), canvas->get_stride(), out.data());
+      int worst = 0;
+      for (size_t i = 0; i < out.size(); i++)
+        worst = std::max(worst, std::abs(out[i] - reference[i]));
+      CHECK(worst <= 1);
+      max_difference = std::max(max_difference, worst);
+    }
+  }
+  std::cout << "Largest difference with the Cairo scaling: " << max_difference
+            << std::endl;
+  return test_result("downscale_cairo_test");
+}
@@ -0,0 +1,168 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks of the incremental rasterization of DrawingCanvas, the damaged area
+// covers the new segment and the brush, and nothing outside of it changes.
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "drawing_canvas.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr int kSize = 250;
+constexpr double kBrush = 10.0;
+
+// Copy of the pixels of the canvas, one uint32_t per ARGB32 pixel
+std::vector<uint32_t> pixels(const DrawingCanvas &canvas) {
+  const auto &surface = canvas.surface();
+  surface->flush();
+  std::vector<uint32_t> copy(kSize * kSize);
+  for (int y = 0; y < kSize; y++) {
+    std::memcpy(&copy[y * kSize],
+                surface->get_data() + y * surface->get_stride(),
+                kSize * sizeof(uint32_t));
+  }
+  return copy;
+}
+
+bool inside(const CanvasRect &rect, int x, int y) {
+  return x >= rect.x && x < rect.x + rect.width && y >= rect.y &&
+         y < rect.y + rect.height;
+}
+
+// Bounding box of the pixels that differ, empty if none
+CanvasRect changed(const std::vector<uint32_t> &before,
+                   const std::vector<uint32_t> &after) {
+  int x0 = kSize, y0 = kSize, x1 = 0, y1 = 0;
+  for (int y = 0; y < kSize; y++) {
+    for (int x = 0; x < kSize; x++) {
+      if (before[y * kSize + x] == after[y * kSize + x]) continue;
+      x0 = std::min(x0, x);
+      y0 = std::min(y0, y);
+      x1 = std::max(x1, x + 1);
+      y1 = std::max(y1, y + 1);
+    }
+  }
+  if (x1 == 0) return {};
+  return {x0, y0, x1 - x0, y1 - y0};
+}
+
+// Bounding box of the ink of a stroke through the points drawn alone on a
+// black canvas
+CanvasRect ink(const std::vector<std::pair<double, double>> &points) {
+  DrawingCanvas canvas(kSize, kSize, kBrush);
+  const std::vector<uint32_t> black = pixels(canvas);
+  canvas.press(points[0].first, points[0].second, 0);
+  for (size_t i = 1; i < points.size(); i++) {
+    canvas.move(points[i].first, points[i].second, 0);
+  }
+  CanvasRect damage;
+  canvas.rasterize_pending(damage);
+  return changed(black, pixels(canvas));
+}
+
+// Checks that the damage covers the ink of the new segments, with the brush,
+// and at most the pixel of anti-aliasing on each side, and that no pixel
+// outside of it changed
+void check_damage(const CanvasRect &damage, const CanvasRect &segments,
+                  const std::vector<uint32_t> &before,
+                  const std::vector<uint32_t> &after) {
+  CHECK(segments.width > 0);
+  CHECK(inside(damage, segments.x, segments.y));
+  CHECK(inside(damage, segments.x + segments.width - 1,
+               segments.y + segments.height - 1));
+  CHECK(segments.x - damage.x <= 2);
+  CHECK(segments.y - damage.y <= 2);
+  CHECK(damage.x + damage.width - (segments.x + segments.width) <= 2);
+  CHECK(damage.y + damage.height - (segments.y + segments.height) <= 2);
+  int outside = 0;
+  for (int y = 0; y < kSize; y++) {
+    for (int x = 0; x < kSize; x++) {
+      if (inside(damage, x, y)) continue;
+      if (before[y * kSize + x] != after[y * kSize + x]) outside++;
+    }
+  }
+  CHECK_EQ(outside, 0);
+}
+
+void check_rasterize_pending() {
+  DrawingCanvas canvas(kSize, kSize, kBrush);
+  CanvasRect damage;
+  CHECK_EQ(canvas.rasterize_pending(damage), 0u);
+  CHECK(!canvas.move(10, 10, 0));
+
+  // A press is a dot, the brush around the point plus a pixel
+  std::vector<uint32_t> before = pixels(canvas);
+  canvas.press(100, 100, 0);
+  CHECK_EQ(canvas.rasterize_pending(damage), 1u);
+  CHECK_EQ(damage.x, 89);
+  CHECK_EQ(damage.y, 89);
+  CHECK_EQ(damage.width, 22);
+  CHECK_EQ(damage.height, 22);
+  std::vector<uint32_t> after = pixels(canvas);
+  check_damage(damage, ink({{100, 100}}), before, after);
+
+  // A move only damages its segment, from the previous point to the new one,
+  // not the rest of the stroke
+  before = after;
+  canvas.move(120, 110, 16);
+  CHECK_EQ(canvas.rasterize_pending(damage), 1u);
+  CHECK_EQ(damage.x, 89);
+  CHECK_EQ(damage.y, 89);
+  CHECK_EQ(damage.width, 42);
+  CHECK_EQ(damage.height, 32);
+  after = pixels(canvas);
+  check_damage(damage, ink({{100, 100}, {120, 110}}), before, after);
+
+  before = after;
+  canvas.move(180, 200, 32);
+  CHECK_EQ(canvas.rasterize_pending(damage), 1u);
+  CHECK_EQ(damage.x, 109);
+  CHECK_EQ(damage.y, 99);
+  CHECK_EQ(damage.width, 82);
+  CHECK_EQ(damage.height, 112);
+  after = pixels(canvas);
+  check_damage(damage, ink({{120, 110}, {180, 200}}), before, after);
+
+  // Nothing new, nothing drawn
+  CHECK_EQ(canvas.rasterize_pending(damage), 0u);
+
+  // A new stroke is not joined to the previous one, its damage is its dot
+  canvas.release();
+  CHECK(!canvas.move(30, 30, 48));
+  before = after;
+  canvas.press(40, 200, 64);
+  CHECK_EQ(canvas.rasterize_pending(damage), 1u);
+  CHECK_EQ(damage.x, 29);
+  CHECK_EQ(damage.y, 189);
+  CHECK_EQ(damage.width, 22);
+  CHECK_EQ(damage.height, 22);
+  after = pixels(canvas);
+  check_damage(damage, ink({{40, 200}}), before, after);
+
+  // Several moves between frames are damaged together
+  before = after;
+  canvas.move(60, 190, 80);
+  canvas.move(70, 220, 96);
+  CHECK_EQ(canvas.rasterize_pending(damage), 2u);
+  CHECK_EQ(damage.x, 29);
+  CHECK_EQ(damage.y, 179);
+  CHECK_EQ(damage.width, 52);
+  CHECK_EQ(damage.height, 52);
+  after = pixels(canvas);
+  check_damage(damage, ink({{40, 200}, {60, 190}, {70, 220}}), before, after);
+}
+
+}  // namespace
+
+int main() {
+  check_rasterize_pending();
+  return test_result("drawing_canvas_test");
+}
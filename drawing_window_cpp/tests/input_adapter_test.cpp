@@ -0,0 +1,225 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks every kernel of InputAdapter, for every type, layout, channel count,
+// size and preprocessing, against the preprocessing run on its own into a
+// gray image that a plain loop quantizes and spreads over the channels.
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "input_adapter.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr int kCanvasSize = 250;
+constexpr double kBrushSize = 10.0;
+
+const char *type_name(InputType type) {
+  switch (type) {
+    case InputType::float32:
+      return "float";
+    case InputType::int8:
+      return "int8";
+    default:
+      return "uint8";
+  }
+}
+
+const char *preprocessing_name(Preprocessing preprocessing) {
+  return preprocessing == Preprocessing::mnist ? "mnist" : "downscale";
+}
+
+// Sources shared by every combination: strokes of a four, the ARGB32 canvas
+// they give with a slight tint so the luminance weights matter, and the
+// same canvas as a gray image
+struct Sources {
+  Sources()
+      : argb(kCanvasSize * kCanvasSize * 4),
+        gray(kCanvasSize * kCanvasSize) {
+    canvas.width = kCanvasSize;
+    canvas.height = kCanvasSize;
+    canvas.brush = kBrushSize;
+    canvas.strokes.begin_stroke(150, 40, 0);
+    canvas.strokes.add_point(70, 150, 16);
+    canvas.strokes.add_point(190, 150, 32);
+    canvas.strokes.begin_stroke(160, 90, 48);
+    canvas.strokes.add_point(160, 220, 64);
+
+    StrokeRasterizer rasterizer;
+    const InputLut<uint8_t> identity = make_input_lut<uint8_t>(0.0f, 0);
+    rasterizer.run<uint8_t>(canvas.strokes, kBrushSize, kCanvasSize,
+                            kCanvasSize, kCanvasSize, kCanvasSize, gray.data(),
+                            identity);
+    for (size_t i = 0; i < gray.size(); i++) {
+      argb[i * 4 + 0] = gray[i];
+      argb[i * 4 + 1] = static_cast<uint8_t>(gray[i] * 7 / 8);
+      argb[i * 4 + 2] = static_cast<uint8_t>(gray[i] / 2);
+      argb[i * 4 + 3] = 255;
+    }
+  }
+
+  VectorCanvas canvas;
+  std::vector<uint8_t> argb;
+  std::vector<uint8_t> gray;
+};
+
+// Quantizes the gray image and spreads it over the channels in the layout of
+// the spec with a plain loop
+template <typename T>
+std::vector<T> spread(const InputSpec &spec,
+                      const std::vector<uint8_t> &gray) {
+  const InputLut<T> lut =
+      make_input_lut<T>(spec.quant.scale, spec.quant.zero_point);
+  const size_t n = gray.size();
+  std::vector<T> expected(spec.elements());
+  for (int c = 0; c < spec.channels; c++) {
+    for (size_t i = 0; i < n; i++) {
+      size_t index = spec.layout == TensorLayout::nhwc ? i * spec.channels + c
+                                                       : c * n + i;
+      expected[index] = lut[gray[i]];
+    }
+  }
+  return expected;
+}
+
+// Compares the bytes so a float kernel has to match exactly too
+template <typename T>
+void check_same(const std::vector<T> &input, const std::vector<T> &expected,
+                const InputSpec &spec, Preprocessing preprocessing,
+                const char *path) {
+  bool same = input.size() == expected.size() &&
+              std::memcmp(input.data(), expected.data(),
+                          input.size() * sizeof(T)) == 0;
+  if (!same) {
+    std::cerr << path << " differs from the reference: "
+              << type_name(spec.type) << " " << layout_name(spec.layout)
+              << " " << spec.channels << " channels " << spec.width << "x"
+              << spec.height << " " << preprocessing_name(preprocessing)
+              << std::endl;
+  }
+  CHECK(same);
+}
+
+template <typename T>
+void check_kernels(const Sources &sources, const InputSpec &spec,
+                   Preprocessing preprocessing) {
+  const int side = spec.width;
+  const InputLut<uint8_t> identity = make_input_lut<uint8_t>(0.0f, 0);
+  InputAdapter adapter(spec, preprocessing);
+  CHECK(adapter.valid());
+  CHECK_EQ(adapter.bytes(), spec.elements() * sizeof(T));
+  // Filled with garbage so an element the kernel skips is noticed
+  std::vector<T> input(spec.elements());
+  std::vector<uint8_t> gray(side * side);
+
+  // ARGB32 canvas
+  std::memset(input.data(), 0x5a, input.size() * sizeof(T));
+  adapter.write_image(sources.argb.data(), kCanvasSize, kCanvasSize,
+                      kCanvasSize * 4, input.data());
+  if (preprocessing == Preprocessing::mnist) {
+    DigitNormalizer normalizer;
+    normalizer.run<uint8_t>(sources.argb.data(), kCanvasSize, kCanvasSize,
+                            kCanvasSize * 4, gray.data(), identity, side,
+                            side);
+  } else {
+    GrayDownscaler downscaler(kCanvasSize, kCanvasSize, side, side);
+    downscaler.run(sources.argb.data(), kCanvasSize * 4, gray.data());
+  }
+  check_same(input, spread<T>(spec, gray), spec, preprocessing,
+             "write_image");
+
+  // Strokes
+  std::memset(input.data(), 0x5a, input.size() * sizeof(T));
+  adapter.write_vector(sources.canvas, input.data());
+  StrokeRasterizer rasterizer;
+  if (preprocessing == Preprocessing::mnist) {
+    rasterizer.run_normalized<uint8_t>(sources.canvas.strokes, kBrushSize,
+                                       gray.data(), identity, side, side);
+  } else {
+    rasterizer.run<uint8_t>(sources.canvas.strokes, kBrushSize, kCanvasSize,
+                            kCanvasSize, side, side, gray.data(), identity);
+  }
+  check_same(input, spread<T>(spec, gray), spec, preprocessing,
+             "write_vector");
+
+  // Gray image larger than the input, downscaled whatever the preprocessing
+  std::memset(input.data(), 0x5a, input.size() * sizeof(T));
+  adapter.write_gray(sources.gray.data(), kCanvasSize, kCanvasSize,
+                     kCanvasSize, input.data());
+  GrayDownscaler gray_downscaler(kCanvasSize, kCanvasSize, side, side);
+  gray_downscaler.run_gray<uint8_t>(sources.gray.data(), kCanvasSize,
+                                    gray.data(), identity);
+  check_same(input, spread<T>(spec, gray), spec, preprocessing,
+             "write_gray");
+
+  // Gray image of the input size with a padded stride, only quantized
+  const int stride = side + 3;
+  std::vector<uint8_t> small(stride * side, 0);
+  for (int y = 0; y < side; y++)
+    for (int x = 0; x < side; x++)
+      small[y * stride + x] = static_cast<uint8_t>((x * 9 + y * 5) & 0xff);
+  for (int y = 0; y < side; y++)
+    std::memcpy(gray.data() + y * side, small.data() + y * stride, side);
+  std::memset(input.data(), 0x5a, input.size() * sizeof(T));
+  adapter.write_gray(small.data(), side, side, stride, input.data());
+  check_same(input, spread<T>(spec, gray), spec, preprocessing,
+             "write_gray same size");
+
+  // Digit cut out of a wider drawing, always normalized
+  std::memset(input.data(), 0x5a, input.size() * sizeof(T));
+  adapter.write_digit(sources.gray.data(), kCanvasSize, kCanvasSize,
+                      kCanvasSize, input.data());
+  DigitNormalizer digit_normalizer;
+  digit_normalizer.run_gray<uint8_t>(sources.gray.data(), kCanvasSize,
+                                     kCanvasSize, kCanvasSize, gray.data(),
+                                     identity, side, side);
+  check_same(input, spread<T>(spec, gray), spec, preprocessing,
+             "write_digit");
+}
+
+}  // namespace
+
+int main() {
+  const Sources sources;
+  int combinations = 0;
+  for (InputType type :
+       {InputType::float32, InputType::int8, InputType::uint8}) {
+    for (TensorLayout layout : {TensorLayout::nhwc, TensorLayout::nchw}) {
+      for (int channels : {1, 3}) {
+        // The two sizes with fixed kernels and one that takes the generic one
+        for (int side : {28, 32, 40}) {
+          for (Preprocessing preprocessing :
+               {Preprocessing::downscale, Preprocessing::mnist}) {
+            InputSpec spec;
+            spec.type = type;
+            spec.layout = layout;
+            spec.channels = channels;
+            spec.width = spec.height = side;
+            // Quantization of a typical full range export
+            if (type == InputType::int8) spec.quant = {1.0f / 255.0f, -128};
+            if (type == InputType::uint8) spec.quant = {1.0f / 255.0f, 0};
+            switch (type) {
+              case InputType::float32:
+                check_kernels<float>(sources, spec, preprocessing);
+                break;
+              case InputType::int8:
+                check_kernels<int8_t>(sources, spec, preprocessing);
+                break;
+              default:
+                check_kernels<uint8_t>(sources, spec, preprocessing);
+                break;
+            }
+            combinations++;
+          }
+        }
+      }
+    }
+  }
+  std::cout << combinations << " combinations checked" << std::endl;
+  return test_result("input_adapter_test");
+}
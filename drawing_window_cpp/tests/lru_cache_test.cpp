@@ -0,0 +1,74 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks of the LRU cache of the predictions, the eviction order, a find
+// refreshing its entry and clear.
+#include <string>
+
+#include "lru_cache.h"
+#include "test_check.h"
+
+namespace {
+
+// Value of key, -1 if it is not cached
+int value_of(LruCache<int, int> &cache, int key) {
+  const int *value = cache.find(key);
+  return value ? *value : -1;
+}
+
+void check_eviction() {
+  LruCache<int, int> cache(3);
+  cache.insert(1, 10);
+  cache.insert(2, 20);
+  cache.insert(3, 30);
+  CHECK_EQ(cache.size(), 3u);
+
+  // The least recently inserted goes first
+  cache.insert(4, 40);
+  CHECK_EQ(cache.size(), 3u);
+  CHECK_EQ(value_of(cache, 1), -1);
+
+  // A find makes 2 the most recent, so 3 is evicted next
+  CHECK_EQ(value_of(cache, 2), 20);
+  cache.insert(5, 50);
+  CHECK_EQ(value_of(cache, 3), -1);
+  CHECK_EQ(value_of(cache, 2), 20);
+  CHECK_EQ(value_of(cache, 4), 40);
+  CHECK_EQ(value_of(cache, 5), 50);
+
+  // Inserting a cached key replaces its value and evicts nothing, it becomes
+  // the most recent so 4 is evicted next
+  cache.insert(2, 21);
+  CHECK_EQ(cache.size(), 3u);
+  cache.insert(6, 60);
+  CHECK_EQ(value_of(cache, 4), -1);
+  CHECK_EQ(value_of(cache, 2), 21);
+  CHECK_EQ(value_of(cache, 5), 50);
+  CHECK_EQ(value_of(cache, 6), 60);
+
+  cache.clear();
+  CHECK_EQ(cache.size(), 0u);
+  CHECK_EQ(value_of(cache, 6), -1);
+  cache.insert(7, 70);
+  CHECK_EQ(value_of(cache, 7), 70);
+}
+
+// A capacity of 0 still keeps the last entry
+void check_single() {
+  LruCache<std::string, int> cache(0);
+  cache.insert("a", 1);
+  cache.insert("b", 2);
+  CHECK_EQ(cache.size(), 1u);
+  CHECK(cache.find("a") == nullptr);
+  CHECK(cache.find("b") != nullptr);
+}
+
+}  // namespace
+
+int main() {
+  check_eviction();
+  check_single();
+  return test_result("lru_cache_test");
+}
@@ -0,0 +1,171 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks of NnModel on the test model: inference through the copying and
+// the zero-copy APIs, the fused top-k and the batched input. A real model
+// can be checked too by setting WINDOW_TEST_MODEL to its path.
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "nn_model.h"
+#include "test_check.h"
+#include "test_model.h"
+
+namespace {
+
+// Input with the given value on the diagonal pixel of each class
+std::vector<float> make_input(const std::vector<std::pair<int, float>> &ink) {
+  std::vector<float> input(kTestPixels, 0.0f);
+  for (const auto &pixel : ink)
+    input[pixel.first * kTestSide + pixel.first] = pixel.second;
+  return input;
+}
+
+// Softmax of the logits the test model gives for input
+std::vector<float> expected_scores(const std::vector<float> &input) {
+  std::vector<float> scores(kTestClasses);
+  double sum = 0.0;
+  for (int k = 0; k < kTestClasses; k++) {
+    scores[k] = std::exp(input[k * kTestSide + k] + test_model_bias(k));
+    sum += scores[k];
+  }
+  for (float &score : scores) score /= sum;
+  return scores;
+}
+
+std::unique_ptr<NnModel> build(
+    std::shared_ptr<tflite::FlatBufferModel> model) {
+  NnModelOptions options;
+  options.backends = {Backend::builtin};
+  return std::make_unique<NnModel>(std::move(model), options);
+}
+
+// Top-k is sorted, matches the expected scores and the classes add up to one
+void check_top_k(NnModel &nn, int row, const std::vector<float> &expected,
+                 int best) {
+  ClassScore top[kTestClasses];
+  CHECK_EQ(nn.top_k(row, top, 3), 3u);
+  CHECK_EQ(top[0].index, best);
+  for (int i = 0; i < 3; i++) {
+    CHECK(top[i].index >= 0 && top[i].index < kTestClasses);
+    if (top[i].index < 0 || top[i].index >= kTestClasses) continue;
+    CHECK_NEAR(top[i].probability, expected[top[i].index], 1e-5);
+    if (i > 0) CHECK(top[i - 1].probability >= top[i].probability);
+  }
+  CHECK_EQ(nn.top_k(row, top, kTestClasses),
+           static_cast<size_t>(kTestClasses));
+  double sum = 0.0;
+  for (const ClassScore &score : top) sum += score.probability;
+  CHECK_NEAR(sum, 1.0, 1e-5);
+}
+
+void check_softmax_model() {
+  auto nn = build(make_test_model(true));
+  const InputSpec &spec = nn->input_spec();
+  CHECK(spec.supported());
+  CHECK(spec.type == InputType::float32);
+  CHECK(spec.layout == TensorLayout::nhwc);
+  CHECK_EQ(spec.width, kTestSide);
+  CHECK_EQ(spec.height, kTestSide);
+  CHECK_EQ(spec.channels, 1);
+
+  // Class 3 gets 2.3, class 7 1.7 and class 9 0.9
+  std::vector<float> input = make_input({{3, 2.0f}, {7, 1.0f}});
+  std::vector<float> expected = expected_scores(input);
+  std::vector<float> scores = nn->infer<float>(input);
+  CHECK_EQ(scores.size(), static_cast<size_t>(kTestClasses));
+  for (size_t k = 0; k < scores.size() && k < expected.size(); k++)
+    CHECK_NEAR(scores[k], expected[k], 1e-5);
+  check_top_k(*nn, 0, expected, 3);
+
+  ClassScore top[3];
+  nn->top_k(0, top, 3);
+  CHECK_EQ(top[1].index, 7);
+  CHECK_EQ(top[2].index, 9);
+
+  // Zero-copy path, written in place and read from the output tensor
+  std::vector<float> other = make_input({{5, 4.0f}});
+  TensorSpan<float> in = nn->input_span<float>();
+  CHECK_EQ(in.size, static_cast<size_t>(kTestPixels));
+  for (size_t i = 0; i < in.size; i++) in[i] = other[i];
+  CHECK(nn->invoke());
+  TensorSpan<const float> out = nn->output_span<float>();
+  expected = expected_scores(other);
+  for (size_t k = 0; k < out.size && k < expected.size(); k++)
+    CHECK_NEAR(out[k], expected[k], 1e-5);
+  float dequantized[kTestClasses];
+  CHECK_EQ(nn->dequantize_output(dequantized, kTestClasses),
+           static_cast<size_t>(kTestClasses));
+  CHECK_NEAR(dequantized[5], expected[5], 1e-6);
+
+  // Two images per invoke, each row keeps its own result. The builtin
+  // kernels can always resize the batch
+  CHECK(nn->set_batch_size(2));
+  if (nn->batch_size() != 2) return;
+  std::vector<float> first = make_input({{1, 3.0f}});
+  std::vector<float> second = make_input({{8, 3.0f}});
+  TensorSpan<float> row0 = nn->input_row<float>(0);
+  TensorSpan<float> row1 = nn->input_row<float>(1);
+  CHECK_EQ(row0.size, static_cast<size_t>(kTestPixels));
+  for (size_t i = 0; i < row0.size; i++) row0[i] = first[i];
+  for (size_t i = 0; i < row1.size; i++) row1[i] = second[i];
+  CHECK(nn->invoke());
+  check_top_k(*nn, 0, expected_scores(first), 1);
+  check_top_k(*nn, 1, expected_scores(second), 8);
+}
+
+void check_logits_model() {
+  // Without the softmax the model outputs logits, top-k turns them into
+  // the same probabilities
+  auto nn = build(make_test_model(false));
+  std::vector<float> input = make_input({{0, 1.5f}, {6, 0.5f}});
+  std::vector<float> logits = nn->infer<float>(input);
+  CHECK_EQ(logits.size(), static_cast<size_t>(kTestClasses));
+  for (int k = 0; k < kTestClasses && k < static_cast<int>(logits.size());
+       k++)
+    CHECK_NEAR(logits[k], input[k * kTestSide + k] + test_model_bias(k),
+               1e-6);
+  check_top_k(*nn, 0, expected_scores(input), 0);
+}
+
+// Any model: the top classes are sorted and the distribution adds up to one
+void check_model_file(const char *path) {
+  NnModelOptions options;
+  options.backends = {Backend::builtin};
+  NnModel nn(NnModel::load_model(path), options);
+  CHECK(nn.input_spec().supported());
+  InputAdapter adapter(nn.input_spec(), Preprocessing::downscale);
+  if (adapter.valid()) std::memset(nn.input_row_data(0), 0, adapter.bytes());
+  CHECK(nn.invoke());
+  std::vector<ClassScore> top(1000);
+  size_t count = nn.top_k(0, top.data(), top.size());
+  CHECK(count > 0);
+  double sum = 0.0;
+  for (size_t i = 0; i < count; i++) {
+    sum += top[i].probability;
+    if (i > 0) CHECK(top[i - 1].probability >= top[i].probability);
+  }
+  CHECK_NEAR(sum, 1.0, 0.05);
+}
+
+}  // namespace
+
+int main() {
+  try {
+    check_softmax_model();
+    check_logits_model();
+    if (const char *path = std::getenv("WINDOW_TEST_MODEL"))
+      check_model_file(path);
+  } catch (const std::exception &e) {
+    std::cerr << "nn_model_test: " << e.what() << std::endl;
+    return 1;
+  }
+  return test_result("nn_model_test");
+}
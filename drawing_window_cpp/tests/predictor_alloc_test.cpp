@@ -0,0 +1,123 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks that Predictor does not allocate once it is warm. The global
+// operator new is replaced to count the allocations, so this test has its
+// own executable.
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <vector>
+
+#include "predictor.h"
+#include "test_check.h"
+#include "test_model.h"
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+
+void *counted_alloc(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+}  // namespace
+
+void *operator new(size_t size) { return counted_alloc(size); }
+void *operator new[](size_t size) { return counted_alloc(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr int kCanvasSize = 250;
+constexpr int kCalls = 100;
+
+// Runs predict once to warm up, then kCalls times counting the allocations,
+// and checks the digit of every call
+template <typename Predict>
+void check_no_allocations(const char *path, Predict predict, int digit) {
+  CHECK_EQ(predict(), digit);
+  size_t before = allocations.load();
+  bool same = true;
+  for (int i = 0; i < kCalls; i++) same = predict() == digit && same;
+  size_t allocated = allocations.load() - before;
+  if (allocated != 0)
+    std::cerr << path << ": " << allocated << " allocations in " << kCalls
+              << " calls" << std::endl;
+  CHECK_EQ(allocated, 0u);
+  CHECK(same);
+}
+
+void check_predictor(NnModel &nn) {
+  // White square on the pixels the downscale maps onto output (4, 4), the
+  // test model predicts the class of the lit diagonal pixel
+  const int stride = kCanvasSize * 4;
+  std::vector<uint8_t> argb(stride * kCanvasSize, 0);
+  for (int y = 36; y < 44; y++)
+    for (int x = 36; x < 44; x++)
+      for (int c = 0; c < 4; c++) argb[y * stride + x * 4 + c] = 255;
+
+  // A dot on the center of output (6, 6)
+  VectorCanvas canvas;
+  canvas.width = kCanvasSize;
+  canvas.height = kCanvasSize;
+  canvas.brush = 10.0;
+  const float center = 6.5f * kCanvasSize / kTestSide;
+  canvas.strokes.begin_stroke(center, center, 0);
+
+  Predictor downscale(nn, Preprocessing::downscale);
+  check_no_allocations(
+      "image",
+      [&] {
+        return downscale.predict(argb.data(), kCanvasSize, kCanvasSize,
+                                 stride);
+      },
+      4);
+  check_no_allocations(
+      "vector", [&] { return downscale.predict(canvas); }, 6);
+
+  // The MNIST normalization blows the ink up to the 20x20 box in the
+  // center, which lights the diagonal pixels of classes 4 to 9, and the
+  // largest bias wins
+  Predictor mnist(nn, Preprocessing::mnist);
+  check_no_allocations(
+      "mnist image",
+      [&] {
+        return mnist.predict(argb.data(), kCanvasSize, kCanvasSize, stride);
+      },
+      kTestClasses - 1);
+  check_no_allocations(
+      "mnist vector", [&] { return mnist.predict(canvas); },
+      kTestClasses - 1);
+}
+
+}  // namespace
+
+int main() {
+  try {
+    NnModelOptions options;
+    options.backends = {Backend::builtin};
+    NnModel nn(make_test_model(true), options);
+    check_predictor(nn);
+  } catch (const std::exception &e) {
+    std::cerr << "predictor_alloc_test: " << e.what() << std::endl;
+    return 1;
+  }
+  return test_result("predictor_alloc_test");
+}
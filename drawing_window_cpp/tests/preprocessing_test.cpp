@@ -0,0 +1,249 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks of the preprocessing kernels, the quantization tables, the SIMD
+// luminance, the area downscale and the MNIST normalization.
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "preprocessing.h"
+#include "test_check.h"
+
+namespace {
+
+// ARGB32 image filled with one color, stored as BGRA like Cairo
+struct Image {
+  Image(int w, int h, uint8_t r, uint8_t g, uint8_t b)
+      : width(w), height(h), stride(w * 4), data(stride * h) {
+    for (int y = 0; y < h; y++)
+      for (int x = 0; x < w; x++) set(x, y, r, g, b);
+  }
+  void set(int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+    uint8_t *pixel = data.data() + y * stride + x * 4;
+    pixel[0] = b;
+    pixel[1] = g;
+    pixel[2] = r;
+    pixel[3] = 255;
+  }
+  // Fills the rectangle [x0, x1) x [y0, y1) with white
+  void fill(int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++)
+      for (int x = x0; x < x1; x++) set(x, y, 255, 255, 255);
+  }
+
+  int width, height, stride;
+  std::vector<uint8_t> data;
+};
+
+void check_input_luts() {
+  InputLut<float> f = make_input_lut<float>(0.0f, 0);
+  CHECK_EQ(f[0], 0.0f);
+  CHECK_EQ(f[255], 1.0f);
+  CHECK_NEAR(f[51], 0.2, 1e-6);
+
+  // Usual [0, 1] quantizations, the whole range of the type is used
+  InputLut<int8_t> i8 = make_input_lut<int8_t>(1.0f / 255.0f, -128);
+  CHECK_EQ(i8[0], -128);
+  CHECK_EQ(i8[255], 127);
+  InputLut<uint8_t> u8 = make_input_lut<uint8_t>(1.0f / 255.0f, 0);
+  for (int gray = 0; gray < 256; gray++) CHECK_EQ(u8[gray], gray);
+
+  // A coarser scale saturates instead of wrapping
+  InputLut<int8_t> coarse = make_input_lut<int8_t>(1.0f / 127.0f, 0);
+  CHECK_EQ(coarse[0], 0);
+  CHECK_EQ(coarse[255], 127);
+  CHECK_EQ(coarse[128], 64);
+
+  // Without quantization parameters the gray levels are shifted or kept
+  InputLut<int8_t> shifted = make_input_lut<int8_t>(0.0f, 0);
+  CHECK_EQ(shifted[0], -128);
+  CHECK_EQ(shifted[200], 72);
+}
+
+// Plain loop with the luminance weights, the SIMD paths must match it
+uint8_t scalar_luminance(const uint8_t *pixel) {
+  return static_cast<uint8_t>(
+      (54 * pixel[2] + 183 * pixel[1] + 19 * pixel[0] + 128) >> 8);
+}
+
+void check_luminance() {
+  std::mt19937 random(42);
+  std::uniform_int_distribution<int> byte(0, 255);
+  // Widths around the 16 pixels of a vector iteration, rows padded so the
+  // stride is not width * 4 and the rows do not start 16 byte aligned
+  for (int width = 1; width <= 70; width++) {
+    for (int padding : {4, 12, 36}) {
+      const int height = 3;
+      const int stride = width * 4 + padding;
+      std::vector<uint8_t> argb(stride * height);
+      for (uint8_t &value : argb) value = static_cast<uint8_t>(byte(random));
+      std::vector<uint8_t> gray(width);
+      for (int y = 0; y < height; y++) {
+        const uint8_t *row = argb.data() + y * stride;
+        argb_to_luminance(row, gray.data(), width);
+        for (int x = 0; x < width; x++)
+          CHECK_EQ(gray[x], scalar_luminance(row + x * 4));
+      }
+
+      // Same through the downscaler at 1:1, where each output has a single
+      // tap of weight one
+      GrayDownscaler identity(width, height, width, height);
+      std::vector<uint8_t> out(width * height);
+      identity.run(argb.data(), stride, out.data());
+      for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+          CHECK_EQ(out[y * width + x],
+                   scalar_luminance(argb.data() + y * stride + x * 4));
+    }
+  }
+}
+
+void check_downscale() {
+  // A flat color stays flat whatever the ratio, gray stays gray
+  for (int size : {28, 56, 100, 250}) {
+    Image gray(size, size, 100, 100, 100);
+    GrayDownscaler downscaler(size, size, 28, 28);
+    std::vector<uint8_t> out(28 * 28);
+    downscaler.run(gray.data.data(), gray.stride, out.data());
+    for (uint8_t value : out) CHECK_EQ(value, 100);
+
+    Image white(size, size, 255, 255, 255);
+    downscaler.run(white.data.data(), white.stride, out.data());
+    for (uint8_t value : out) CHECK_EQ(value, 255);
+  }
+
+  // Luminance of pure colors, weight * 255 / 256 rounded
+  uint8_t out = 0;
+  GrayDownscaler single(1, 1, 1, 1);
+  Image red(1, 1, 255, 0, 0), green(1, 1, 0, 255, 0), blue(1, 1, 0, 0, 255);
+  single.run(red.data.data(), red.stride, &out);
+  CHECK_EQ(out, 54);
+  single.run(green.data.data(), green.stride, &out);
+  CHECK_EQ(out, 182);
+  single.run(blue.data.data(), blue.stride, &out);
+  CHECK_EQ(out, 19);
+
+  // Area average, every output of a 2x reduction of a checkerboard covers
+  // two black and two white pixels
+  Image board(56, 56, 0, 0, 0);
+  for (int y = 0; y < 56; y++)
+    for (int x = (y & 1); x < 56; x += 2) board.set(x, y, 255, 255, 255);
+  GrayDownscaler half(56, 56, 28, 28);
+  std::vector<uint8_t> averaged(28 * 28);
+  half.run(board.data.data(), board.stride, averaged.data());
+  for (uint8_t value : averaged) CHECK_NEAR(value, 127.5, 0.5);
+
+  // A white square lands on the matching outputs and nowhere else
+  Image square(100, 100, 0, 0, 0);
+  square.fill(0, 0, 50, 50);
+  GrayDownscaler quarter(100, 100, 4, 4);
+  uint8_t blocks[16];
+  quarter.run(square.data.data(), square.stride, blocks);
+  for (int y = 0; y < 4; y++)
+    for (int x = 0; x < 4; x++)
+      CHECK_EQ(blocks[y * 4 + x], (x < 2 && y < 2) ? 255 : 0);
+
+  // The lut is applied as the outputs are written, padded strides are
+  // honored
+  Image padded(60, 30, 255, 255, 255);
+  padded.stride = 60 * 4 + 32;
+  padded.data.assign(padded.stride * 30, 0);
+  padded.fill(0, 0, 60, 30);
+  GrayDownscaler lut_downscaler(60, 30, 6, 3);
+  const InputLut<int8_t> lut = make_input_lut<int8_t>(1.0f / 255.0f, -128);
+  int8_t quantized[18];
+  lut_downscaler.run<int8_t>(padded.data.data(), padded.stride, quantized,
+                             lut);
+  for (int8_t value : quantized) CHECK_EQ(value, 127);
+}
+
+void check_run_gray() {
+  // The gray path matches the ARGB path on an image that is already gray
+  Image argb(90, 70, 0, 0, 0);
+  std::vector<uint8_t> gray(90 * 70, 0);
+  for (int y = 0; y < 70; y++) {
+    for (int x = 0; x < 90; x++) {
+      uint8_t level = static_cast<uint8_t>((x * 7 + y * 13) % 256);
+      argb.set(x, y, level, level, level);
+      gray[y * 90 + x] = level;
+    }
+  }
+  GrayDownscaler downscaler(90, 70, 28, 28);
+  const InputLut<float> lut = make_input_lut<float>(0.0f, 0);
+  std::vector<float> from_argb(28 * 28), from_gray(28 * 28);
+  downscaler.run<float>(argb.data.data(), argb.stride, from_argb.data(), lut);
+  downscaler.run_gray<float>(gray.data(), 90, from_gray.data(), lut);
+  CHECK(from_argb == from_gray);
+}
+
+void check_normalizer() {
+  const InputLut<uint8_t> lut = make_input_lut<uint8_t>(0.0f, 0);
+  DigitNormalizer normalizer;
+  std::vector<uint8_t> out(DigitNormalizer::kSize * DigitNormalizer::kSize);
+
+  // An empty image has no ink and is written as the background
+  Image empty(250, 250, 0, 0, 0);
+  out.assign(out.size(), 77);
+  normalizer.run<uint8_t>(empty.data.data(), 250, 250, empty.stride,
+                          out.data(), lut);
+  CHECK(normalizer.stats().empty());
+  for (uint8_t value : out) CHECK_EQ(value, 0);
+
+  // A bar in a corner is measured, scaled into the box and centered by mass
+  Image bar(250, 250, 0, 0, 0);
+  bar.fill(10, 20, 30, 120);
+  normalizer.run<uint8_t>(bar.data.data(), 250, 250, bar.stride, out.data(),
+                          lut);
+  const InkStats &stats = normalizer.stats();
+  CHECK_EQ(stats.x0, 10);
+  CHECK_EQ(stats.y0, 20);
+  CHECK_EQ(stats.x1, 30);
+  CHECK_EQ(stats.y1, 120);
+  CHECK_NEAR(stats.cx, 20.0, 1e-9);
+  CHECK_NEAR(stats.cy, 70.0, 1e-9);
+
+  double mass = 0.0, cx = 0.0, cy = 0.0;
+  int top = DigitNormalizer::kSize, bottom = 0;
+  for (int y = 0; y < DigitNormalizer::kSize; y++) {
+    for (int x = 0; x < DigitNormalizer::kSize; x++) {
+      double value = out[y * DigitNormalizer::kSize + x];
+      mass += value;
+      cx += value * (x + 0.5);
+      cy += value * (y + 0.5);
+      if (value > 0) {
+        top = std::min(top, y);
+        bottom = std::max(bottom, y + 1);
+      }
+    }
+  }
+  CHECK(mass > 0.0);
+  CHECK_NEAR(cx / mass, DigitNormalizer::kSize / 2.0, 0.5);
+  CHECK_NEAR(cy / mass, DigitNormalizer::kSize / 2.0, 0.5);
+  // The long side fills the box, up to a partial pixel on each end
+  CHECK(bottom - top >= DigitNormalizer::kBox);
+  CHECK(bottom - top <= DigitNormalizer::kBox + 2);
+
+  // Gray images give the same result read in place
+  std::vector<uint8_t> gray(250 * 250, 0);
+  for (int y = 20; y < 120; y++)
+    std::fill(gray.begin() + y * 250 + 10, gray.begin() + y * 250 + 30, 255);
+  std::vector<uint8_t> from_gray(out.size());
+  normalizer.run_gray<uint8_t>(gray.data(), 250, 250, 250, from_gray.data(),
+                               lut);
+  CHECK(from_gray == out);
+}
+
+}  // namespace
+
+int main() {
+  check_input_luts();
+  check_luminance();
+  check_downscale();
+  check_run_gray();
+  check_normalizer();
+  return test_result("preprocessing_test");
+}
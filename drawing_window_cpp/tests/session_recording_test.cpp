@@ -0,0 +1,140 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks of the session files, the events read back as they were recorded,
+// the files that are not sessions and a session cut short by a crash.
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "session_recording.h"
+#include "test_check.h"
+
+namespace {
+
+std::vector<char> read_file(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>()};
+}
+
+void write_file(const std::string &path, const std::vector<char> &bytes) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(bytes.data(), bytes.size());
+}
+
+void check_event(const SessionEvent &event, SessionEvent::Type type, float x,
+                 float y) {
+  CHECK_EQ(event.type, type);
+  CHECK_EQ(event.x, x);
+  CHECK_EQ(event.y, y);
+}
+
+// Positions are rounded to 1/8 pixel and clamped to 16 bits
+void check_round_trip(const std::string &path) {
+  {
+    SessionRecorder recorder(path.c_str(), 500, 250, 10.0);
+    recorder.record(SessionEvent::press, 10.3, 20.06);
+    recorder.record(SessionEvent::motion, -1.5, 249.875);
+    recorder.record(SessionEvent::motion, 5000.0, -5000.0);
+    recorder.record(SessionEvent::release);
+    recorder.record(SessionEvent::predict);
+    recorder.record(SessionEvent::clear);
+    CHECK_EQ(recorder.events(), 6u);
+  }
+  Session session;
+  CHECK(read_session(path.c_str(), session));
+  CHECK_EQ(session.width, 500);
+  CHECK_EQ(session.height, 250);
+  CHECK_EQ(session.brush, 10.0);
+  CHECK_EQ(session.events.size(), 6u);
+  if (session.events.size() != 6) return;
+  check_event(session.events[0], SessionEvent::press, 10.25f, 20.0f);
+  check_event(session.events[1], SessionEvent::motion, -1.5f, 249.875f);
+  check_event(session.events[2], SessionEvent::motion, 4095.875f, -4096.0f);
+  check_event(session.events[3], SessionEvent::release, 0.0f, 0.0f);
+  check_event(session.events[4], SessionEvent::predict, 0.0f, 0.0f);
+  check_event(session.events[5], SessionEvent::clear, 0.0f, 0.0f);
+  for (size_t i = 1; i < session.events.size(); i++) {
+    CHECK(session.events[i].time >= session.events[i - 1].time);
+  }
+}
+
+void check_rejected(const std::string &path, const std::string &other) {
+  const std::vector<char> bytes = read_file(path);
+
+  // Magic
+  std::vector<char> bad = bytes;
+  bad[0] = 'X';
+  write_file(other, bad);
+  Session session;
+  CHECK(!read_session(other.c_str(), session));
+
+  // Version, right after the magic
+  bad = bytes;
+  bad[4] = 2;
+  write_file(other, bad);
+  CHECK(!read_session(other.c_str(), session));
+
+  // Shorter than the header
+  write_file(other, std::vector<char>(bytes.begin(), bytes.begin() + 10));
+  CHECK(!read_session(other.c_str(), session));
+
+  // An event type past the last one, the type follows time, x and y
+  bad = bytes;
+  bad[16 + 8] = 9;
+  write_file(other, bad);
+  CHECK(!read_session(other.c_str(), session));
+
+  CHECK(!read_session((path + ".missing").c_str(), session));
+}
+
+// The last event lost its tail, the complete ones are kept
+void check_truncated(const std::string &path, const std::string &other) {
+  std::vector<char> bytes = read_file(path);
+  bytes.resize(bytes.size() - 5);
+  write_file(other, bytes);
+  Session full, truncated;
+  CHECK(read_session(path.c_str(), full));
+  CHECK(read_session(other.c_str(), truncated));
+  CHECK_EQ(truncated.events.size(), 5u);
+  for (size_t i = 0; i < truncated.events.size() && i < full.events.size();
+       i++) {
+    CHECK_EQ(truncated.events[i].type, full.events[i].type);
+    CHECK_EQ(truncated.events[i].time, full.events[i].time);
+    CHECK_EQ(truncated.events[i].x, full.events[i].x);
+    CHECK_EQ(truncated.events[i].y, full.events[i].y);
+  }
+
+  // Only the header, no events
+  bytes.resize(16);
+  write_file(other, bytes);
+  CHECK(read_session(other.c_str(), truncated));
+  CHECK(truncated.events.empty());
+}
+
+}  // namespace
+
+int main() {
+  char dir[] = "/tmp/session_recording_testXXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    std::cerr << "Unable to create a temporary directory" << std::endl;
+    return 1;
+  }
+  const std::string path = std::string(dir) + "/session.dws";
+  const std::string other = std::string(dir) + "/other.dws";
+  check_round_trip(path);
+  check_rejected(path, other);
+  check_truncated(path, other);
+  unlink(path.c_str());
+  unlink(other.c_str());
+  rmdir(dir);
+  return test_result("session_recording_test");
+}
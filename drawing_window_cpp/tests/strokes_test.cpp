@@ -0,0 +1,137 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Checks of the vector stroke model, its hash and the stroke rasterizer.
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "strokes.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr int kCanvas = 280;  // 10 canvas pixels per output pixel
+constexpr int kOut = 28;
+
+void check_hash() {
+  StrokeSet a, b;
+  CHECK(a.hash() == b.hash());
+  a.begin_stroke(10, 20, 0);
+  a.add_point(30, 40, 5);
+  // Same positions at other times give the same hash
+  b.begin_stroke(10, 20, 100);
+  b.add_point(30, 40, 900);
+  CHECK(a.hash() == b.hash());
+  CHECK_EQ(a.size(), 2u);
+  CHECK_EQ(a.stroke_count(), 1u);
+
+  // The same points split in two strokes are another drawing
+  StrokeSet split;
+  split.begin_stroke(10, 20, 0);
+  split.begin_stroke(30, 40, 5);
+  CHECK(split.hash() != a.hash());
+  CHECK_EQ(split.stroke_count(), 2u);
+  CHECK(&split.segment_start(1) == &split.points()[1]);
+  CHECK(&a.segment_start(1) == &a.points()[0]);
+
+  a.clear();
+  CHECK(a.empty());
+  CHECK(a.hash() == StrokeSet().hash());
+}
+
+void check_rasterizer() {
+  const InputLut<uint8_t> lut = make_input_lut<uint8_t>(0.0f, 0);
+  StrokeRasterizer rasterizer;
+  std::vector<uint8_t> out(kOut * kOut, 77);
+
+  // No strokes, no ink
+  StrokeSet empty;
+  rasterizer.run<uint8_t>(empty, 20.0, kCanvas, kCanvas, kOut, kOut,
+                          out.data(), lut);
+  for (uint8_t value : out) CHECK_EQ(value, 0);
+
+  // A dot on the corner shared by the four central pixels, they are fully
+  // covered, the image is symmetric and nothing is drawn beyond the brush
+  StrokeSet dot;
+  dot.begin_stroke(140, 140, 0);
+  rasterizer.run<uint8_t>(dot, 20.0, kCanvas, kCanvas, kOut, kOut, out.data(),
+                          lut);
+  for (int y : {13, 14})
+    for (int x : {13, 14}) CHECK_EQ(out[y * kOut + x], 255);
+  for (int y = 0; y < kOut; y++) {
+    for (int x = 0; x < kOut; x++) {
+      CHECK_EQ(out[y * kOut + x], out[x * kOut + y]);
+      CHECK_EQ(out[y * kOut + x], out[y * kOut + (kOut - 1 - x)]);
+      // Pixel centers further than the radius plus one pixel stay empty
+      double dx = (x + 0.5) * 10 - 140, dy = (y + 0.5) * 10 - 140;
+      if (dx * dx + dy * dy > 30.0 * 30.0) CHECK_EQ(out[y * kOut + x], 0);
+    }
+  }
+
+  // A horizontal line covers its rows with the same values along the line,
+  // the rows out of reach of the brush stay empty
+  StrokeSet line;
+  line.begin_stroke(40, 140, 0);
+  line.add_point(240, 140, 10);
+  const InputLut<float> flut = make_input_lut<float>(0.0f, 0);
+  std::vector<float> coverage(kOut * kOut);
+  rasterizer.run<float>(line, 10.0, kCanvas, kCanvas, kOut, kOut,
+                        coverage.data(), flut);
+  for (int y = 0; y < kOut; y++) {
+    for (int x = 6; x < 22; x++)
+      CHECK_EQ(coverage[y * kOut + x], coverage[y * kOut + 6]);
+    if (y < 11 || y > 16)
+      for (int x = 0; x < kOut; x++) CHECK_EQ(coverage[y * kOut + x], 0.0f);
+  }
+  CHECK_EQ(coverage[13 * kOut + 10], 1.0f);
+  CHECK_EQ(coverage[14 * kOut + 10], 1.0f);
+}
+
+void check_normalized() {
+  const InputLut<float> lut = make_input_lut<float>(0.0f, 0);
+  StrokeRasterizer rasterizer;
+  std::vector<float> out(kOut * kOut, 0.5f);
+
+  StrokeSet empty;
+  rasterizer.run_normalized<float>(empty, 10.0, out.data(), lut);
+  for (float value : out) CHECK_EQ(value, 0.0f);
+
+  // An L drawn in a corner ends up with its center of mass in the center
+  // and its long side filling the box
+  StrokeSet corner;
+  corner.begin_stroke(20, 20, 0);
+  corner.add_point(20, 100, 10);
+  corner.add_point(60, 100, 20);
+  rasterizer.run_normalized<float>(corner, 5.0, out.data(), lut);
+  double mass = 0.0, cx = 0.0, cy = 0.0;
+  int top = kOut, bottom = 0;
+  for (int y = 0; y < kOut; y++) {
+    for (int x = 0; x < kOut; x++) {
+      float value = out[y * kOut + x];
+      mass += value;
+      cx += value * (x + 0.5);
+      cy += value * (y + 0.5);
+      if (value > 0.0f) {
+        top = std::min(top, y);
+        bottom = std::max(bottom, y + 1);
+      }
+    }
+  }
+  CHECK(mass > 0.0);
+  CHECK_NEAR(cx / mass, kOut / 2.0, 0.5);
+  CHECK_NEAR(cy / mass, kOut / 2.0, 0.5);
+  CHECK(bottom - top >= DigitNormalizer::kBox - 1);
+  CHECK(bottom - top <= DigitNormalizer::kBox + 2);
+}
+
+}  // namespace
+
+int main() {
+  check_hash();
+  check_rasterizer();
+  check_normalized();
+  return test_result("strokes_test");
+}
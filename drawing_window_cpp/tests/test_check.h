@@ -0,0 +1,61 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Minimal checks for the unit tests, a failed check prints where it failed
+// and the test keeps going so a run reports every failure at once.
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+// Number of failed checks of the test
+inline int &check_failures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition)                                                     \
+  do {                                                                       \
+    if (!(condition)) {                                                      \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition      \
+                << ") failed" << std::endl;                                  \
+      check_failures()++;                                                    \
+    }                                                                        \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                       \
+  do {                                                                       \
+    const auto check_a = (a);                                                \
+    const auto check_b = (b);                                                \
+    if (!(check_a == check_b)) {                                             \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b   \
+                << ") failed, " << +check_a << " != " << +check_b            \
+                << std::endl;                                                \
+      check_failures()++;                                                    \
+    }                                                                        \
+  } while (0)
+
+#define CHECK_NEAR(a, b, tolerance)                                          \
+  do {                                                                       \
+    const double check_a = (a);                                              \
+    const double check_b = (b);                                              \
+    if (!(std::fabs(check_a - check_b) <= (tolerance))) {                    \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_NEAR(" #a         \
+                << ", " #b ") failed, " << check_a << " vs " << check_b      \
+                << std::endl;                                                \
+      check_failures()++;                                                    \
+    }                                                                        \
+  } while (0)
+
+// Prints the outcome of the test, its value is the exit code for ctest
+inline int test_result(const char *name) {
+  if (check_failures() == 0) {
+    std::cout << name << ": all checks passed" << std::endl;
+    return 0;
+  }
+  std::cerr << name << ": " << check_failures() << " checks failed"
+            << std::endl;
+  return 1;
+}
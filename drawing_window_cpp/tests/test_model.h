@@ -0,0 +1,108 @@
+//
+// Copyright (c) Manuel Rodriguez.
+// Licensed under the MIT license. See LICENSE file in the project root for
+// details.
+//
+// Tiny float model built in memory for the tests, models/ only ships the
+// training scripts so there is no .tflite file to load.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "flatbuffers/flatbuffers.h"
+#include "tensorflow/lite/model_builder.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+constexpr int kTestSide = 28;
+constexpr int kTestPixels = kTestSide * kTestSide;
+constexpr int kTestClasses = 10;
+
+// Logit of class k is the pixel (k, k) of the input plus its bias
+inline float test_model_bias(int k) { return k / 10.0f; }
+
+/// Builds a model with a 1x28x28x1 float input and a fully connected layer
+/// that gives the 10 logits described by test_model_bias, followed by a
+/// softmax when softmax is set. Throws if TFLite rejects the model
+inline std::shared_ptr<tflite::FlatBufferModel> make_test_model(bool softmax) {
+  flatbuffers::FlatBufferBuilder fbb;
+
+  // Buffer 0 is the empty one of the tensors without data
+  std::vector<float> weights(kTestClasses * kTestPixels, 0.0f);
+  std::vector<float> bias(kTestClasses);
+  for (int k = 0; k < kTestClasses; k++) {
+    weights[k * kTestPixels + k * kTestSide + k] = 1.0f;
+    bias[k] = test_model_bias(k);
+  }
+  auto constant = [&fbb](const std::vector<float> &values) {
+    size_t bytes = values.size() * sizeof(float);
+    fbb.ForceVectorAlignment(bytes, sizeof(uint8_t), 16);
+    return tflite::CreateBuffer(
+        fbb, fbb.CreateVector(
+                 reinterpret_cast<const uint8_t *>(values.data()), bytes));
+  };
+  std::vector<flatbuffers::Offset<tflite::Buffer>> buffers = {
+      tflite::CreateBuffer(fbb), constant(weights), constant(bias)};
+
+  auto tensor = [&fbb](const std::vector<int32_t> &shape, uint32_t buffer,
+                       const char *name) {
+    return tflite::CreateTensor(fbb, fbb.CreateVector(shape),
+                                tflite::TensorType_FLOAT32, buffer,
+                                fbb.CreateString(name));
+  };
+  std::vector<flatbuffers::Offset<tflite::Tensor>> tensors = {
+      tensor({1, kTestSide, kTestSide, 1}, 0, "input"),
+      tensor({kTestClasses, kTestPixels}, 1, "weights"),
+      tensor({kTestClasses}, 2, "bias"),
+      tensor({1, kTestClasses}, 0, "logits"),
+      tensor({1, kTestClasses}, 0, "scores")};
+
+  auto code = [&fbb](tflite::BuiltinOperator op) {
+    return tflite::CreateOperatorCode(fbb, static_cast<int8_t>(op), 0, 1, op);
+  };
+  std::vector<flatbuffers::Offset<tflite::OperatorCode>> codes = {
+      code(tflite::BuiltinOperator_FULLY_CONNECTED),
+      code(tflite::BuiltinOperator_SOFTMAX)};
+
+  std::vector<flatbuffers::Offset<tflite::Operator>> operators;
+  const std::vector<int32_t> fc_inputs = {0, 1, 2}, logits = {3}, scores = {4};
+  operators.push_back(tflite::CreateOperator(
+      fbb, 0, fbb.CreateVector(fc_inputs), fbb.CreateVector(logits),
+      tflite::BuiltinOptions_FullyConnectedOptions,
+      tflite::CreateFullyConnectedOptions(fbb).Union()));
+  if (softmax) {
+    operators.push_back(tflite::CreateOperator(
+        fbb, 1, fbb.CreateVector(logits), fbb.CreateVector(scores),
+        tflite::BuiltinOptions_SoftmaxOptions,
+        tflite::CreateSoftmaxOptions(fbb, 1.0f).Union()));
+  }
+
+  const std::vector<int32_t> inputs = {0};
+  auto subgraph = tflite::CreateSubGraph(
+      fbb, fbb.CreateVector(tensors), fbb.CreateVector(inputs),
+      fbb.CreateVector(softmax ? scores : logits), fbb.CreateVector(operators),
+      fbb.CreateString("main"));
+  auto model = tflite::CreateModel(
+      fbb, 3, fbb.CreateVector(codes), fbb.CreateVector(&subgraph, 1),
+      fbb.CreateString("window test model"), fbb.CreateVector(buffers));
+  tflite::FinishModelBuffer(fbb, model);
+
+  // The model does not own its buffer, the deleter keeps it alive. Copied
+  // into 16 byte blocks so the aligned constants stay aligned in memory
+  struct alignas(16) Block {
+    uint8_t bytes[16];
+  };
+  auto storage =
+      std::make_shared<std::vector<Block>>((fbb.GetSize() + 15) / 16);
+  std::memcpy(storage->data(), fbb.GetBufferPointer(), fbb.GetSize());
+  std::unique_ptr<tflite::FlatBufferModel> built =
+      tflite::FlatBufferModel::BuildFromBuffer(
+          reinterpret_cast<const char *>(storage->data()), fbb.GetSize());
+  if (!built) throw std::runtime_error("Unable to build the test model");
+  return std::shared_ptr<tflite::FlatBufferModel>(
+      built.release(),
+      [storage](tflite::FlatBufferModel *loaded) { delete loaded; });
+}
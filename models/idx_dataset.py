@@ -0,0 +1,26 @@
+#!/usr/bin/env python3
+
+import struct
+import numpy as np
+
+# Reads an unsigned byte IDX file, like the MNIST ones, into an array shaped
+# by its dimensions
+def read_idx(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[0] != 0 or data[1] != 0 or data[2] != 0x08 or data[3] == 0:
+        raise ValueError(f"Not an unsigned byte IDX file: {path}")
+    rank = data[3]
+    dims = struct.unpack(">" + "I" * rank, data[4:4 + 4 * rank])
+    count = int(np.prod(dims))
+    return np.frombuffer(data, np.uint8, count, 4 + 4 * rank).reshape(dims)
+
+# Samples saved by the window with --capture prefix, 28x28 images with the
+# ink in white like MNIST and their labels
+def load_captured(prefix):
+    images = read_idx(prefix + "-images-idx3-ubyte")
+    labels = read_idx(prefix + "-labels-idx1-ubyte")
+    if len(images) != len(labels):
+        raise ValueError(f"{prefix}: {len(images)} images but {len(labels)} labels")
+    print(f"Loaded {len(images)} captured samples from {prefix}")
+    return images, labels
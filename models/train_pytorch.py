@@ -1,9 +1,11 @@
 #!/usr/bin/env python3
 
+import argparse
 import torch
 from torch import nn
+from idx_dataset import load_captured
 from pytorch_model import NeuralNetwork
-from torch.utils.data import DataLoader
+from torch.utils.data import ConcatDataset, DataLoader
 from torchvision import datasets
 from torchvision.transforms import ToTensor, Lambda
 
@@ -44,10 +46,22 @@ def test(dataloader, model, loss_fn):
     correct /= size
     print(f"Test Error: \n Accuracy: {(100*correct):>0.1f}%, Avg loss: {test_loss:>8f} \n")
 
+parser = argparse.ArgumentParser()
+parser.add_argument("--captured", action="append", default=[], metavar="prefix",
+                    help="Also train on the samples saved by the window with --capture prefix")
+args = parser.parse_args()
+
 # Download MNIST dataset
 training_data = datasets.MNIST(root="data", train=True, download=True,transform=ToTensor())
 test_data = datasets.MNIST(root="data", train=False, download=True, transform=ToTensor())
 
+# Captured samples as the MNIST dataset gives them, a 1x28x28 tensor in
+# [0, 1] and an int label
+for prefix in args.captured:
+    images, labels = load_captured(prefix)
+    images = torch.tensor(images, dtype=torch.float32).unsqueeze(1) / 255.0
+    training_data = ConcatDataset([training_data, list(zip(images, labels.tolist()))])
+
 # Create Data loaders
 batch_size = 32
 train_dataloader = DataLoader(training_data, batch_size=batch_size)
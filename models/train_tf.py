@@ -1,9 +1,21 @@
 #!/usr/bin/env python3
 
+import argparse
+import numpy as np
 import tensorflow as tf
+from idx_dataset import load_captured
 mnist = tf.keras.datasets.mnist
 
+parser = argparse.ArgumentParser()
+parser.add_argument("--captured", action="append", default=[], metavar="prefix",
+                    help="Also train on the samples saved by the window with --capture prefix")
+args = parser.parse_args()
+
 (x_train, y_train),(x_test, y_test) = mnist.load_data()
+for prefix in args.captured:
+    images, labels = load_captured(prefix)
+    x_train = np.concatenate([x_train, images])
+    y_train = np.concatenate([y_train, labels])
 x_train, x_test = x_train / 255.0, x_test / 255.0
 
 model = tf.keras.models.Sequential([